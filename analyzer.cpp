@@ -0,0 +1,309 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "analyzer.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+    // how an instruction influences the control flow
+    enum flow : unsigned char {
+        invalid = 0, // not a valid opcode. Most likely we ran into data
+        next,        // continues with the next instruction
+        jump,        // 1NNN
+        call,        // 2NNN
+        ret,         // 00EE
+        skip,        // 3XNN, 4XNN, 5XY0, 9XY0, EX9E, EXA1
+        computed     // BNNN
+    };
+
+    flow classify(unsigned short opcode){
+        switch (opcode&0xF000){
+            case 0x0000:
+                if(opcode == 0x00E0)
+                    return next;
+                if(opcode == 0x00EE)
+                    return ret;
+                return invalid;
+            case 0x1000:
+                return jump;
+            case 0x2000:
+                return call;
+            case 0x3000:
+            case 0x4000:
+                return skip;
+            case 0x5000:
+            case 0x9000:
+                return (opcode&0x000F) == 0 ? skip : invalid;
+            case 0x8000:
+                switch (opcode&0x000F){
+                    case 0x0: case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x6: case 0x7: case 0xE:
+                        return next;
+                    default:
+                        return invalid;
+                }
+            case 0xB000:
+                return computed;
+            case 0xE000:
+                return ((opcode&0x00FF) == 0x9E || (opcode&0x00FF) == 0xA1) ? skip : invalid;
+            case 0xF000:
+                switch (opcode&0x00FF){
+                    case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x33: case 0x55: case 0x65:
+                        return next;
+                    default:
+                        return invalid;
+                }
+            default:
+                // 6XNN, 7XNN, ANNN, CXNN, DXYN
+                return next;
+        }
+    }
+}
+
+const basic_block *rom_analysis::block_at(unsigned short addr) const {
+    // the last block which starts at or before addr
+    auto it = std::upper_bound(blocks.begin(),blocks.end(),addr,[](unsigned short a, const basic_block &b){
+        return a < b.start;
+    });
+    if(it == blocks.begin())
+        return nullptr;
+    --it;
+    if(addr > it->end+1)
+        return nullptr;
+    return &*it;
+}
+
+rom_analysis analyze(const unsigned char *memory, unsigned short begin, unsigned short end){
+    rom_analysis result;
+    result.begin = begin;
+    result.end = end;
+    result.hash = fnv1a_64(memory+begin,end-begin);
+
+    // per address: the flow of the instruction starting there (invalid if there is none) and if a block starts there
+    std::vector<unsigned char> instruction(0x1000,invalid);
+    std::vector<bool> leader(0x1000,false);
+
+    std::vector<unsigned short> work {begin};
+    leader[begin] = true;
+    auto branch_to = [&](unsigned short target){
+        target &= 0x0FFF;
+        leader[target] = true;
+        work.push_back(target);
+    };
+
+    while(!work.empty()){
+        unsigned short pc = work.back();
+        work.pop_back();
+
+        // follow the straight line code until the control flow changes or we reach code we have already seen
+        while(pc >= begin && pc+1 < end && instruction[pc] == invalid){
+            unsigned short opcode = (memory[pc] << 8) | memory[pc+1];
+            flow f = classify(opcode);
+            if(f == invalid)
+                break;
+
+            instruction[pc] = f;
+            result.map[pc] = rom_analysis::code;
+            result.map[pc+1] = rom_analysis::code;
+
+            if((opcode&0xF000) == 0xA000)
+                result.data_references.push_back(opcode&0x0FFF);
+
+            if(f == next){
+                pc += 2;
+                continue;
+            }
+
+            switch (f){
+                case jump:
+                    branch_to(opcode);
+                    break;
+                case call:
+                    result.subroutines.push_back(opcode&0x0FFF);
+                    branch_to(opcode);
+                    // we assume that the subroutine returns
+                    branch_to(pc+2);
+                    break;
+                case skip:
+                    branch_to(pc+2);
+                    branch_to(pc+4);
+                    break;
+                case computed:
+                    result.computed_jumps.push_back(pc);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        }
+    }
+
+    // everything in the ROM which is not reachable is treated as data
+    for(unsigned short addr = begin; addr < end; ++addr){
+        if(result.map[addr] != rom_analysis::code)
+            result.map[addr] = rom_analysis::data;
+    }
+
+    // split the reachable instructions into basic blocks
+    basic_block *current = nullptr;
+    for(unsigned short pc = begin; pc+1 < end; ++pc){
+        if(instruction[pc] == invalid)
+            continue;
+        if(current == nullptr || leader[pc] || pc != current->end+2 || instruction[current->end] != next){
+            result.blocks.emplace_back();
+            current = &result.blocks.back();
+            current->start = pc;
+        }
+        current->end = pc;
+
+        unsigned short opcode = (memory[pc] << 8) | memory[pc+1];
+        switch (instruction[pc]){
+            case jump:
+                current->successors.push_back(opcode&0x0FFF);
+                break;
+            case call:
+                current->successors.push_back(opcode&0x0FFF);
+                current->successors.push_back(pc+2);
+                break;
+            case skip:
+                current->successors.push_back(pc+2);
+                current->successors.push_back(pc+4);
+                break;
+            case ret:
+                current->returns = true;
+                break;
+            case computed:
+                current->computed_jump = true;
+                break;
+            default:
+                break;
+        }
+    }
+    // a block which is cut by a leader falls through, a block which runs into invalid code does not
+    for(auto &block : result.blocks){
+        if(instruction[block.end] == next && block.successors.empty() && block.end+3 < end
+           && instruction[block.end+2] != invalid)
+            block.successors.push_back(block.end+2);
+    }
+
+    std::sort(result.subroutines.begin(),result.subroutines.end());
+    result.subroutines.erase(std::unique(result.subroutines.begin(),result.subroutines.end()),result.subroutines.end());
+    std::sort(result.data_references.begin(),result.data_references.end());
+    result.data_references.erase(std::unique(result.data_references.begin(),result.data_references.end()),
+                                 result.data_references.end());
+    return result;
+}
+
+std::shared_ptr<const rom_analysis> analyze_rom(const unsigned char *rom, size_t size){
+    struct entry {
+        std::vector<unsigned char> rom;
+        std::shared_ptr<const rom_analysis> analysis;
+    };
+    static std::mutex cache_mutex;
+    static std::unordered_map<uint64_t,entry> cache;
+    // insertion order of the cached hashes, the oldest one is evicted first
+    static std::deque<uint64_t> order;
+
+    size = std::min<size_t>(size,0x1000-0x200);
+    uint64_t hash = fnv1a_64(rom,size);
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(hash);
+        if(it != cache.end() && it->second.rom.size() == size && std::memcmp(it->second.rom.data(),rom,size) == 0)
+            return it->second.analysis;
+    }
+
+    // place the ROM where the interpreter would load it, so all addresses match
+    std::vector<unsigned char> memory(0x1000,0);
+    std::copy(rom,rom+size,memory.begin()+0x200);
+    std::shared_ptr<const rom_analysis> analysis = std::make_shared<rom_analysis>(analyze(memory.data(),0x200,0x200+size));
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    // a ROM with the same hash replaces the cached one
+    if(cache.find(hash) == cache.end()){
+        if(order.size() >= analysis_cache_size){
+            cache.erase(order.front());
+            order.pop_front();
+        }
+        order.push_back(hash);
+    }
+    cache[hash] = {std::vector<unsigned char>(rom,rom+size),analysis};
+    return analysis;
+}
+
+void disassemble(unsigned short opcode, char *buffer, size_t size){
+    unsigned vX = (opcode & 0x0F00) >> 8;
+    unsigned vY = (opcode & 0x00F0) >> 4;
+    unsigned nnn = opcode & 0x0FFF;
+    unsigned nn = opcode & 0x00FF;
+
+    if(classify(opcode) == invalid){
+        snprintf(buffer,size,"DW 0x%04X",opcode);
+        return;
+    }
+
+    switch (opcode&0xF000){
+        case 0x0000:
+            snprintf(buffer,size,opcode == 0x00E0 ? "CLS" : "RET");
+            break;
+        case 0x1000: snprintf(buffer,size,"JP 0x%03X",nnn); break;
+        case 0x2000: snprintf(buffer,size,"CALL 0x%03X",nnn); break;
+        case 0x3000: snprintf(buffer,size,"SE V%X,0x%02X",vX,nn); break;
+        case 0x4000: snprintf(buffer,size,"SNE V%X,0x%02X",vX,nn); break;
+        case 0x5000: snprintf(buffer,size,"SE V%X,V%X",vX,vY); break;
+        case 0x6000: snprintf(buffer,size,"LD V%X,0x%02X",vX,nn); break;
+        case 0x7000: snprintf(buffer,size,"ADD V%X,0x%02X",vX,nn); break;
+        case 0x8000: {
+            static const char *names[16] = {"LD","OR","AND","XOR","ADD","SUB","SHR","SUBN",
+                                            "","","","","","","SHL",""};
+            snprintf(buffer,size,"%s V%X,V%X",names[opcode&0x000F],vX,vY);
+            break;
+        }
+        case 0x9000: snprintf(buffer,size,"SNE V%X,V%X",vX,vY); break;
+        case 0xA000: snprintf(buffer,size,"LD I,0x%03X",nnn); break;
+        case 0xB000: snprintf(buffer,size,"JP V0,0x%03X",nnn); break;
+        case 0xC000: snprintf(buffer,size,"RND V%X,0x%02X",vX,nn); break;
+        case 0xD000: snprintf(buffer,size,"DRW V%X,V%X,%X",vX,vY,opcode&0x000F); break;
+        case 0xE000: snprintf(buffer,size,"%s V%X",nn == 0x9E ? "SKP" : "SKNP",vX); break;
+        case 0xF000:
+            switch (nn){
+                case 0x07: snprintf(buffer,size,"LD V%X,DT",vX); break;
+                case 0x0A: snprintf(buffer,size,"LD V%X,K",vX); break;
+                case 0x15: snprintf(buffer,size,"LD DT,V%X",vX); break;
+                case 0x18: snprintf(buffer,size,"LD ST,V%X",vX); break;
+                case 0x1E: snprintf(buffer,size,"ADD I,V%X",vX); break;
+                case 0x29: snprintf(buffer,size,"LD F,V%X",vX); break;
+                case 0x33: snprintf(buffer,size,"LD B,V%X",vX); break;
+                case 0x55: snprintf(buffer,size,"LD [I],V%X",vX); break;
+                default:   snprintf(buffer,size,"LD V%X,[I]",vX); break;
+            }
+            break;
+    }
+}
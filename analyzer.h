@@ -0,0 +1,97 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_ANALYZER_H
+#define CHIP_8_ANALYZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A basic block is a run of instructions which is only entered at the first and only left at the last instruction
+struct basic_block {
+    unsigned short start {0};
+    // address of the last instruction of the block
+    unsigned short end {0};
+    // addresses where execution can continue after the block. Empty for 00EE and computed jumps
+    std::vector<unsigned short> successors;
+    // the block ends with BNNN, the target is only known at runtime
+    bool computed_jump {false};
+    // the block ends with 00EE
+    bool returns {false};
+};
+
+struct rom_analysis {
+    // classification of each byte of the address space
+    enum region : unsigned char {
+        unknown = 0, // outside of the ROM
+        code = 1,    // reachable instruction
+        data = 2     // inside the ROM, but never reached by the control flow
+    };
+
+    // FNV-1a hash of the ROM bytes. Used as cache key
+    uint64_t hash {0};
+
+    // the ROM occupies [begin, end)
+    unsigned short begin {0x200};
+    unsigned short end {0x200};
+
+    // all basic blocks, sorted by their start address
+    std::vector<basic_block> blocks;
+
+    // entry addresses of subroutines (2NNN targets)
+    std::vector<unsigned short> subroutines;
+
+    // addresses of BNNN instructions
+    std::vector<unsigned short> computed_jumps;
+
+    // addresses loaded into I by ANNN. Usually sprites or lookup tables
+    std::vector<unsigned short> data_references;
+
+    unsigned char map[0x1000] {0};
+
+    // returns the block which contains the instruction at addr or nullptr
+    const basic_block *block_at(unsigned short addr) const;
+
+    bool is_code(unsigned short addr) const {
+        return addr < 0x1000 && map[addr] == code;
+    }
+};
+
+// walks the ROM which is loaded at [begin, end) of memory from begin. 1NNN, 2NNN and the skip instructions are
+// followed, BNNN is flagged as computed jump and ends the walk on this path
+rom_analysis analyze(const unsigned char *memory, unsigned short begin, unsigned short end);
+
+// analyzes a ROM which is loaded to 0x200. The results of the last analysis_cache_size ROMs are cached by the hash
+// of the ROM, a hit is only served if the ROM bytes match as well. The result stays valid while it is referenced,
+// also after it was evicted from the cache. Thread safe.
+std::shared_ptr<const rom_analysis> analyze_rom(const unsigned char *rom, size_t size);
+
+const size_t analysis_cache_size = 256;
+
+// writes a short mnemonic of the opcode to buffer, e.g "JP 0x200". Unknown opcodes are written as "DW 0xXXXX"
+void disassemble(unsigned short opcode, char *buffer, size_t size);
+
+#endif //CHIP_8_ANALYZER_H
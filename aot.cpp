@@ -0,0 +1,55 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "aot.h"
+
+aot_runtime::aot_runtime(const aot_program &program) : program(program) {
+    for(size_t i = 0; i < program.block_count; ++i)
+        table[program.blocks[i].start] = &program.blocks[i];
+}
+
+bool aot_runtime::intact(const chip8 &ch8, const aot_block &block) const {
+    return aot_intact(ch8,program.rom,block.start,block.end+2);
+}
+
+unsigned long long aot_runtime::run(chip8 &ch8, unsigned long long cycles) {
+    unsigned long long executed = 0;
+    unsigned long long interpreted = 0;
+    const aot_block *block = table[ch8.PC&0x0FFF];
+    while(executed < cycles){
+        // a block is only entered if it can run to its end without exceeding the budget, so the translated code
+        // stops at exactly the same instruction as the interpreter would
+        if(block != nullptr && block->length <= cycles-executed && intact(ch8,*block)){
+            block = block->run(ch8,executed);
+            if(block == nullptr)
+                block = table[ch8.PC&0x0FFF];
+        } else {
+            ch8.cycle();
+            ++executed;
+            ++interpreted;
+            block = table[ch8.PC&0x0FFF];
+        }
+    }
+    return interpreted;
+}
@@ -0,0 +1,85 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_AOT_H
+#define CHIP_8_AOT_H
+
+#include "chip8.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Runtime support for ROMs which were translated to C++ by the recompiler (see recompiler.h). The generated code
+// contains one function per basic block. A block function executes the whole block, adds the number of executed
+// instructions to executed and returns the block which follows, if it is known at compile time. Otherwise it returns
+// nullptr and the successor is looked up by the PC.
+struct aot_block;
+typedef const aot_block *(*aot_block_function)(chip8 &ch8, unsigned long long &executed);
+
+struct aot_block {
+    unsigned short start;
+    // address of the last instruction
+    unsigned short end;
+    // number of instructions in the block
+    unsigned short length;
+    aot_block_function run;
+};
+
+// true if memory from begin up to end still contains the ROM. Translated code checks the rest of its block with it
+// after instructions which may write memory, the block must not run code which it overwrote itself
+inline bool aot_intact(const chip8 &ch8, const unsigned char *rom, unsigned short begin, unsigned short end){
+    return std::memcmp(ch8.memory+begin,rom+(begin-0x200),end-begin) == 0;
+}
+
+// everything the recompiler emits for one ROM
+struct aot_program {
+    // the original ROM. Blocks are only executed as long as memory still contains these bytes
+    const unsigned char *rom;
+    size_t rom_size;
+    uint64_t hash;
+    // sorted by start address
+    const aot_block *blocks;
+    size_t block_count;
+};
+
+class aot_runtime {
+public:
+    explicit aot_runtime(const aot_program &program);
+
+    // executes exactly cycles instructions. Translated blocks are used where possible, computed jumps, code outside
+    // the ROM and self-modified code fall back to chip8::cycle(). Returns the number of instructions which were
+    // executed by the interpreter
+    unsigned long long run(chip8 &ch8, unsigned long long cycles);
+
+private:
+    const aot_program &program;
+
+    // block which starts at an address or nullptr
+    const aot_block *table[0x1000] {nullptr};
+
+    // true if the code of the block in memory is still the code which was translated
+    bool intact(const chip8 &ch8, const aot_block &block) const;
+};
+
+#endif //CHIP_8_AOT_H
@@ -0,0 +1,57 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "chip8.h"
+#include "recompiler.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// chip8_aot <rom> <output.cpp> [symbol]
+// translates a ROM into a C++ translation unit, which can be linked with aot_runner.cpp into a native runner
+int main(int argc, char **argv) {
+    if(argc < 3){
+        std::cerr << "usage: " << argv[0] << " <rom> <output.cpp> [symbol]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1],std::ios::binary);
+    if(!in){
+        std::cerr << "can not open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<unsigned char> rom((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+    if(rom.empty() || rom.size() > chip8::max_program_size){
+        std::cerr << argv[1] << " is empty or larger than " << chip8::max_program_size << " bytes" << std::endl;
+        return 1;
+    }
+
+    std::ofstream out(argv[2]);
+    if(!out){
+        std::cerr << "can not write " << argv[2] << std::endl;
+        return 1;
+    }
+    return recompile(rom.data(),rom.size(),argc > 3 ? argv[3] : "aot_rom",out) ? 0 : 1;
+}
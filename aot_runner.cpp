@@ -0,0 +1,79 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "aot.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// defined by the translation unit which chip8_aot generated
+extern const aot_program aot_rom;
+
+// aot_runner [cycles] [checkpoints]
+// runs the translated ROM and the interpreter side by side and compares their state digests at every checkpoint
+int main(int argc, char **argv) {
+    unsigned long long cycles = argc > 1 ? std::strtoull(argv[1],nullptr,0) : 10000000;
+    unsigned long long checkpoints = argc > 2 ? std::strtoull(argv[2],nullptr,0) : 100;
+    if(checkpoints == 0)
+        checkpoints = 1;
+    unsigned long long step = cycles/checkpoints > 0 ? cycles/checkpoints : 1;
+
+    chip8 interpreter;
+    chip8 native;
+    interpreter.load_program(aot_rom.rom,aot_rom.rom_size);
+    native.load_program(aot_rom.rom,aot_rom.rom_size);
+    interpreter.seed(0);
+    native.seed(0);
+
+    aot_runtime runtime(aot_rom);
+    std::chrono::duration<double> interpreter_time(0), native_time(0);
+    unsigned long long interpreted = 0;
+
+    for(unsigned long long done = 0; done < cycles; done += step){
+        unsigned long long n = std::min(step,cycles-done);
+
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned long long i = 0; i < n; ++i)
+            interpreter.cycle();
+        auto middle = std::chrono::steady_clock::now();
+        interpreted += runtime.run(native,n);
+        auto end = std::chrono::steady_clock::now();
+        interpreter_time += middle-start;
+        native_time += end-middle;
+
+        if(interpreter.digest() != native.digest()){
+            std::printf("MISMATCH after %llu cycles: interpreter 0x%016llx native 0x%016llx (PC 0x%03X / 0x%03X)\n",
+                        done+n,(unsigned long long)interpreter.digest(),(unsigned long long)native.digest(),
+                        interpreter.PC,native.PC);
+            return 1;
+        }
+    }
+
+    std::printf("OK %llu cycles, digest 0x%016llx\n",cycles,(unsigned long long)native.digest());
+    std::printf("interpreter %.3fs (%.1f M instructions/s)\n",interpreter_time.count(),
+                cycles/interpreter_time.count()/1e6);
+    std::printf("native      %.3fs (%.1f M instructions/s), %llu instructions interpreted\n",native_time.count(),
+                cycles/native_time.count()/1e6,interpreted);
+    return 0;
+}
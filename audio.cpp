@@ -0,0 +1,162 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "audio.h"
+#include "byte_order.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    const int16_t amplitude = 8000;
+    const size_t buffer_size = 1 << 16;
+
+    // RIFF header of a 16 bit mono PCM file with data_size bytes of samples
+    void wav_header(unsigned char *header, unsigned int sample_rate, uint32_t data_size){
+        std::memcpy(header,"RIFF",4);
+        put32(header+4,36+data_size);
+        std::memcpy(header+8,"WAVEfmt ",8);
+        put32(header+16,16);
+        put16(header+20,1); // PCM
+        put16(header+22,1); // mono
+        put32(header+24,sample_rate);
+        put32(header+28,sample_rate*2);
+        put16(header+32,2);
+        put16(header+34,16);
+        std::memcpy(header+36,"data",4);
+        put32(header+40,data_size);
+    }
+}
+
+beeper::beeper(unsigned int sample_rate) : rate(sample_rate) {
+    // square wave, 8 bits high and 8 bits low
+    for(int i = 0; i < 16; ++i)
+        pattern[i] = i%2 == 0 ? 0xFF : 0x00;
+    set_pitch(64);
+}
+
+void beeper::set_pattern(const unsigned char p[16]) {
+    std::memcpy(pattern,p,sizeof(pattern));
+}
+
+void beeper::set_pitch(unsigned char pitch) {
+    double bits_per_second = 4000.0*std::pow(2.0,(pitch-64)/48.0);
+    step = (uint64_t)(bits_per_second/rate*4294967296.0);
+}
+
+size_t beeper::render_frame(bool on, int16_t *block) {
+    remainder += rate;
+    size_t count = remainder/60;
+    remainder %= 60;
+
+    if(!on){
+        // every beep starts at the beginning of the pattern
+        phase = 0;
+        std::memset(block,0,count*sizeof(int16_t));
+        return count;
+    }
+
+    for(size_t i = 0; i < count; ++i){
+        unsigned int bit = (phase >> 32) & 127;
+        block[i] = (pattern[bit >> 3] & (0x80 >> (bit & 7))) ? amplitude : -amplitude;
+        phase += step;
+    }
+    return count;
+}
+
+wav_writer::~wav_writer() {
+    close();
+}
+
+bool wav_writer::open(const std::string &path, unsigned int sample_rate) {
+    close();
+    file = std::fopen(path.c_str(),"wb");
+    if(file == nullptr)
+        return false;
+    std::setvbuf(file,nullptr,_IONBF,0);
+    failed = false;
+    written = 0;
+    buffer.clear();
+    buffer.reserve(buffer_size);
+
+    // the sizes are not known yet, they are patched in close()
+    unsigned char header[44];
+    wav_header(header,sample_rate,0);
+    buffer.insert(buffer.end(),header,header+sizeof(header));
+    return true;
+}
+
+void wav_writer::write(const int16_t *samples, size_t count) {
+    if(file == nullptr)
+        return;
+    written += count*2;
+    while(count > 0){
+        if(buffer.size() == buffer_size)
+            flush();
+        size_t n = std::min(count,(buffer_size-buffer.size())/2);
+        size_t offset = buffer.size();
+        buffer.resize(offset+n*2);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // WAV samples are little endian, so they can be copied as they are
+        std::memcpy(&buffer[offset],samples,n*2);
+#else
+        for(size_t i = 0; i < n; ++i)
+            put16(reinterpret_cast<unsigned char *>(&buffer[offset+i*2]),(uint16_t)samples[i]);
+#endif
+        samples += n;
+        count -= n;
+    }
+}
+
+void wav_writer::flush() {
+    if(!buffer.empty() && std::fwrite(buffer.data(),1,buffer.size(),file) != buffer.size())
+        failed = true;
+    buffer.clear();
+}
+
+bool wav_writer::close() {
+    if(file == nullptr)
+        return !failed;
+    flush();
+
+    // patch the sizes of the RIFF and the data chunk
+    unsigned char riff_size[4], data_size[4];
+    put32(riff_size,36+(uint32_t)written);
+    put32(data_size,(uint32_t)written);
+    if(std::fseek(file,4,SEEK_SET) != 0 || std::fwrite(riff_size,1,4,file) != 4 ||
+       std::fseek(file,40,SEEK_SET) != 0 || std::fwrite(data_size,1,4,file) != 4)
+        failed = true;
+    if(std::fclose(file) != 0)
+        failed = true;
+    file = nullptr;
+    return !failed;
+}
+
+void audio_stream::frame(bool on) {
+    size_t count = tone.render_frame(on,block.data());
+    if(wav != nullptr)
+        wav->write(block.data(),count);
+    if(ring != nullptr)
+        ring->push(block.data(),count);
+}
@@ -0,0 +1,124 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_AUDIO_H
+#define CHIP_8_AUDIO_H
+
+#include "spsc_ring.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Generates the sound of the beeper. The chip-8 plays a tone while the sound timer is not 0. The tone is described
+// like XO-CHIP audio: a 128 bit pattern which is played at 4000*2^((pitch-64)/48) bits per second. The default
+// pattern is a square wave, which gives the usual 250Hz beep at the default pitch.
+// Samples are generated for a whole 60Hz frame at once.
+class beeper {
+public:
+    explicit beeper(unsigned int sample_rate = 48000);
+
+    void set_pattern(const unsigned char pattern[16]);
+    void set_pitch(unsigned char pitch);
+
+    unsigned int sample_rate() const {
+        return rate;
+    }
+
+    // number of samples of one frame. Fractions are carried over to the next frame
+    size_t samples_per_frame() const {
+        return (rate+59)/60;
+    }
+
+    // writes the samples of one frame to block, which must hold samples_per_frame() samples. Returns the number of
+    // samples which were written
+    size_t render_frame(bool on, int16_t *block);
+
+private:
+    unsigned int rate;
+    unsigned char pattern[16];
+    // position in the pattern in 1/2^32 bits and increment per sample
+    uint64_t phase {0};
+    uint64_t step {0};
+    // rate/60 samples per frame plus the carried fraction, in 1/60 samples
+    unsigned int remainder {0};
+};
+
+// streams 16 bit mono PCM to a WAV file. The sizes in the header are written when the file is closed
+class wav_writer {
+public:
+    wav_writer() = default;
+    wav_writer(const wav_writer &) = delete;
+    wav_writer &operator=(const wav_writer &) = delete;
+    ~wav_writer();
+
+    bool open(const std::string &path, unsigned int sample_rate);
+    void write(const int16_t *samples, size_t count);
+    bool close();
+
+    uint64_t samples() const {
+        return written/2;
+    }
+
+private:
+    FILE *file {nullptr};
+    std::vector<char> buffer;
+    uint64_t written {0};
+    bool failed {false};
+
+    void flush();
+};
+
+// lock free ring which a local consumer, e.g. a sound card thread, drains
+typedef spsc_ring<int16_t,1 << 15> audio_ring;
+
+// renders the beeper once per frame and hands the block to a WAV file and/or a ring buffer. Without an audio_stream
+// no sound is produced at all, which costs nothing
+class audio_stream {
+public:
+    explicit audio_stream(unsigned int sample_rate = 48000) : tone(sample_rate), block(tone.samples_per_frame()) {}
+
+    beeper &generator(){
+        return tone;
+    }
+
+    // both sinks are optional. Samples which do not fit into the ring are dropped
+    void set_wav(wav_writer *writer){
+        wav = writer;
+    }
+    void set_ring(audio_ring *output){
+        ring = output;
+    }
+
+    // called once per emulated frame with the state of the sound timer
+    void frame(bool on);
+
+private:
+    beeper tone;
+    std::vector<int16_t> block;
+    wav_writer *wav {nullptr};
+    audio_ring *ring {nullptr};
+};
+
+#endif //CHIP_8_AUDIO_H
@@ -0,0 +1,75 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_BYTE_ORDER_H
+#define CHIP_8_BYTE_ORDER_H
+
+#include <cstdint>
+#include <vector>
+
+// The file formats (WAV, savestates, ROM packs, golden stores) and the control protocol store integers little endian,
+// whatever the byte order of the host is. put and get work on a buffer which is large enough, append grows a vector.
+inline void put16(unsigned char *p, uint16_t value){
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+inline void put32(unsigned char *p, uint32_t value){
+    put16(p,value & 0xFFFF);
+    put16(p+2,value >> 16);
+}
+
+inline void put64(unsigned char *p, uint64_t value){
+    put32(p,value & 0xFFFFFFFF);
+    put32(p+4,value >> 32);
+}
+
+inline uint16_t get16(const unsigned char *p){
+    return p[0] | p[1] << 8;
+}
+
+inline uint32_t get32(const unsigned char *p){
+    return get16(p) | (uint32_t)get16(p+2) << 16;
+}
+
+inline uint64_t get64(const unsigned char *p){
+    return get32(p) | (uint64_t)get32(p+4) << 32;
+}
+
+inline void append16(std::vector<unsigned char> &out, uint16_t value){
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+inline void append32(std::vector<unsigned char> &out, uint32_t value){
+    append16(out,value & 0xFFFF);
+    append16(out,value >> 16);
+}
+
+inline void append64(std::vector<unsigned char> &out, uint64_t value){
+    append32(out,value & 0xFFFFFFFF);
+    append32(out,value >> 32);
+}
+
+#endif //CHIP_8_BYTE_ORDER_H
@@ -0,0 +1,142 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "capture.h"
+#include <cstring>
+
+namespace {
+    const size_t buffer_size = 1 << 20;
+}
+
+frame_capture::~frame_capture() {
+    close();
+}
+
+frame_capture::format frame_capture::format_of(const std::string &path) {
+    if(path.size() >= 4 && path.compare(path.size()-4,4,".ppm") == 0)
+        return ppm;
+    return y4m;
+}
+
+bool frame_capture::open(const std::string &path, frame_capture::format t, int w, int h, int s) {
+    close();
+    file = std::fopen(path.c_str(),"wb");
+    if(file == nullptr)
+        return false;
+    // we do our own buffering
+    std::setvbuf(file,nullptr,_IONBF,0);
+
+    type = t;
+    width = w;
+    height = h;
+    scale = s > 0 ? s : 1;
+    failed = false;
+    pending.clear();
+    repeat = 0;
+    buffer.clear();
+    buffer.reserve(buffer_size);
+    frame_count = unique_count = written = 0;
+
+    if(type == y4m){
+        char header[128];
+        int n = snprintf(header,sizeof(header),"YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n",width*scale,height*scale);
+        append(header,n);
+    }
+    return true;
+}
+
+void frame_capture::add_frame(const unsigned char *pixels) {
+    if(file == nullptr)
+        return;
+    ++frame_count;
+    size_t size = width*height;
+    if(!pending.empty() && std::memcmp(pending.data(),pixels,size) == 0){
+        ++repeat;
+        return;
+    }
+    write_pending();
+    pending.assign(pixels,pixels+size);
+    repeat = 1;
+    ++unique_count;
+}
+
+void frame_capture::write_pending() {
+    if(pending.empty())
+        return;
+
+    char header[128];
+    int n;
+    if(type == y4m){
+        if(repeat > 1)
+            n = snprintf(header,sizeof(header),"FRAME Xrepeat=%llu\n",(unsigned long long)repeat);
+        else
+            n = snprintf(header,sizeof(header),"FRAME\n");
+    } else {
+        if(repeat > 1)
+            n = snprintf(header,sizeof(header),"P6\n# repeat %llu\n%d %d\n255\n",(unsigned long long)repeat,
+                         width*scale,height*scale);
+        else
+            n = snprintf(header,sizeof(header),"P6\n%d %d\n255\n",width*scale,height*scale);
+    }
+    append(header,n);
+
+    // one scaled row is built once and appended scale times
+    size_t channels = type == y4m ? 1 : 3;
+    std::vector<char> row(width*scale*channels);
+    for(int y = 0; y < height; ++y){
+        for(int x = 0; x < width; ++x){
+            char value = pending[y*width+x] ? (char)255 : 0;
+            std::memset(&row[x*scale*channels],value,scale*channels);
+        }
+        for(int i = 0; i < scale; ++i)
+            append(row.data(),row.size());
+    }
+}
+
+void frame_capture::append(const char *data, size_t size) {
+    if(buffer.size()+size > buffer_size)
+        flush();
+    buffer.insert(buffer.end(),data,data+size);
+}
+
+void frame_capture::flush() {
+    if(buffer.empty())
+        return;
+    if(std::fwrite(buffer.data(),1,buffer.size(),file) != buffer.size())
+        failed = true;
+    written += buffer.size();
+    buffer.clear();
+}
+
+bool frame_capture::close() {
+    if(file == nullptr)
+        return !failed;
+    write_pending();
+    pending.clear();
+    flush();
+    if(std::fclose(file) != 0)
+        failed = true;
+    file = nullptr;
+    return !failed;
+}
@@ -0,0 +1,96 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_CAPTURE_H
+#define CHIP_8_CAPTURE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Streams frames into a raw video file. Most CHIP-8 frames are identical to the previous one, such a frame is not
+// written again but counted, and the count is stored in the header of the frame it repeats:
+//   y4m: a 60 fps mono YUV4MPEG2 stream, a repeated frame has the header "FRAME Xrepeat=N"
+//   ppm: concatenated binary PPM (P6) images, a repeated image has the comment "# repeat N"
+// Players which do not know these extensions show every distinct frame once.
+class frame_capture {
+public:
+    enum format {
+        y4m,
+        ppm
+    };
+
+    frame_capture() = default;
+    frame_capture(const frame_capture &) = delete;
+    frame_capture &operator=(const frame_capture &) = delete;
+    ~frame_capture();
+
+    // scale enlarges every pixel to scale*scale pixels. Returns false if the file can not be created
+    bool open(const std::string &path, format type, int width, int height, int scale = 1);
+
+    // format by file extension, .ppm or anything else for y4m
+    static format format_of(const std::string &path);
+
+    // pixels is one byte per pixel which is either 0 or 1
+    void add_frame(const unsigned char *pixels);
+
+    // writes the pending frame and closes the file. Returns false if a write failed
+    bool close();
+
+    uint64_t frames() const {
+        return frame_count;
+    }
+    uint64_t unique_frames() const {
+        return unique_count;
+    }
+    uint64_t bytes_written() const {
+        return written;
+    }
+
+private:
+    FILE *file {nullptr};
+    format type {y4m};
+    int width {0};
+    int height {0};
+    int scale {1};
+    bool failed {false};
+
+    // the last distinct frame, written once the next distinct frame arrives or the capture is closed
+    std::vector<unsigned char> pending;
+    uint64_t repeat {0};
+
+    // writes are collected and handed to the file in large blocks
+    std::vector<char> buffer;
+
+    uint64_t frame_count {0};
+    uint64_t unique_count {0};
+    uint64_t written {0};
+
+    void write_pending();
+    void append(const char *data, size_t size);
+    void flush();
+};
+
+#endif //CHIP_8_CAPTURE_H
@@ -24,15 +24,153 @@ SOFTWARE.
 
 #include <iostream>
 #include "chip8.h"
+#include "debugger.h"
+#include "hash.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iterator>
+#include <new>
+#include <random>
+
+// the static constants are bound to references, e.g. by std::min, and need a definition
+const int chip8::width;
+const int chip8::height;
+const size_t chip8::max_program_size;
+const int chip8::stack_size;
+const long chip8::vip_cycles_per_frame;
+const unsigned int chip8::vip_skip_cycles;
 
 void chip8::cycle() {
     fetch();
+    // the debugger stops before the instruction is executed
+    if(armed_debugger != nullptr && armed_debugger->check(*this))
+        return;
+    if(profiler != nullptr)
+        profiler->count(timing == cosmac_vip ? vip_cycles(opcode) : 1);
     decode();
 }
 
+bool chip8::run_frame() {
+    // the timing model is chosen once per frame, so the default loop stays as it is
+    if(timing == cosmac_vip)
+        return run_frame_vip();
+    for(unsigned int i = 0; i < instructions_per_frame; ++i){
+        cycle();
+        // the instruction the debugger stopped at has not been executed
+        if(armed_debugger != nullptr && armed_debugger->reason() != debugger::none){
+            instructions_executed += i;
+            return false;
+        }
+    }
+    instructions_executed += instructions_per_frame;
+    return end_frame();
+}
+
+bool chip8::run_frame_vip() {
+    long budget = vip_cycles_per_frame-vip_overrun;
+    vip_overrun = 0;
+    bool first = true;
+    while(budget > 0){
+        unsigned short next = (memory[PC & 0x0FFF] << 8) | memory[(PC+1) & 0x0FFF];
+        // DXYN waits for the vertical blank interrupt, it only draws as the first instruction of a frame
+        if((next & 0xF000) == 0xD000 && !first)
+            break;
+        unsigned int cost = vip_cycles(next);
+        unsigned short pc = PC;
+        cycle();
+        if(armed_debugger != nullptr && armed_debugger->reason() != debugger::none)
+            return false;
+        ++instructions_executed;
+        unsigned short group = next & 0xF000;
+        bool skip = group == 0x3000 || group == 0x4000 || group == 0x5000 || group == 0x9000 || group == 0xE000;
+        if(skip && PC == pc+4)
+            cost += vip_skip_cycles;
+        budget -= cost;
+        machine_cycles += cost;
+        first = false;
+    }
+    // an instruction which does not fit into the frame delays the next one
+    if(budget < 0)
+        vip_overrun = -budget;
+    return end_frame();
+}
+
+bool chip8::end_frame() {
+    // both timers count down at 60Hz
+    beep = sound_timer > 0;
+    if(delay_timer > 0)
+        --delay_timer;
+    if(sound_timer > 0)
+        --sound_timer;
+    return true;
+}
+
+unsigned int chip8::vip_cycles(unsigned short op) const {
+    // every instruction is fetched and dispatched by the interpreter loop first
+    const unsigned int fetch_cycles = 40;
+    unsigned char vX = (op & 0x0F00) >> 8;
+
+    switch (op&0xF000){
+        case 0x0000:
+            if(op == 0x00E0)
+                return fetch_cycles+3038; // clears the 256 bytes of display memory one by one
+            if(op == 0x00EE)
+                return fetch_cycles+10;
+            return fetch_cycles; // machine language routine, its run time is unknown
+        case 0x1000:
+            return fetch_cycles+12;
+        case 0x2000:
+            return fetch_cycles+26;
+        case 0x3000:
+        case 0x4000:
+            return fetch_cycles+10;
+        case 0x5000:
+        case 0x9000:
+            return fetch_cycles+14;
+        case 0x6000:
+            return fetch_cycles+6;
+        case 0x7000:
+            return fetch_cycles+10;
+        case 0x8000:
+            return fetch_cycles+((op & 0x000F) == 0 ? 12 : 44);
+        case 0xA000:
+            return fetch_cycles+12;
+        case 0xB000:
+            return fetch_cycles+22;
+        case 0xC000:
+            return fetch_cycles+36;
+        case 0xD000:{
+            // a sprite row which is not aligned to a byte of display memory is shifted and touches two bytes
+            unsigned int rows = op & 0x000F;
+            bool aligned = VF[vX]%8 == 0;
+            return fetch_cycles+26+rows*(aligned ? 22 : 34);
+        }
+        case 0xE000:
+            return fetch_cycles+14;
+        default:
+            switch (op&0x00FF){
+                case 0x1E:
+                case 0x29:
+                    return fetch_cycles+16;
+                case 0x33:{
+                    // the digits are found by repeated subtraction
+                    unsigned char value = VF[vX];
+                    return fetch_cycles+80+16*(value/100+value/10%10+value%10);
+                }
+                case 0x55:
+                case 0x65:
+                    return fetch_cycles+14+14*(vX+1);
+                default:
+                    return fetch_cycles+10;
+            }
+    }
+}
+
 void chip8::fetch(){
-    chip8::opcode = (memory[PC] << 8) | memory[PC+1];
+    chip8::opcode = (memory[PC & 0x0FFF] << 8) | memory[(PC+1) & 0x0FFF];
 }
 
 void chip8::decode() {
@@ -44,22 +182,28 @@ void chip8::decode() {
     // bits of the opcode
     switch (opcode&0xF000){
         case 0x0000:{
-            // opcodes in the form of 0x00CD There are only two, 00EE and 00E0
-            switch (opcode&0x00FF){
+            // opcodes in the form of 0x00CD There are only two, 00EE and 00E0. 0NNN calls a machine language routine
+            // of the COSMAC VIP, which can not be emulated
+            switch (opcode){
                 case 0x00E0:
-                    sprintf(info_string,"opcode 0x%04x not implemented",opcode);
+                    // 00E0 clears the display
+                    std::memset(display,0,sizeof(display));
                     PC+=2;
-                    //std::cout << opcode << " not implemented" << std::endl;
                     break;
 
                 case 0x00EE:
-                    sprintf(info_string,"opcode 0x%04x not implemented",opcode);
-                    //std::cout << opcode << " not implemented" << std::endl;
+                    // 00EE returns from a subroutine
+                    if(SP == 0){
+                        sprintf(info_string,"stack underflow at 0x%03x",PC);
+                        break;
+                    }
+                    PC = stack[--SP];
+                    if(profiler != nullptr)
+                        profiler->ret();
                     break;
 
                 default:
-                    sprintf(info_string,"Unknown opcode 0x%04x",opcode);
-                    //std::cout << "Unknown opcode: " << opcode << std::endl;
+                    unknown_opcode();
                     break;
             }
             break;
@@ -72,8 +216,15 @@ void chip8::decode() {
         }
 
         case 0x2000:{
-            sprintf(info_string,"opcode 0x%04x not implemented",opcode);
-            //std::cout << opcode << " not implemented" << std::endl;
+            // 2NNN calls the subroutine at NNN. The return address is pushed on the stack
+            if(SP == stack_size){
+                sprintf(info_string,"stack overflow at 0x%03x",PC);
+                break;
+            }
+            stack[SP++] = PC+2;
+            PC = opcode&0x0FFF;
+            if(profiler != nullptr)
+                profiler->call(PC);
             break;
         }
 
@@ -97,6 +248,10 @@ void chip8::decode() {
 
         case 0x5000:{
             // 5XY0 skips the next instruction if VX equals VY
+            if((opcode&0x000F) != 0){
+                unknown_opcode();
+                break;
+            }
             if(VF[vX] == VF[vY])
                 PC += 4;
             else
@@ -147,57 +302,61 @@ void chip8::decode() {
                     PC+= 2;
                     break;
                 }
+                // the flag is written after the result, so it wins if X is F
                 case 4:{
                     // 8XY4 adds VY to VX. Set VF to 1 if there's a carry, and to 0 otherwise
                     // registers are 8 bit. We sum them up in a 16bit variable and check if there was an overflow.
                     // 0x100 gives us b1 0000 0000 and only works because the chip-8 is a big-endian machine
                     unsigned short sum = VF[vX] + VF[vY];
-                    VF[0xF] = (sum & 0x100)>>8;
                     VF[vX] = sum;
+                    VF[0xF] = (sum & 0x100)>>8;
                     PC += 2;
                     break;
                 }
                 case 5:{
                     // 8XY5 subtracts VY from VX. Set VF to 0 if there's a borrow, and to 1 otherwise
-                    unsigned short difference = VF[vX] - VF[vY];
-                    if(VF[vY] > VF[vX])
-                        VF[0xF] = 0;
-                    else
-                        VF[0xF] = 1;
-                    VF[vX] = difference;
+                    unsigned char flag = VF[vY] > VF[vX] ? 0 : 1;
+                    VF[vX] -= VF[vY];
+                    VF[0xF] = flag;
                     PC += 2;
                     break;
                 }
                 case 6:{
                     // 8XY6 stores the least significant bit of VX in VF, then shifts VX to the right by 1
-                    VF[0xF] = VF[vX] & 0x1;
+                    unsigned char flag = VF[vX] & 0x1;
                     VF[vX] >>= 1;
+                    VF[0xF] = flag;
                     PC += 2;
                     break;
                 }
                 case 7:{
                     // 8XY7 sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 otherwise
-                    unsigned short difference = VF[vY] - VF[vX];
-                    if(VF[vX] > VF[vY])
-                        VF[0xF] = 0;
-                    else
-                        VF[0xF] = 1;
-                    VF[vX] = difference;
+                    unsigned char flag = VF[vX] > VF[vY] ? 0 : 1;
+                    VF[vX] = VF[vY] - VF[vX];
+                    VF[0xF] = flag;
                     PC += 2;
                     break;
                 }
                 case 0xE:{
                     // 8XYE stores the most significant bit of VX in VF, then shifts VX to the left by 1
-                    VF[0xF] = (VF[vX] &0x80) >> 7; // 0x80 = b 1000 000
+                    unsigned char flag = (VF[vX] &0x80) >> 7; // 0x80 = b 1000 000
                     VF[vX] <<= 1;
+                    VF[0xF] = flag;
                     PC += 2;
                     break;
                 }
+                default:
+                    unknown_opcode();
+                    break;
             }
             break;
         }
         case 0x9000: {
             // 9XY0 skips the next instruction if VX != VY
+            if((opcode&0x000F) != 0){
+                unknown_opcode();
+                break;
+            }
             if (VF[vX] == VF[vY])
                 PC += 2;
             else
@@ -214,7 +373,7 @@ void chip8::decode() {
 
         case 0xB000:{
             // BNNN jumps to the address NNN + V0
-            PC = VF[0] + opcode&0x0FFF;
+            PC = (VF[0] + (opcode&0x0FFF)) & 0x0FFF;
             break;
         }
         case 0xC000:{
@@ -225,29 +384,48 @@ void chip8::decode() {
         }
 
         case 0xD000:{
-            //std::cout << opcode << " not implemented" << std::endl;
-            sprintf(info_string,"opcode 0x%04x not implemented",opcode);
+            // DXYN draws the N bytes high sprite stored at I to (VX, VY). Every set bit of the sprite flips a pixel.
+            // VF is set to 1 if a pixel is turned off, and to 0 otherwise. The start position wraps around the
+            // display, the sprite itself is clipped at the edges
+            unsigned int x = VF[vX] % width;
+            unsigned int y = VF[vY] % height;
+            VF[0xF] = 0;
+            for(unsigned int row = 0; row < (opcode&0x000F) && y+row < height; ++row){
+                unsigned char sprite = memory[(I+row)&0x0FFF];
+                for(unsigned int column = 0; column < 8 && x+column < width; ++column){
+                    if(sprite & (0x80 >> column)){
+                        unsigned char &pixel = display[(y+row)*width+x+column];
+                        VF[0xF] |= pixel;
+                        pixel ^= 1;
+                    }
+                }
+            }
+            PC += 2;
             break;
         }
 
         case 0xE000:{
-            switch (opcode&0x000F){
-                case 0xE:{
+            // the keypad has 16 keys, only the low nibble of VX selects one
+            switch (opcode&0x00FF){
+                case 0x9E:{
                     // EX9E skips the next instruction if the key stored in VX is pressed
-                    if(key[VF[vX]])
+                    if(key[VF[vX] & 0xF])
                         PC += 4;
                     else
                         PC += 2;
                     break;
                 }
-                case 0x1:{
+                case 0xA1:{
                     // EXA1 Skips the next instruction if the key stored in VX isn't pressed
-                    if(key[VF[vX]])
+                    if(key[VF[vX] & 0xF])
                         PC += 2;
                     else
                         PC += 4;
                     break;
                 }
+                default:
+                    unknown_opcode();
+                    break;
             }
             break;
         }
@@ -261,8 +439,15 @@ void chip8::decode() {
                     break;
                 }
                 case 0x0A:{
-                    //std::cout << opcode << " not implemented" << std::endl;
-                    sprintf(info_string,"opcode 0x%04x not implemented",opcode);
+                    // FX0A waits for a key press and stores the key in VX. Until a key is pressed, the instruction is
+                    // executed again
+                    for(unsigned char k = 0; k < 16; ++k){
+                        if(key[k]){
+                            VF[vX] = k;
+                            PC += 2;
+                            break;
+                        }
+                    }
                     break;
                 }
                 case 0x15:{
@@ -287,35 +472,39 @@ void chip8::decode() {
                     // Sets I to the location of the sprite for the character in VX
                     // each sprite is represented as 5 bytes in memory. Sprite for the char 0 starts at memory 0x0
                     // sprite for char 1 starts at memory location 0x05 ,...
-                    I = VF[vX]*5;
+                    I = (VF[vX] & 0xF)*5;
                     PC += 2;
                     break;
                 }
                 case 0x33:{
                     // FX33 From the decimal representation of VX, store the hundreds digit in memory location I,
                     // the tens digit ad I+1 and the ones digit at I+2
-                    memory[I] =   (unsigned  char)  VF[vX]/100;
-                    memory[I+1] = (unsigned  char) (VF[vX] % 100)/10;
-                    memory[I+2] = (unsigned  char)  VF[vX] % 10;
+                    // like every access through I, the address wraps around at the end of the memory
+                    memory[I & 0x0FFF] =     (unsigned  char)  VF[vX]/100;
+                    memory[(I+1) & 0x0FFF] = (unsigned  char) (VF[vX] % 100)/10;
+                    memory[(I+2) & 0x0FFF] = (unsigned  char)  VF[vX] % 10;
                     PC += 2;
                     break;
                 }
                 case 0x55:{
-                    // FX55 stores V0 to VX in memory starting at address I
-                    for(int offset = 0; offset < vX; ++offset){
-                        memory[I+offset] = VF[offset];
+                    // FX55 stores V0 to VX in memory starting at address I. I is not changed
+                    for(int offset = 0; offset <= vX; ++offset){
+                        memory[(I+offset) & 0x0FFF] = VF[offset];
                     }
                     PC += 2;
                     break;
                 }
                 case 0x65:{
-                    // FX65 saves V0 to VX to memory starting at address I
-                    for(int offset = 0; offset < vX; ++offset){
-                        VF[offset] = memory[I+offset];
+                    // FX65 loads V0 to VX from memory starting at address I. I is not changed
+                    for(int offset = 0; offset <= vX; ++offset){
+                        VF[offset] = memory[(I+offset) & 0x0FFF];
                     }
                     PC += 2;
                     break;
                 }
+                default:
+                    unknown_opcode();
+                    break;
             }
             break;
         }
@@ -323,11 +512,57 @@ void chip8::decode() {
     }
 }
 
-chip8::chip8( unsigned short pc, unsigned short opcode) : PC(pc), opcode(opcode) {
-    rng = std::mt19937(dev());
+void chip8::unknown_opcode() {
+    ++unknown_opcodes;
+    sprintf(info_string,"Unknown opcode 0x%04x",opcode);
+}
+
+namespace {
+    // a (mostly) true, slow random number to seed the generator of a new instance
+    uint64_t random_seed(){
+        std::random_device dev;
+        return ((uint64_t)dev() << 32) | dev();
+    }
+}
+
+const unsigned char chip8::fonts[0x50] {
+        0xF0, 0x90, 0x90, 0x90, 0xF0, //0
+        0x20, 0x60, 0x20, 0x20, 0x70, //1
+        0xF0, 0x10, 0xF0, 0x80, 0xF0, //2
+        0xF0, 0x10, 0xF0, 0x10, 0xF0, //3
+        0x90, 0x90, 0xF0, 0x10, 0x10, //4
+        0xF0, 0x80, 0xF0, 0x10, 0xF0, //5
+        0xF0, 0x80, 0xF0, 0x90, 0xF0, //6
+        0xF0, 0x10, 0x20, 0x40, 0x40, //7
+        0xF0, 0x90, 0xF0, 0x90, 0xF0, //8
+        0xF0, 0x90, 0xF0, 0x10, 0xF0, //9
+        0xF0, 0x90, 0xF0, 0x90, 0x90, //A
+        0xE0, 0x90, 0xE0, 0x90, 0xE0, //B
+        0xF0, 0x80, 0x80, 0x80, 0xF0, //C
+        0xE0, 0x90, 0x90, 0x90, 0xE0, //D
+        0xF0, 0x80, 0xF0, 0x80, 0xF0, //E
+        0xF0, 0x80, 0xF0, 0x80, 0x80  //F
+};
+
+chip8::chip8() : rng_state(random_seed()) {
     init();
 }
 
+chip8::chip8( unsigned short pc, unsigned short opcode) : PC(pc), opcode(opcode), rng_state(random_seed()) {
+    init();
+}
+
+void *chip8::operator new(size_t size) {
+    void *p = nullptr;
+    if(posix_memalign(&p,alignof(chip8),size) != 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+void chip8::operator delete(void *p) {
+    std::free(p);
+}
+
 void chip8::init() {
     // copy all the fonts into the beginning of the memory
     std::copy(std::begin(fonts),std::end(fonts),std::begin(memory));
@@ -337,6 +572,10 @@ void chip8::load_program(std::vector<uint16_t> data) {
     PC = 0x200;
     opcode = 0;
     I = 0;
+    program_size = data.size()*2;
+    SP = 0;
+    machine_cycles = 0;
+    vip_overrun = 0;
     int k = 0;
     for(int i = 0x200; i < 0x200+data.size()*2; ++i){
         if(i%2 == 0)
@@ -349,3 +588,67 @@ void chip8::load_program(std::vector<uint16_t> data) {
     }
 }
 
+void chip8::load_program(const unsigned char *data, size_t size) {
+    PC = 0x200;
+    opcode = 0;
+    I = 0;
+    size = std::min(size,max_program_size);
+    program_size = size;
+    SP = 0;
+    machine_cycles = 0;
+    vip_overrun = 0;
+    std::copy(data,data+size,std::begin(memory)+0x200);
+}
+
+bool chip8::load_file(const char *path) {
+    std::ifstream in(path,std::ios::binary);
+    if(!in){
+        snprintf(info_string,sizeof(info_string),"can not open %s",path);
+        return false;
+    }
+    std::vector<unsigned char> rom((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+    if(rom.size() > sizeof(memory)-0x200){
+        snprintf(info_string,sizeof(info_string),"%s is larger than 0x%X bytes",path,(unsigned)sizeof(memory)-0x200);
+        return false;
+    }
+    load_program(rom.data(),rom.size());
+    return true;
+}
+
+uint64_t chip8::digest() const {
+    uint64_t hash = fnv1a_64(memory,sizeof(memory));
+    hash = fnv1a_64(VF,sizeof(VF),hash);
+    hash = fnv1a_64(&PC,sizeof(PC),hash);
+    hash = fnv1a_64(&I,sizeof(I),hash);
+    hash = fnv1a_64(&opcode,sizeof(opcode),hash);
+    hash = fnv1a_64(&delay_timer,sizeof(delay_timer),hash);
+    hash = fnv1a_64(&sound_timer,sizeof(sound_timer),hash);
+    hash = fnv1a_64(&SP,sizeof(SP),hash);
+    hash = fnv1a_64(stack,sizeof(stack),hash);
+    return fnv1a_64(display,sizeof(display),hash);
+}
+
+uint64_t chip8::state_hash() const {
+    uint64_t hash = word_hash_64(memory,sizeof(memory));
+    hash = word_hash_64(display,sizeof(display),hash);
+    hash = word_hash_64(stack,sizeof(stack),hash);
+    hash = word_hash_64(VF,sizeof(VF),hash);
+    hash = word_hash_64(key,sizeof(key),hash);
+    unsigned char registers[] = {(unsigned char)PC,(unsigned char)(PC >> 8),(unsigned char)I,(unsigned char)(I >> 8),
+                                 (unsigned char)opcode,(unsigned char)(opcode >> 8),SP,delay_timer,sound_timer,beep,
+                                 timing};
+    hash = fnv1a_64(registers,sizeof(registers),hash);
+    hash = fnv1a_64(&instructions_per_frame,sizeof(instructions_per_frame),hash);
+    hash = fnv1a_64(&vip_overrun,sizeof(vip_overrun),hash);
+    return fnv1a_64(&rng_state,sizeof(rng_state),hash);
+}
+
+bool chip8::same_state(const chip8 &other) const {
+    return PC == other.PC && I == other.I && opcode == other.opcode && SP == other.SP &&
+           delay_timer == other.delay_timer && sound_timer == other.sound_timer && beep == other.beep &&
+           timing == other.timing && instructions_per_frame == other.instructions_per_frame &&
+           vip_overrun == other.vip_overrun && rng_state == other.rng_state &&
+           std::memcmp(VF,other.VF,sizeof(VF)) == 0 && std::memcmp(key,other.key,sizeof(key)) == 0 &&
+           std::memcmp(stack,other.stack,sizeof(stack)) == 0 && std::memcmp(memory,other.memory,sizeof(memory)) == 0 &&
+           std::memcmp(display,other.display,sizeof(display)) == 0;
+}
@@ -25,25 +25,118 @@ SOFTWARE.
 #ifndef CHIP_8_CHIP8_H
 #define CHIP_8_CHIP8_H
 
-#include <random>
-
-class chip8 {
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class call_profiler;
+class debugger;
+
+// The state is ordered by how often it is used. The registers, timers, the settings of run_frame() and the hooks
+// which cycle() tests share the first cache line, the stack and the keypad the second. Memory and display follow,
+// diagnostics and the random number generator are at the end, so a VM which runs a loop touches few cache lines.
+// Many thousand instances fit into memory: the fonts exist once and the generator is 8 bytes.
+class alignas(64) chip8 {
 public:
-    chip8(){
-        rng = std::mt19937(dev());
-        init();
-    };
+    chip8();
 
     chip8(unsigned short pc, unsigned short opcode);
 
+    // instances are allocated aligned to a cache line, which operator new of C++14 does not do on its own
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
+
+    // fixed_rate runs instructions_per_frame instructions per frame. cosmac_vip charges every instruction the
+    // machine cycles it takes the interpreter of the COSMAC VIP and ends the frame once a frame worth of cycles is
+    // used up. Like on the VIP, DXYN waits for the start of the next frame before it draws
+    enum timing_model : unsigned char {
+        fixed_rate,
+        cosmac_vip
+    };
+
+    // ---- hot: the first cache line
+
+    // program counter needs to address 4096 locations
+    unsigned short PC {0};
+
+    // register to store the current opcode. There are 35 opcodes, each is 2 bytes long and is stored big-endian
+    unsigned short opcode {0};
+
+    // address register is 16 bits wide
+    unsigned short I {0};
+
+    // 16 8-bit registers named V0 - VF. The VF register is sometimes a flag.
+    unsigned char VF[16] {0};
+
+    // number of return addresses on the stack
+    unsigned char SP {0};
+
+    // two timers that count down at 60Hz to 0
+    unsigned  char delay_timer {0};
+    unsigned  char sound_timer {0};
+
+    // true if the sound timer was active during the last frame, i.e. the beeper has to sound
+    bool beep {false};
+
+    timing_model timing {fixed_rate};
+
+    // how many instructions are executed per 60Hz frame
+    unsigned int instructions_per_frame {10};
+
+    // set by the debugger while it has breakpoints or watchpoints armed, see debugger.h
+    debugger *armed_debugger {nullptr};
+
+    // set while a call_profiler is attached, see profiler.h
+    call_profiler *profiler {nullptr};
+
+private:
+    // ---- the second cache line
+
+    // the stack is used to store the return address when subroutines are called. 48 bytes for 24 levels of nesting
+    alignas(64) unsigned short stack[24] {0};
+
+public:
+    // Chip-8 has a hexadecimal keyboard. key[X] is true, if the key is currently pressed
+    bool key[16] {false};
+
+    // ---- memory and display
+
     // 4096 (0x1000) kilobytes of memory. Each memory region is 8 bit - one byte.
     // the first 512 bytes (0x200) of the memory are occupied by the interpreter. Therefore, programs usually start
     // at 0x200
     // the upper 256 bytes (0xF00 - 0xFFF) are reserved for display refresh. The 96 bytes below that (0xEA0-0xEFF)
     // are reserved for the call stack, internal use and variables.
     // Addresses 0x000 - 0x50 are reserved for the hexadecimal sprites. 16 sprites ate 5 bytes each.
-    unsigned char memory[0x1000] {0};
+    alignas(64) unsigned char memory[0x1000] {0};
+
+private:
+    // resolution is 64*32 pixels monochrome
+    unsigned char display[64*32] {0};
 
+public:
+    // ---- cold
+
+    // number of bytes loaded to 0x200 by the last call to load_program
+    unsigned short program_size {0};
+
+    // machine cycles used on the VIP since the program was loaded. Only counted with the cosmac_vip timing
+    unsigned long long machine_cycles {0};
+
+    // instructions run_frame() executed and unknown opcodes decode() met over the lifetime of the instance. Unlike
+    // machine_cycles they are not reset by load_program(), see metrics.h
+    unsigned long long instructions_executed {0};
+    unsigned long long unknown_opcodes {0};
+
+    char info_string[100] {0};
+
+private:
+    // cycles which the last instruction of the previous frame took beyond the end of that frame
+    long vip_overrun {0};
+
+    // state of the pseudo random number generator of CXNN, see random_256()
+    uint64_t rng_state {0};
+
+public:
     // Each character of the hexadecimal system is represented with 5 bytes. For example the character 2:
     /*
 
@@ -55,72 +148,103 @@ public:
     ****    11110000    0xF0
 
      */
-    // This representation needs to be copied into memory
-    unsigned char fonts[0x50]{
-            0xF0, 0x90, 0x90, 0x90, 0xF0, //0
-            0x20, 0x60, 0x20, 0x20, 0x70, //1
-            0xF0, 0x10, 0xF0, 0x80, 0xF0, //2
-            0xF0, 0x10, 0xF0, 0x10, 0xF0, //3
-            0x90, 0x90, 0xF0, 0x10, 0x10, //4
-            0xF0, 0x80, 0xF0, 0x10, 0xF0, //5
-            0xF0, 0x80, 0xF0, 0x90, 0xF0, //6
-            0xF0, 0x10, 0x20, 0x40, 0x40, //7
-            0xF0, 0x90, 0xF0, 0x90, 0xF0, //8
-            0xF0, 0x90, 0xF0, 0x10, 0xF0, //9
-            0xF0, 0x90, 0xF0, 0x90, 0x90, //A
-            0xE0, 0x90, 0xE0, 0x90, 0xE0, //B
-            0xF0, 0x80, 0x80, 0x80, 0xF0, //C
-            0xE0, 0x90, 0x90, 0x90, 0xE0, //D
-            0xF0, 0x80, 0xF0, 0x80, 0xF0, //E
-            0xF0, 0x80, 0xF0, 0x80, 0x80  //F
-    };
+    // This representation needs to be copied into memory. All instances share it
+    static const unsigned char fonts[0x50];
 
-    // program counter needs to address 4096 locations
-    unsigned short PC {0};
+    static const int stack_size = 24;
 
-    // register to store the current opcode. There are 35 opcodes, each is 2 bytes long and is stored big-endian
-    unsigned short opcode {0};
+    // resolution of the display
+    static const int width = 64;
+    static const int height = 32;
 
-    // 16 8-bit registers named V0 - VF. The VF register is sometimes a flag.
-    unsigned char VF[16] {0};
+    // programs are loaded to 0x200, so at most 0xE00 bytes fit into memory
+    static const size_t max_program_size = 0x1000-0x200;
 
-    // address register is 16 bits wide
-    unsigned short I {0};
+    // the 1802 runs at 1.76MHz and needs 8 clock cycles per machine cycle, 3668 machine cycles per 60Hz frame
+    static const long vip_cycles_per_frame = 3668;
 
-    // two timers that count down at 60Hz to 0
-    unsigned  char delay_timer {0};
-    unsigned  char sound_timer {0};
+    // machine cycles the next instruction costs on the VIP. The skip of 3XNN, 4XNN, 5XY0, 9XY0, EX9E and EXA1 costs
+    // vip_skip_cycles more
+    unsigned int vip_cycles(unsigned short op) const;
+    static const unsigned int vip_skip_cycles = 4;
+
+    // machine cycles of the slowest instruction, 00E0. vip_overrun stays below it
+    static const long vip_max_cycles = 40+3038;
+
+    // upper bound for instructions_per_frame, 60 million instructions per second
+    static const unsigned int max_instructions_per_frame = 1000000;
+
+    // return address at the given level of nesting, 0 is the outermost call
+    unsigned short stack_entry(int level) const {
+        return stack[level];
+    }
 
     void decode();
 
     void cycle();
 
+    // emulates one 60Hz frame: instructions_per_frame instructions, then the timers count down. Returns false if the
+    // debugger stopped the frame early
+    bool run_frame();
+
     void init();
 
     void load_program(std::vector<uint16_t> data);
 
-    char info_string[100];
-    // Chip-8 has a hexadecimal keyboard. key[X] is true, if the key is currently pressed
-    bool key[16] {false};
+    // loads a ROM image as it is stored in .ch8 files to 0x200. At most 0xE00 bytes fit into memory
+    void load_program(const unsigned char *data, size_t size);
+
+    // loads a .ch8 file. Returns false and sets info_string if the file can not be read or is too large
+    bool load_file(const char *path);
+
+    // hash over the complete machine state: memory, registers, stack, display and timers. Two machines which have
+    // the same digest behave identically, given the same input and random numbers
+    uint64_t digest() const;
 
+    // everything which decides how the machine continues: the state of digest(), the keys, the generator, the
+    // settings of run_frame() and the VIP timing. Two machines with the same state produce the same frames forever,
+    // see halt_detector.h. state_hash() is faster than digest(), but only valid within this process
+    uint64_t state_hash() const;
+    bool same_state(const chip8 &other) const;
+
+    // makes CXNN deterministic
+    void seed(uint64_t value){
+        rng_state = value;
+    }
+
+    // the display, one byte per pixel which is either 0 or 1. Row major, width*height bytes
+    const unsigned char *framebuffer() const {
+        return display;
+    }
+
+    // splitmix64. Every bit of the output is uniform, so the top 8 bits are an unbiased number in [0,255]
     unsigned char random_256(){
-        return rand_256(rng);
+        uint64_t z = (rng_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+        return (z ^ (z >> 31)) >> 56;
     }
 
 private:
-    std::random_device dev; // generate a (mostly) true, slow random number
-    std::mt19937 rng; // seed the mersenne twister with the random number. Pseudo-random number generator
-    std::uniform_int_distribution<std::mt19937::result_type> rand_256; // tweak the random numbers to a range of [0,255] both inclusive. This is guaranteed to be unbiased
+    // loads and saves the complete state to compare decode() with its specification
+    friend class conformance_engine;
 
-    // the stack is used to store the return address when subroutines are called. 48 bytes for 24 levels of nesting
-    unsigned short stack[24] {0};
+    // serialize the private state, see savestate.h
+    friend void encode_savestate(const chip8 &ch8, bool sparse, std::vector<unsigned char> &out);
+    friend bool decode_savestate(const unsigned char *data, size_t size, chip8 &ch8);
 
-    // resolution is 64*32 pixels monochrome
-    unsigned char display[64*32] {0};
+    // records and replays the effect of frames, see frame_cache.h
+    friend class frame_cache;
 
     // function to fetch the opcode from memory
     void fetch();
 
+    bool run_frame_vip();
+    bool end_frame();
+
+    // counts the opcode and reports it in info_string
+    void unknown_opcode();
+
 };
 
 
@@ -0,0 +1,514 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "conformance.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace {
+    // opcodes are handed to the threads in chunks of this size
+    const unsigned int chunk_size = 256;
+
+    // splitmix64, a small generator which is cheap to seed for every case
+    class generator {
+    public:
+        explicit generator(uint64_t seed) : state(seed) {}
+
+        uint64_t next(){
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+        unsigned int below(unsigned int n){
+            return next()%n;
+        }
+        bool one_in(unsigned int n){
+            return below(n) == 0;
+        }
+        // a random byte, every fourth time one which is likely to reveal overflows and sign errors
+        unsigned char byte(){
+            static const unsigned char edges[] = {0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0xFE, 0xFF};
+            uint64_t r = next();
+            if((r & 3) == 0)
+                return edges[(r >> 2) & 7];
+            return r >> 8;
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    void randomize(vm_state &state, generator &random){
+        for(unsigned char &byte : state.memory)
+            byte = random.next();
+        for(unsigned char &pixel : state.display)
+            pixel = random.next() & 1;
+    }
+
+    // changes state into a new case for opcode. Memory and display are only changed where opcode looks at them
+    void generate(vm_state &state, unsigned short opcode, generator &random){
+        unsigned x = (opcode & 0x0F00) >> 8;
+        unsigned y = (opcode & 0x00F0) >> 4;
+
+        for(unsigned char &v : state.V)
+            v = random.byte();
+        // make comparisons true often enough
+        switch (random.below(4)){
+            case 0: state.V[y] = state.V[x]; break;
+            case 1: state.V[x] = opcode & 0x00FF; break;
+            default: break;
+        }
+
+        switch (random.below(16)){
+            case 0: state.I = random.next(); break;                    // beyond the memory
+            case 1: case 2: state.I = 0xFF0+random.below(16); break;   // accesses wrap around
+            default: state.I = random.below(0x1000); break;
+        }
+        state.PC = random.one_in(16) ? 0xFFE : 0x200+2*random.below(0x700);
+
+        switch (random.below(4)){
+            case 0: state.SP = 0; break;
+            case 1: state.SP = chip8::stack_size; break;
+            default: state.SP = random.below(chip8::stack_size+1); break;
+        }
+        for(uint16_t &entry : state.stack)
+            entry = random.below(0x1000);
+
+        state.delay_timer = random.byte();
+        state.sound_timer = random.byte();
+
+        uint64_t keys = random.next();
+        switch (random.below(4)){
+            case 0: keys = 0; break;                           // FX0A has to wait
+            case 1: keys = 1ull << (keys % 16); break;         // exactly one key
+            default: break;
+        }
+        for(int k = 0; k < 16; ++k)
+            state.key[k] = (keys >> k) & 1;
+
+        // the bytes at I are read by FX65 and DXYN
+        for(unsigned offset = 0; offset < 16; ++offset)
+            state.memory[(state.I+offset) & 0x0FFF] = random.byte();
+
+        // sprites are drawn on an empty or a random area
+        if((opcode & 0xF000) == 0xD000){
+            bool empty = random.one_in(4);
+            for(unsigned row = 0; row < 16; ++row){
+                for(unsigned column = 0; column < 8; ++column){
+                    unsigned px = (state.V[x]+column) % chip8::width;
+                    unsigned py = (state.V[y]+row) % chip8::height;
+                    state.display[py*chip8::width+px] = empty ? 0 : random.next() & 1;
+                }
+            }
+        }
+    }
+
+    bool equal(const vm_state &a, const vm_state &b){
+        return a.PC == b.PC && a.I == b.I && a.SP == b.SP && a.delay_timer == b.delay_timer &&
+               a.sound_timer == b.sound_timer && std::memcmp(a.V,b.V,sizeof(a.V)) == 0 &&
+               std::memcmp(a.stack,b.stack,sizeof(a.stack)) == 0 && std::memcmp(a.key,b.key,sizeof(a.key)) == 0 &&
+               std::memcmp(a.memory,b.memory,sizeof(a.memory)) == 0 &&
+               std::memcmp(a.display,b.display,sizeof(a.display)) == 0;
+    }
+
+    void append(std::string &out, const char *format, unsigned a, unsigned b = 0, unsigned c = 0){
+        char line[96];
+        std::snprintf(line,sizeof(line),format,a,b,c);
+        out += line;
+    }
+}
+
+void reference_step(vm_state &s, unsigned short opcode, unsigned char random) {
+    unsigned x = (opcode & 0x0F00) >> 8;
+    unsigned y = (opcode & 0x00F0) >> 4;
+    unsigned n = opcode & 0x000F;
+    unsigned char nn = opcode & 0x00FF;
+    uint16_t nnn = opcode & 0x0FFF;
+    uint16_t next = s.PC+2;
+    uint16_t skip = s.PC+4;
+
+    switch (opcode >> 12){
+        case 0x0:
+            if(opcode == 0x00E0){
+                std::memset(s.display,0,sizeof(s.display));
+                s.PC = next;
+            } else if(opcode == 0x00EE && s.SP > 0){
+                s.PC = s.stack[--s.SP];
+            }
+            return;
+        case 0x1:
+            s.PC = nnn;
+            return;
+        case 0x2:
+            if(s.SP < chip8::stack_size){
+                s.stack[s.SP++] = next;
+                s.PC = nnn;
+            }
+            return;
+        case 0x3:
+            s.PC = s.V[x] == nn ? skip : next;
+            return;
+        case 0x4:
+            s.PC = s.V[x] != nn ? skip : next;
+            return;
+        case 0x5:
+            if(n == 0)
+                s.PC = s.V[x] == s.V[y] ? skip : next;
+            return;
+        case 0x6:
+            s.V[x] = nn;
+            s.PC = next;
+            return;
+        case 0x7:
+            s.V[x] = s.V[x]+nn;
+            s.PC = next;
+            return;
+        case 0x8:{
+            unsigned vx = s.V[x], vy = s.V[y];
+            int flag = -1;
+            switch (n){
+                case 0x0: s.V[x] = vy; break;
+                case 0x1: s.V[x] = vx | vy; break;
+                case 0x2: s.V[x] = vx & vy; break;
+                case 0x3: s.V[x] = vx ^ vy; break;
+                case 0x4: s.V[x] = vx+vy; flag = vx+vy > 0xFF; break;
+                case 0x5: s.V[x] = vx-vy; flag = vx >= vy; break;
+                case 0x6: s.V[x] = vx >> 1; flag = vx & 1; break;
+                case 0x7: s.V[x] = vy-vx; flag = vy >= vx; break;
+                case 0xE: s.V[x] = vx << 1; flag = vx >> 7; break;
+                default: return;
+            }
+            if(flag >= 0)
+                s.V[0xF] = flag;
+            s.PC = next;
+            return;
+        }
+        case 0x9:
+            if(n == 0)
+                s.PC = s.V[x] != s.V[y] ? skip : next;
+            return;
+        case 0xA:
+            s.I = nnn;
+            s.PC = next;
+            return;
+        case 0xB:
+            s.PC = (nnn+s.V[0]) & 0x0FFF;
+            return;
+        case 0xC:
+            s.V[x] = random & nn;
+            s.PC = next;
+            return;
+        case 0xD:{
+            unsigned left = s.V[x] % chip8::width, top = s.V[y] % chip8::height;
+            unsigned char collision = 0;
+            for(unsigned row = 0; row < n; ++row){
+                unsigned char bits = s.memory[(s.I+row) & 0x0FFF];
+                for(unsigned column = 0; column < 8; ++column){
+                    unsigned px = left+column, py = top+row;
+                    if(px >= chip8::width || py >= chip8::height || !(bits & (0x80 >> column)))
+                        continue;
+                    unsigned char &pixel = s.display[py*chip8::width+px];
+                    collision |= pixel;
+                    pixel ^= 1;
+                }
+            }
+            s.V[0xF] = collision;
+            s.PC = next;
+            return;
+        }
+        case 0xE:
+            if(nn == 0x9E)
+                s.PC = s.key[s.V[x] & 0xF] ? skip : next;
+            else if(nn == 0xA1)
+                s.PC = s.key[s.V[x] & 0xF] ? next : skip;
+            return;
+        default:
+            break;
+    }
+
+    switch (nn){
+        case 0x07: s.V[x] = s.delay_timer; break;
+        case 0x0A:{
+            int pressed = -1;
+            for(int k = 15; k >= 0; --k)
+                if(s.key[k])
+                    pressed = k;
+            if(pressed < 0)
+                return;
+            s.V[x] = pressed;
+            break;
+        }
+        case 0x15: s.delay_timer = s.V[x]; break;
+        case 0x18: s.sound_timer = s.V[x]; break;
+        case 0x1E: s.I = s.I+s.V[x]; break;
+        case 0x29: s.I = (s.V[x] & 0xF)*5; break;
+        case 0x33:
+            s.memory[s.I & 0x0FFF] = s.V[x]/100;
+            s.memory[(s.I+1) & 0x0FFF] = s.V[x]/10%10;
+            s.memory[(s.I+2) & 0x0FFF] = s.V[x]%10;
+            break;
+        case 0x55:
+            for(unsigned i = 0; i <= x; ++i)
+                s.memory[(s.I+i) & 0x0FFF] = s.V[i];
+            break;
+        case 0x65:
+            for(unsigned i = 0; i <= x; ++i)
+                s.V[i] = s.memory[(s.I+i) & 0x0FFF];
+            break;
+        default:
+            return;
+    }
+    s.PC = next;
+}
+
+void conformance_engine::load(chip8 &ch8, const vm_state &state) {
+    std::memcpy(ch8.memory,state.memory,sizeof(state.memory));
+    std::memcpy(ch8.VF,state.V,sizeof(state.V));
+    ch8.I = state.I;
+    ch8.PC = state.PC;
+    ch8.SP = state.SP;
+    std::memcpy(ch8.stack,state.stack,sizeof(state.stack));
+    ch8.delay_timer = state.delay_timer;
+    ch8.sound_timer = state.sound_timer;
+    std::memcpy(ch8.key,state.key,sizeof(state.key));
+    std::memcpy(ch8.display,state.display,sizeof(state.display));
+}
+
+void conformance_engine::save(const chip8 &ch8, vm_state &state) {
+    std::memcpy(state.memory,ch8.memory,sizeof(state.memory));
+    std::memcpy(state.V,ch8.VF,sizeof(state.V));
+    state.I = ch8.I;
+    state.PC = ch8.PC;
+    state.SP = ch8.SP;
+    std::memcpy(state.stack,ch8.stack,sizeof(state.stack));
+    state.delay_timer = ch8.delay_timer;
+    state.sound_timer = ch8.sound_timer;
+    std::memcpy(state.key,ch8.key,sizeof(state.key));
+    std::memcpy(state.display,ch8.display,sizeof(state.display));
+}
+
+bool conformance_engine::check(chip8 &ch8, unsigned short opcode, const vm_state &before, vm_state &expected,
+                               vm_state &actual) {
+    load(ch8,before);
+    ch8.opcode = opcode;
+    ch8.decode();
+    save(ch8,actual);
+
+    expected = before;
+    unsigned char random = (opcode & 0xF000) == 0xC000 ? actual.V[(opcode & 0x0F00) >> 8] : 0;
+    reference_step(expected,opcode,random);
+    return equal(expected,actual);
+}
+
+conformance_failure conformance_engine::shrink(chip8 &ch8, unsigned short opcode, const vm_state &before) {
+    conformance_failure failure;
+    failure.opcode = opcode;
+    vm_state current = before;
+    vm_state candidate;
+
+    // keeps the candidate if it still fails
+    auto attempt = [&](){
+        if(equal(candidate,current) || check(ch8,opcode,candidate,failure.expected,failure.actual))
+            return false;
+        current = candidate;
+        return true;
+    };
+    // zeroes ever smaller blocks of an array, as long as the case keeps failing
+    auto clear_blocks = [&](unsigned char *(*field)(vm_state &), size_t size){
+        bool changed = false;
+        for(size_t block = size; block > 0; block /= 16){
+            for(size_t start = 0; start < size; start += block){
+                candidate = current;
+                std::memset(field(candidate)+start,0,std::min(block,size-start));
+                changed |= attempt();
+            }
+        }
+        return changed;
+    };
+
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(int i = 0; i < 16; ++i){
+            candidate = current;
+            candidate.V[i] = 0;
+            changed |= attempt();
+            candidate = current;
+            candidate.key[i] = false;
+            changed |= attempt();
+        }
+        for(int i = 0; i < chip8::stack_size; ++i){
+            candidate = current;
+            candidate.stack[i] = 0;
+            changed |= attempt();
+        }
+        candidate = current;
+        candidate.I = 0;
+        changed |= attempt();
+        candidate = current;
+        candidate.PC = 0x200;
+        changed |= attempt();
+        candidate = current;
+        candidate.SP = 0;
+        changed |= attempt();
+        candidate = current;
+        candidate.delay_timer = candidate.sound_timer = 0;
+        changed |= attempt();
+        changed |= clear_blocks([](vm_state &s){ return s.memory; },sizeof(current.memory));
+        changed |= clear_blocks([](vm_state &s){ return s.display; },sizeof(current.display));
+    }
+
+    failure.before = current;
+    check(ch8,opcode,current,failure.expected,failure.actual);
+    return failure;
+}
+
+std::string conformance_engine::describe(const conformance_failure &f) {
+    std::string out;
+    const vm_state &b = f.before, &e = f.expected, &a = f.actual;
+    append(out,"opcode 0x%04X\n  state    PC=0x%03X",f.opcode,b.PC);
+    for(int i = 0; i < 16; ++i)
+        if(b.V[i] != 0)
+            append(out," V%X=0x%02X",i,b.V[i]);
+    if(b.I != 0)
+        append(out," I=0x%03X",b.I);
+    if(b.SP != 0)
+        append(out," SP=%u",b.SP);
+    for(int i = 0; i < chip8::stack_size; ++i)
+        if(b.stack[i] != 0)
+            append(out," stack[%d]=0x%03X",i,b.stack[i]);
+    if(b.delay_timer != 0 || b.sound_timer != 0)
+        append(out," DT=0x%02X ST=0x%02X",b.delay_timer,b.sound_timer);
+    for(int i = 0; i < 16; ++i)
+        if(b.key[i])
+            append(out," key %X",i);
+    int shown = 0;
+    for(int i = 0; i < 0x1000; ++i)
+        if(b.memory[i] != 0 && shown++ < 16)
+            append(out," [0x%03X]=0x%02X",i,b.memory[i]);
+    unsigned pixels = std::count(std::begin(b.display),std::end(b.display),1);
+    if(pixels > 0)
+        append(out," %u pixels set",pixels);
+
+    out += "\n  expected / actual:";
+    if(e.PC != a.PC)
+        append(out," PC 0x%03X / 0x%03X",e.PC,a.PC);
+    for(int i = 0; i < 16; ++i)
+        if(e.V[i] != a.V[i])
+            append(out," V%X 0x%02X / 0x%02X",i,e.V[i],a.V[i]);
+    if(e.I != a.I)
+        append(out," I 0x%03X / 0x%03X",e.I,a.I);
+    if(e.SP != a.SP)
+        append(out," SP %u / %u",e.SP,a.SP);
+    for(int i = 0; i < chip8::stack_size; ++i)
+        if(e.stack[i] != a.stack[i])
+            append(out," stack[%d] 0x%03X / 0x%03X",i,e.stack[i],a.stack[i]);
+    if(e.delay_timer != a.delay_timer)
+        append(out," DT 0x%02X / 0x%02X",e.delay_timer,a.delay_timer);
+    if(e.sound_timer != a.sound_timer)
+        append(out," ST 0x%02X / 0x%02X",e.sound_timer,a.sound_timer);
+    shown = 0;
+    for(int i = 0; i < 0x1000; ++i)
+        if(e.memory[i] != a.memory[i] && shown++ < 16)
+            append(out," [0x%03X] 0x%02X / 0x%02X",i,e.memory[i],a.memory[i]);
+    shown = 0;
+    for(int i = 0; i < chip8::width*chip8::height; ++i)
+        if(e.display[i] != a.display[i] && shown++ < 16){
+            append(out," pixel (%u,%u) ",i%chip8::width,i/chip8::width);
+            append(out,"%u / %u",e.display[i],a.display[i]);
+        }
+    out += "\n";
+    return out;
+}
+
+conformance_report conformance_engine::run() const {
+    unsigned threads = options.threads;
+    if(threads == 0)
+        threads = std::max(1u,std::thread::hardware_concurrency());
+
+    std::atomic<unsigned> next_chunk {options.first_opcode};
+    std::atomic<uint64_t> cases {0};
+    std::atomic<uint64_t> failed {0};
+    // the first failing state of every opcode, per thread
+    std::vector<std::vector<std::pair<unsigned short,vm_state>>> found(threads);
+
+    auto work = [&](unsigned index){
+        chip8 ch8;
+        std::vector<vm_state> buffers(3);
+        vm_state &before = buffers[0], &expected = buffers[1], &actual = buffers[2];
+        generator setup(options.seed*0x9E3779B97F4A7C15ull+index);
+        randomize(before,setup);
+        uint64_t count = 0, failures = 0;
+
+        unsigned first;
+        while((first = next_chunk.fetch_add(chunk_size)) <= options.last_opcode){
+            unsigned last = std::min(first+chunk_size-1,options.last_opcode);
+            for(unsigned opcode = first; opcode <= last; ++opcode){
+                bool reported = false;
+                for(unsigned i = 0; i < options.states_per_opcode; ++i){
+                    generator random(options.seed ^ ((uint64_t)opcode << 32 | i));
+                    generate(before,opcode,random);
+                    ++count;
+                    if(check(ch8,opcode,before,expected,actual))
+                        continue;
+                    ++failures;
+                    if(!reported && found[index].size() < options.max_reports){
+                        found[index].emplace_back(opcode,before);
+                        reported = true;
+                    }
+                }
+            }
+        }
+        cases += count;
+        failed += failures;
+    };
+
+    std::vector<std::thread> pool;
+    for(unsigned i = 1; i < threads; ++i)
+        pool.emplace_back(work,i);
+    work(0);
+    for(std::thread &t : pool)
+        t.join();
+
+    std::vector<std::pair<unsigned short,vm_state>> all;
+    for(auto &list : found)
+        for(auto &entry : list)
+            all.push_back(std::move(entry));
+    std::sort(all.begin(),all.end(),[](const std::pair<unsigned short,vm_state> &a,
+                                       const std::pair<unsigned short,vm_state> &b){
+        return a.first < b.first;
+    });
+
+    conformance_report report;
+    report.cases = cases;
+    report.failed_cases = failed;
+    chip8 ch8;
+    for(size_t i = 0; i < all.size() && i < options.max_reports; ++i)
+        report.failures.push_back(shrink(ch8,all[i].first,all[i].second));
+    return report;
+}
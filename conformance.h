@@ -0,0 +1,112 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_CONFORMANCE_H
+#define CHIP_8_CONFORMANCE_H
+
+#include "chip8.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Checks chip8::decode() against an independent, executable specification of every instruction. Each of the 65536
+// opcodes is run on many generated machine states. Registers, I, PC, the stack, timers and keys are random, with
+// extra weight on edge values and on the equalities which make skips taken, and memory and display windows which the
+// opcode touches are filled with random bytes. Opcodes are distributed over threads. A failing case is shrunk to a
+// minimal state which still fails, so the report shows only what matters.
+//
+// The specification follows the COSMAC VIP where the interpreter of this project does:
+//   - every memory access through I wraps around at 0xFFF, I itself is a 16 bit register
+//   - the flag of 8XY4 to 8XYE is written after the result, so it wins if X is F
+//   - 8XY6 and 8XYE shift VX, FX55 and FX65 copy V0 to VX inclusive and leave I unchanged
+//   - EX9E, EXA1 and FX29 only use the low nibble of VX. FX0A repeats until a key is pressed
+//   - BNNN jumps to (NNN + V0) & 0xFFF
+//   - unknown opcodes, 0NNN, a call with a full stack and a return with an empty one leave the state unchanged
+// The result of CXNN can not be predicted. The specification takes the random byte from the result, so it only checks
+// that NN masks the random number and nothing else changes.
+struct vm_state {
+    unsigned char memory[0x1000];
+    unsigned char V[16];
+    uint16_t I;
+    uint16_t PC;
+    uint8_t SP;
+    uint16_t stack[chip8::stack_size];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    bool key[16];
+    unsigned char display[chip8::width*chip8::height];
+};
+
+// the specification: executes opcode on state. random is the random byte of CXNN
+void reference_step(vm_state &state, unsigned short opcode, unsigned char random);
+
+struct conformance_options {
+    unsigned int states_per_opcode {32};
+    // 0 uses every core
+    unsigned int threads {0};
+    uint64_t seed {1};
+    unsigned int first_opcode {0};
+    unsigned int last_opcode {0xFFFF};
+    // failures are shrunk and reported up to this number, the rest is only counted
+    size_t max_reports {16};
+};
+
+struct conformance_failure {
+    unsigned short opcode;
+    vm_state before;
+    vm_state expected;
+    vm_state actual;
+};
+
+struct conformance_report {
+    uint64_t cases {0};
+    uint64_t failed_cases {0};
+    // shrunk failures, at most one per opcode, sorted by opcode
+    std::vector<conformance_failure> failures;
+};
+
+class conformance_engine {
+public:
+    explicit conformance_engine(const conformance_options &options = conformance_options()) : options(options) {}
+
+    conformance_report run() const;
+
+    // runs one case. Returns true if decode() produced the state of the specification
+    static bool check(chip8 &ch8, unsigned short opcode, const vm_state &before, vm_state &expected,
+                      vm_state &actual);
+
+    // simplifies before as long as the case keeps failing
+    static conformance_failure shrink(chip8 &ch8, unsigned short opcode, const vm_state &before);
+
+    // the non-zero parts of the shrunk state and every difference between the expected and the actual state
+    static std::string describe(const conformance_failure &failure);
+
+    static void load(chip8 &ch8, const vm_state &state);
+    static void save(const chip8 &ch8, vm_state &state);
+
+private:
+    conformance_options options;
+};
+
+#endif //CHIP_8_CONFORMANCE_H
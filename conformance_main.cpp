@@ -0,0 +1,75 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "conformance.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+
+// chip8_conformance [--states N] [--threads N] [--seed N] [--opcodes FIRST-LAST]
+// runs every opcode against the specification in conformance.h and prints the shrunk failures
+int main(int argc, char **argv) {
+    static const option options[] = {
+            {"states",required_argument,nullptr,'s'},
+            {"threads",required_argument,nullptr,'t'},
+            {"seed",required_argument,nullptr,'r'},
+            {"opcodes",required_argument,nullptr,'o'},
+            {"help",no_argument,nullptr,'h'},
+            {nullptr,0,nullptr,0}
+    };
+    conformance_options config;
+    int opt;
+    while((opt = getopt_long(argc,argv,"h",options,nullptr)) != -1){
+        switch (opt){
+            case 's': config.states_per_opcode = std::strtoul(optarg,nullptr,0); break;
+            case 't': config.threads = std::strtoul(optarg,nullptr,0); break;
+            case 'r': config.seed = std::strtoull(optarg,nullptr,0); break;
+            case 'o':{
+                char *end;
+                config.first_opcode = std::strtoul(optarg,&end,16);
+                config.last_opcode = *end == '-' ? std::strtoul(end+1,nullptr,16) : config.first_opcode;
+                break;
+            }
+            default:
+                std::fprintf(stderr,"usage: %s [--states N] [--threads N] [--seed N] [--opcodes FIRST-LAST]\n",
+                             argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(config.last_opcode > 0xFFFF || config.first_opcode > config.last_opcode){
+        std::fprintf(stderr,"opcodes are 0000-FFFF\n");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    conformance_report report = conformance_engine(config).run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+
+    for(const conformance_failure &failure : report.failures)
+        std::fputs(conformance_engine::describe(failure).c_str(),stdout);
+    std::printf("%llu cases, %llu failed, %.2fs (%.1f M cases/s)\n",(unsigned long long)report.cases,
+                (unsigned long long)report.failed_cases,elapsed.count(),report.cases/elapsed.count()/1e6);
+    return report.failed_cases == 0 ? 0 : 1;
+}
@@ -0,0 +1,561 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "control.h"
+#include "byte_order.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    // bounds checked reads from a payload
+    class reader {
+    public:
+        reader(const unsigned char *data, size_t size) : data(data), size(size) {}
+
+        bool has(size_t count) const {
+            return size-position >= count;
+        }
+        uint8_t u8(){
+            return data[position++];
+        }
+        uint16_t u16(){
+            uint16_t value = get16(data+position);
+            position += 2;
+            return value;
+        }
+        uint32_t u32(){
+            uint32_t value = get32(data+position);
+            position += 4;
+            return value;
+        }
+        uint64_t u64(){
+            uint64_t value = get64(data+position);
+            position += 8;
+            return value;
+        }
+        const unsigned char *bytes(size_t count){
+            const unsigned char *p = data+position;
+            position += count;
+            return p;
+        }
+
+    private:
+        const unsigned char *data;
+        size_t size;
+        size_t position {0};
+    };
+
+    bool set_nonblocking(int fd){
+        int flags = fcntl(fd,F_GETFL,0);
+        return flags >= 0 && fcntl(fd,F_SETFL,flags | O_NONBLOCK) == 0;
+    }
+
+    bool socket_address(const std::string &path, sockaddr_un &address){
+        if(path.size() >= sizeof(address.sun_path))
+            return false;
+        std::memset(&address,0,sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path,path.c_str(),path.size()+1);
+        return true;
+    }
+}
+
+control_request::control_request(uint32_t tag) {
+    clear(tag);
+}
+
+void control_request::clear(uint32_t tag) {
+    bytes.clear();
+    append32(bytes,0);
+    append32(bytes,tag);
+    append16(bytes,0);
+}
+
+bool control_request::command(control_op op, uint32_t vm) {
+    if(commands() >= control_max_commands)
+        return false;
+    put16(&bytes[8],commands()+1);
+    bytes.push_back(op);
+    append32(bytes,vm);
+    return true;
+}
+
+bool control_request::create() {
+    return command(control_create,0);
+}
+
+bool control_request::destroy(uint32_t vm) {
+    return command(control_destroy,vm);
+}
+
+bool control_request::load(uint32_t vm, const unsigned char *rom, uint32_t size) {
+    if(!command(control_load,vm))
+        return false;
+    append32(bytes,size);
+    bytes.insert(bytes.end(),rom,rom+size);
+    return true;
+}
+
+bool control_request::key(uint32_t vm, unsigned char key, bool pressed) {
+    if(!command(control_key,vm))
+        return false;
+    bytes.push_back(key);
+    bytes.push_back(pressed ? 1 : 0);
+    return true;
+}
+
+bool control_request::step(uint32_t vm, uint32_t frames) {
+    if(!command(control_step,vm))
+        return false;
+    append32(bytes,frames);
+    return true;
+}
+
+bool control_request::digest(uint32_t vm) {
+    return command(control_digest,vm);
+}
+
+bool control_request::framebuffer(uint32_t vm) {
+    return command(control_framebuffer,vm);
+}
+
+bool control_request::seed(uint32_t vm, uint32_t value) {
+    if(!command(control_seed,vm))
+        return false;
+    append32(bytes,value);
+    return true;
+}
+
+uint16_t control_request::commands() const {
+    return bytes[8] | (bytes[9] << 8);
+}
+
+const std::vector<unsigned char> &control_request::message() {
+    put32(bytes.data(),bytes.size()-4);
+    return bytes;
+}
+
+bool parse_control_reply(const unsigned char *payload, size_t size, uint32_t &tag,
+                         std::vector<control_result> &results) {
+    reader in(payload,size);
+    if(!in.has(6))
+        return false;
+    tag = in.u32();
+    uint16_t count = in.u16();
+    results.resize(count);
+    for(control_result &result : results){
+        if(!in.has(2))
+            return false;
+        result.op = (control_op)in.u8();
+        result.status = (control_status)in.u8();
+        result.value = 0;
+        if(result.status != control_ok)
+            continue;
+        switch (result.op){
+            case control_create:
+                if(!in.has(4))
+                    return false;
+                result.value = in.u32();
+                break;
+            case control_digest:
+                if(!in.has(8))
+                    return false;
+                result.value = in.u64();
+                break;
+            case control_framebuffer:
+                if(!in.has(sizeof(result.pixels)))
+                    return false;
+                std::memcpy(result.pixels,in.bytes(sizeof(result.pixels)),sizeof(result.pixels));
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+control_server::~control_server() {
+    for(connection &c : connections)
+        ::close(c.fd);
+    if(listener >= 0){
+        ::close(listener);
+        unlink(path.c_str());
+    }
+}
+
+bool control_server::open(const std::string &socket_path) {
+    sockaddr_un address;
+    if(!socket_address(socket_path,address))
+        return false;
+    int fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd < 0)
+        return false;
+    unlink(socket_path.c_str());
+    if(bind(fd,reinterpret_cast<sockaddr *>(&address),sizeof(address)) != 0 || listen(fd,64) != 0 ||
+       !set_nonblocking(fd)){
+        ::close(fd);
+        return false;
+    }
+    listener = fd;
+    path = socket_path;
+    return true;
+}
+
+void control_server::serve() {
+    while(!stopping.load(std::memory_order_relaxed))
+        poll(100);
+}
+
+void control_server::poll(int timeout_ms) {
+    std::vector<pollfd> fds;
+    fds.reserve(connections.size()+1);
+    fds.push_back({listener,POLLIN,0});
+    for(const connection &c : connections)
+        fds.push_back({c.fd,(short)(c.sent < c.output.size() ? POLLIN | POLLOUT : POLLIN),0});
+    if(::poll(fds.data(),fds.size(),timeout_ms) <= 0)
+        return;
+
+    // connections which are accepted now are polled the next time
+    size_t polled = connections.size();
+    if(fds[0].revents & POLLIN)
+        accept_connections();
+
+    size_t kept = 0;
+    for(size_t i = 0; i < polled; ++i){
+        connection &c = connections[i];
+        short events = fds[i+1].revents;
+        bool open = true;
+        if(events & (POLLIN | POLLHUP | POLLERR))
+            open = receive(c);
+        if(open && (events & POLLOUT))
+            open = send_pending(c);
+        if(open){
+            if(kept != i)
+                connections[kept] = std::move(c);
+            ++kept;
+        } else {
+            ::close(c.fd);
+        }
+    }
+    for(size_t i = polled; i < connections.size(); ++i)
+        connections[kept++] = std::move(connections[i]);
+    connections.resize(kept);
+}
+
+void control_server::accept_connections() {
+    while(true){
+        int fd = accept(listener,nullptr,nullptr);
+        if(fd < 0)
+            return;
+        if(!set_nonblocking(fd)){
+            ::close(fd);
+            continue;
+        }
+        connections.push_back({fd,{},{},0});
+    }
+}
+
+bool control_server::receive(connection &c) {
+    unsigned char buffer[1 << 16];
+    bool closed = false;
+    while(true){
+        ssize_t n = recv(c.fd,buffer,sizeof(buffer),0);
+        if(n > 0){
+            c.input.insert(c.input.end(),buffer,buffer+n);
+            continue;
+        }
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            closed = true;
+        break;
+    }
+
+    // answer every complete request, the replies are sent together
+    size_t consumed = 0;
+    while(c.input.size()-consumed >= 4){
+        uint32_t size = get32(&c.input[consumed]);
+        if(size > control_max_message)
+            return false;
+        if(c.input.size()-consumed-4 < size)
+            break;
+        handle(&c.input[consumed+4],size,c.output);
+        consumed += 4+size;
+    }
+    c.input.erase(c.input.begin(),c.input.begin()+consumed);
+
+    if(closed)
+        return false;
+    return send_pending(c);
+}
+
+bool control_server::send_pending(connection &c) {
+    while(c.sent < c.output.size()){
+        ssize_t n = ::send(c.fd,&c.output[c.sent],c.output.size()-c.sent,MSG_NOSIGNAL);
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        c.sent += n;
+    }
+    c.output.clear();
+    c.sent = 0;
+    return true;
+}
+
+chip8 *control_server::find(uint32_t vm) {
+    auto it = vms.find(vm);
+    return it == vms.end() ? nullptr : it->second.get();
+}
+
+void control_server::handle(const unsigned char *payload, size_t size, std::vector<unsigned char> &reply) {
+    size_t start = reply.size();
+    reader in(payload,size);
+    uint32_t tag = 0;
+    uint16_t count = 0;
+    if(in.has(6)){
+        tag = in.u32();
+        count = in.u16();
+    }
+    append32(reply,0);
+    append32(reply,tag);
+    append16(reply,0);
+
+    // the frames of all step commands are recorded in one go, so the metrics cost two clock reads per request
+    std::chrono::steady_clock::time_point started;
+    if(metrics != nullptr)
+        started = std::chrono::steady_clock::now();
+    uint64_t stepped = 0, instructions = 0, unknown = 0;
+
+    uint16_t answered = 0;
+    for(; answered < count; ++answered){
+        if(!in.has(5)){
+            reply.push_back(0);
+            reply.push_back(control_bad_request);
+            ++answered;
+            break;
+        }
+        control_op op = (control_op)in.u8();
+        uint32_t id = in.u32();
+        reply.push_back(op);
+
+        if(op == control_create){
+            std::unique_ptr<chip8> vm(new chip8);
+            // VMs are deterministic unless the client seeds them differently
+            vm->seed(0);
+            uint32_t new_id = next_id++;
+            vms[new_id] = std::move(vm);
+            reply.push_back(control_ok);
+            append32(reply,new_id);
+            continue;
+        }
+
+        // the arguments are read before the VM is looked up, so the next command is found either way
+        uint32_t argument = 0;
+        const unsigned char *rom = nullptr;
+        unsigned char key = 0;
+        bool pressed = false;
+        bool valid = true;
+        switch (op){
+            case control_destroy:
+            case control_digest:
+            case control_framebuffer:
+                break;
+            case control_load:
+                valid = in.has(4);
+                if(valid){
+                    argument = in.u32();
+                    valid = in.has(argument);
+                    if(valid)
+                        rom = in.bytes(argument);
+                }
+                break;
+            case control_key:
+                valid = in.has(2);
+                if(valid){
+                    key = in.u8();
+                    pressed = in.u8() != 0;
+                }
+                break;
+            case control_step:
+            case control_seed:
+                valid = in.has(4);
+                if(valid)
+                    argument = in.u32();
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if(!valid){
+            // the rest of the request can not be parsed
+            reply.push_back(control_bad_request);
+            ++answered;
+            break;
+        }
+
+        chip8 *vm = find(id);
+        if(vm == nullptr){
+            reply.push_back(control_no_such_vm);
+            continue;
+        }
+        switch (op){
+            case control_destroy:
+                vms.erase(id);
+                reply.push_back(control_ok);
+                break;
+            case control_load:
+                // load_program() would cut a larger ROM silently
+                if(argument == 0 || argument > chip8::max_program_size){
+                    reply.push_back(control_bad_request);
+                    break;
+                }
+                vm->load_program(rom,argument);
+                reply.push_back(control_ok);
+                break;
+            case control_key:
+                if(key > 0xF){
+                    reply.push_back(control_bad_request);
+                    break;
+                }
+                vm->key[key] = pressed;
+                reply.push_back(control_ok);
+                break;
+            case control_step:{
+                uint64_t executed = vm->instructions_executed, unknown_before = vm->unknown_opcodes;
+                for(uint32_t i = 0; i < argument; ++i)
+                    vm->run_frame();
+                stepped += argument;
+                instructions += vm->instructions_executed-executed;
+                unknown += vm->unknown_opcodes-unknown_before;
+                reply.push_back(control_ok);
+                break;
+            }
+            case control_digest:
+                reply.push_back(control_ok);
+                append64(reply,vm->digest());
+                break;
+            case control_framebuffer:{
+                reply.push_back(control_ok);
+                const unsigned char *pixels = vm->framebuffer();
+                for(int i = 0; i < chip8::width*chip8::height; i += 8){
+                    unsigned char bits = 0;
+                    for(int b = 0; b < 8; ++b)
+                        bits |= pixels[i+b] << (7-b);
+                    reply.push_back(bits);
+                }
+                break;
+            }
+            case control_seed:
+                vm->seed(argument);
+                reply.push_back(control_ok);
+                break;
+            default:
+                break;
+        }
+    }
+
+    put32(&reply[start],reply.size()-start-4);
+    put16(&reply[start+8],answered);
+
+    if(metrics != nullptr)
+        metrics->record_frames(stepped,instructions,unknown,std::chrono::steady_clock::now()-started);
+}
+
+control_client::~control_client() {
+    close();
+}
+
+bool control_client::connect(const std::string &path) {
+    close();
+    sockaddr_un address;
+    if(!socket_address(path,address))
+        return false;
+    fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd < 0)
+        return false;
+    if(::connect(fd,reinterpret_cast<sockaddr *>(&address),sizeof(address)) != 0){
+        close();
+        return false;
+    }
+    return true;
+}
+
+void control_client::close() {
+    if(fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+bool control_client::send(control_request &request) {
+    const std::vector<unsigned char> &message = request.message();
+    size_t sent = 0;
+    while(sent < message.size()){
+        ssize_t n = ::send(fd,message.data()+sent,message.size()-sent,MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool control_client::receive(uint32_t &tag, std::vector<control_result> &results) {
+    auto read_all = [this](unsigned char *data, size_t size){
+        while(size > 0){
+            ssize_t n = recv(fd,data,size,0);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    };
+
+    unsigned char prefix[4];
+    if(!read_all(prefix,4))
+        return false;
+    uint32_t size = get32(prefix);
+    if(size > control_max_message)
+        return false;
+    payload.resize(size);
+    return read_all(payload.data(),size) && parse_control_reply(payload.data(),size,tag,results);
+}
+
+bool control_client::call(control_request &request, std::vector<control_result> &results) {
+    uint32_t tag;
+    const std::vector<unsigned char> &message = request.message();
+    uint32_t expected = get32(&message[4]);
+    return send(request) && receive(tag,results) && tag == expected;
+}
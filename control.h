@@ -0,0 +1,204 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_CONTROL_H
+#define CHIP_8_CONTROL_H
+
+#include "chip8.h"
+#include "metrics.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Lets other processes drive many chip8 instances through a Unix domain socket. The protocol is binary and length
+// prefixed, all integers are little endian:
+//   message  uint32 payload size, payload
+//   request  uint32 tag, uint16 command count, commands
+//   reply    uint32 tag of the request, uint16 result count, one result per command
+//   command  uint8 op, uint32 vm, arguments of the op
+//   result   uint8 op, uint8 status, data of the op if the status is ok
+// One request can address any number of VMs, e.g. step 1000 VMs by one frame and fetch their digests, so the cost of
+// a round trip is shared by all of them. Requests of a connection are answered in order.
+//
+//   op               arguments                data
+//   create           -                        uint32 id of the new VM
+//   destroy          -                        -
+//   load             uint32 size, ROM bytes   -
+//   key              uint8 key, uint8 pressed -
+//   step             uint32 frames            -
+//   digest           -                        uint64 chip8::digest()
+//   framebuffer      -                        256 bytes, one bit per pixel, row major, MSB first
+//   seed             uint32 seed              -
+enum control_op : uint8_t {
+    control_create = 1,
+    control_destroy,
+    control_load,
+    control_key,
+    control_step,
+    control_digest,
+    control_framebuffer,
+    control_seed
+};
+
+enum control_status : uint8_t {
+    control_ok = 0,
+    control_no_such_vm,
+    // the command is truncated or its arguments are invalid. Commands after a truncated one are not answered
+    control_bad_request
+};
+
+// larger messages close the connection
+const uint32_t control_max_message = 1 << 24;
+
+// the command count of a request is 16 bits wide
+const uint32_t control_max_commands = 0xFFFF;
+
+// builds the payload of a request
+class control_request {
+public:
+    explicit control_request(uint32_t tag = 0);
+
+    void clear(uint32_t tag = 0);
+
+    // each returns false and leaves the request as it is if it already holds control_max_commands commands
+    bool create();
+    bool destroy(uint32_t vm);
+    bool load(uint32_t vm, const unsigned char *rom, uint32_t size);
+    bool key(uint32_t vm, unsigned char key, bool pressed);
+    bool step(uint32_t vm, uint32_t frames);
+    bool digest(uint32_t vm);
+    bool framebuffer(uint32_t vm);
+    bool seed(uint32_t vm, uint32_t value);
+
+    uint16_t commands() const;
+    // the message including its size prefix
+    const std::vector<unsigned char> &message();
+
+private:
+    std::vector<unsigned char> bytes;
+
+    bool command(control_op op, uint32_t vm);
+};
+
+struct control_result {
+    control_op op;
+    control_status status;
+    // id of a created VM or the digest
+    uint64_t value;
+    // only filled for framebuffer
+    unsigned char pixels[chip8::width*chip8::height/8];
+};
+
+// parses the payload of a reply. Returns false if it is malformed
+bool parse_control_reply(const unsigned char *payload, size_t size, uint32_t &tag,
+                         std::vector<control_result> &results);
+
+class control_server {
+public:
+    control_server() = default;
+    control_server(const control_server &) = delete;
+    control_server &operator=(const control_server &) = delete;
+    // closes all connections and removes the socket
+    ~control_server();
+
+    // creates the socket at path. An existing socket file at path is replaced. Returns false on failure
+    bool open(const std::string &path);
+
+    // waits at most timeout_ms for connections and requests and answers every complete request
+    void poll(int timeout_ms);
+
+    // polls until stop() is called
+    void serve();
+
+    // may be called from any thread or a signal handler
+    void stop(){
+        stopping.store(true,std::memory_order_relaxed);
+    }
+
+    bool stopped() const {
+        return stopping.load(std::memory_order_relaxed);
+    }
+
+    // the frames which step commands emulate are recorded in the metrics, one histogram entry per request
+    void set_metrics(thread_metrics *m){
+        metrics = m;
+    }
+
+    // answers one request payload. The reply message, including its size prefix, is appended to reply
+    void handle(const unsigned char *payload, size_t size, std::vector<unsigned char> &reply);
+
+    size_t vm_count() const {
+        return vms.size();
+    }
+
+private:
+    struct connection {
+        int fd;
+        std::vector<unsigned char> input;
+        std::vector<unsigned char> output;
+        // bytes of output which were already sent
+        size_t sent;
+    };
+
+    std::string path;
+    int listener {-1};
+    std::vector<connection> connections;
+    std::unordered_map<uint32_t,std::unique_ptr<chip8>> vms;
+    uint32_t next_id {1};
+    std::atomic<bool> stopping {false};
+    thread_metrics *metrics {nullptr};
+
+    void accept_connections();
+    // false if the connection has to be closed
+    bool receive(connection &c);
+    bool send_pending(connection &c);
+    chip8 *find(uint32_t vm);
+};
+
+class control_client {
+public:
+    control_client() = default;
+    control_client(const control_client &) = delete;
+    control_client &operator=(const control_client &) = delete;
+    ~control_client();
+
+    bool connect(const std::string &path);
+    void close();
+
+    // sends the request and blocks until its reply arrived. Returns false on I/O errors or malformed replies
+    bool call(control_request &request, std::vector<control_result> &results);
+
+    // the two halves of call, to keep several requests in flight
+    bool send(control_request &request);
+    bool receive(uint32_t &tag, std::vector<control_result> &results);
+
+private:
+    int fd {-1};
+    std::vector<unsigned char> payload;
+};
+
+#endif //CHIP_8_CONTROL_H
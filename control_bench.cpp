@@ -0,0 +1,226 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "control.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    void usage(const char *name){
+        std::fprintf(stderr,"usage: %s [options] rom\n"
+                            "  --socket PATH    connect to a running chip8_server instead of starting one\n"
+                            "  --vms N          number of VMs, at most 65535 (default 256)\n"
+                            "  --batch N        VMs stepped per request, at most 65535 (default 64)\n"
+                            "  --frames N       frames per VM and step (default 1)\n"
+                            "  --requests N     number of step requests (default 20000)\n"
+                            "  --depth N        requests in flight (default 1)\n",name);
+    }
+
+    // true if the server answered every command of the request with control_ok
+    bool all_ok(const std::vector<control_result> &results, size_t commands){
+        if(results.size() != commands)
+            return false;
+        for(const control_result &result : results)
+            if(result.status != control_ok)
+                return false;
+        return true;
+    }
+
+    double percentile(std::vector<double> &sorted, double p){
+        size_t index = std::min(sorted.size()-1,(size_t)(p*sorted.size()));
+        return sorted[index];
+    }
+}
+
+// chip8_control_bench [options] rom
+// measures how many step requests per second a control server answers and how long they take
+int main(int argc, char **argv) {
+    static const option options[] = {
+            {"socket",required_argument,nullptr,'s'},
+            {"vms",required_argument,nullptr,'v'},
+            {"batch",required_argument,nullptr,'b'},
+            {"frames",required_argument,nullptr,'f'},
+            {"requests",required_argument,nullptr,'r'},
+            {"depth",required_argument,nullptr,'d'},
+            {"help",no_argument,nullptr,'h'},
+            {nullptr,0,nullptr,0}
+    };
+    std::string socket_path;
+    uint32_t vm_count = 256;
+    uint32_t batch = 64;
+    uint32_t frames = 1;
+    uint32_t request_count = 20000;
+    uint32_t depth = 1;
+    int opt;
+    while((opt = getopt_long(argc,argv,"h",options,nullptr)) != -1){
+        switch (opt){
+            case 's': socket_path = optarg; break;
+            case 'v': vm_count = std::strtoul(optarg,nullptr,0); break;
+            case 'b': batch = std::strtoul(optarg,nullptr,0); break;
+            case 'f': frames = std::strtoul(optarg,nullptr,0); break;
+            case 'r': request_count = std::strtoul(optarg,nullptr,0); break;
+            case 'd': depth = std::strtoul(optarg,nullptr,0); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    // every VM is created by one command of one request
+    if(optind >= argc || vm_count == 0 || vm_count > control_max_commands || batch == 0 ||
+       batch > control_max_commands || depth == 0){
+        usage(argv[0]);
+        return 1;
+    }
+    std::ifstream file(argv[optind],std::ios::binary);
+    std::vector<unsigned char> rom((std::istreambuf_iterator<char>(file)),std::istreambuf_iterator<char>());
+    if(!file.is_open() || rom.empty()){
+        std::fprintf(stderr,"can not read %s\n",argv[optind]);
+        return 1;
+    }
+
+    // without a socket the server runs on a thread of this process
+    control_server local;
+    std::thread server_thread;
+    if(socket_path.empty()){
+        socket_path = "/tmp/chip8-bench-" + std::to_string(getpid()) + ".sock";
+        if(!local.open(socket_path)){
+            std::fprintf(stderr,"can not listen on %s\n",socket_path.c_str());
+            return 1;
+        }
+        server_thread = std::thread([&local]{ local.serve(); });
+    }
+
+    int status = 0;
+    {
+        control_client client;
+        if(!client.connect(socket_path)){
+            std::fprintf(stderr,"can not connect to %s\n",socket_path.c_str());
+            status = 1;
+        }
+
+        // create the VMs in one request, then load the ROM into them
+        control_request request;
+        std::vector<control_result> results;
+        std::vector<uint32_t> ids;
+        if(status == 0){
+            for(uint32_t i = 0; i < vm_count; ++i)
+                request.create();
+            if(!client.call(request,results) || !all_ok(results,vm_count)){
+                std::fprintf(stderr,"creating the VMs failed\n");
+                status = 1;
+            }
+            for(const control_result &result : results)
+                if(result.status == control_ok)
+                    ids.push_back(result.value);
+            // the loads are split into requests which stay well below control_max_message
+            size_t loads_per_request = std::max<size_t>(1,control_max_message/2/(rom.size()+9));
+            for(size_t first = 0; status == 0 && first < ids.size(); first += loads_per_request){
+                size_t last = std::min(ids.size(),first+loads_per_request);
+                request.clear();
+                for(size_t i = first; i < last; ++i)
+                    request.load(ids[i],rom.data(),rom.size());
+                if(!client.call(request,results) || !all_ok(results,last-first)){
+                    std::fprintf(stderr,"loading the ROM failed\n");
+                    status = 1;
+                }
+            }
+        }
+
+        if(status == 0){
+            std::vector<double> latency;
+            latency.reserve(request_count);
+            std::vector<std::chrono::steady_clock::time_point> sent(depth);
+            uint32_t next_vm = 0;
+            uint32_t issued = 0;
+            uint32_t done = 0;
+            bool rejected = false;
+            auto start = std::chrono::steady_clock::now();
+            while(done < request_count && status == 0){
+                // keep depth requests in flight, replies arrive in order
+                while(issued < request_count && issued-done < depth){
+                    request.clear(issued);
+                    for(uint32_t i = 0; i < batch; ++i){
+                        request.step(ids[next_vm],frames);
+                        next_vm = (next_vm+1)%ids.size();
+                    }
+                    sent[issued%depth] = std::chrono::steady_clock::now();
+                    if(!client.send(request))
+                        status = 1;
+                    ++issued;
+                }
+                uint32_t tag;
+                if(status != 0 || !client.receive(tag,results) || tag != done){
+                    status = 1;
+                    break;
+                }
+                if(!all_ok(results,batch)){
+                    std::fprintf(stderr,"the server rejected step request %u\n",done);
+                    rejected = true;
+                    status = 1;
+                    break;
+                }
+                std::chrono::duration<double,std::micro> elapsed = std::chrono::steady_clock::now()-sent[done%depth];
+                latency.push_back(elapsed.count());
+                ++done;
+            }
+            std::chrono::duration<double> total = std::chrono::steady_clock::now()-start;
+
+            if(status != 0){
+                if(!rejected)
+                    std::fprintf(stderr,"the connection to the server failed\n");
+            } else {
+                std::sort(latency.begin(),latency.end());
+                std::printf("requests     %u of %u VM steps (%u VMs, %u frames each)\n",request_count,batch,vm_count,
+                            frames);
+                std::printf("time         %.3fs\n",total.count());
+                std::printf("requests/s   %.0f\n",request_count/total.count());
+                std::printf("VM frames/s  %.0f\n",(double)request_count*batch*frames/total.count());
+                std::printf("latency      p50 %.1fus  p99 %.1fus  p99.9 %.1fus  max %.1fus\n",
+                            percentile(latency,0.5),percentile(latency,0.99),percentile(latency,0.999),
+                            latency.back());
+            }
+        }
+
+        request.clear();
+        for(uint32_t id : ids)
+            request.destroy(id);
+        if(!ids.empty())
+            client.call(request,results);
+    }
+
+    if(server_thread.joinable()){
+        local.stop();
+        server_thread.join();
+    }
+    return status;
+}
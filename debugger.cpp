@@ -0,0 +1,191 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "debugger.h"
+#include "chip8.h"
+#include <algorithm>
+
+namespace {
+    // bitmap of the 256 byte pages which overlap [begin, end)
+    uint16_t page_mask(unsigned begin, unsigned end){
+        if(end <= begin)
+            return 0;
+        unsigned first = (begin >> 8) & 0xF;
+        unsigned last = std::min((end-1) >> 8,0xFu);
+        uint16_t mask = 0;
+        for(unsigned page = first; page <= last; ++page)
+            mask |= 1u << page;
+        return mask;
+    }
+
+    // the memory range [begin, end) the instruction accesses besides its fetch. Returns false if it does not
+    // access memory
+    bool memory_access(const chip8 &ch8, unsigned &begin, unsigned &end, bool &writes){
+        unsigned short opcode = ch8.opcode;
+        unsigned vX = (opcode & 0x0F00) >> 8;
+        begin = ch8.I & 0x0FFF;
+        writes = false;
+        switch (opcode&0xF0FF){
+            case 0xF033:
+                end = begin+3;
+                writes = true;
+                return true;
+            case 0xF055:
+                end = begin+vX+1;
+                writes = true;
+                return true;
+            case 0xF065:
+                end = begin+vX+1;
+                return true;
+            default:
+                break;
+        }
+        if((opcode&0xF000) == 0xD000){
+            end = begin+(opcode&0x000F);
+            return true;
+        }
+        return false;
+    }
+
+    bool compare(unsigned char a, debugger::comparison cmp, unsigned char b){
+        switch (cmp){
+            case debugger::equal: return a == b;
+            case debugger::not_equal: return a != b;
+            case debugger::less: return a < b;
+            case debugger::greater: return a > b;
+        }
+        return false;
+    }
+}
+
+debugger::debugger(chip8 &ch8) : ch8(ch8) {}
+
+debugger::~debugger() {
+    if(ch8.armed_debugger == this)
+        ch8.armed_debugger = nullptr;
+}
+
+void debugger::add_breakpoint(unsigned short addr) {
+    breakpoints.set(addr&0x0FFF);
+    update();
+}
+
+void debugger::remove_breakpoint(unsigned short addr) {
+    breakpoints.reset(addr&0x0FFF);
+    update();
+}
+
+bool debugger::has_breakpoint(unsigned short addr) const {
+    return breakpoints.test(addr&0x0FFF);
+}
+
+void debugger::add_condition(unsigned short addr, unsigned char reg, debugger::comparison cmp, unsigned char value) {
+    conditions.push_back({addr == anywhere ? anywhere : (unsigned short)(addr&0x0FFF),(unsigned char)(reg&0xF),cmp,
+                          value});
+    update();
+}
+
+void debugger::add_watchpoint(unsigned short begin, unsigned short end, bool on_read, bool on_write) {
+    watchpoints.push_back({begin,end,on_read,on_write});
+    update();
+}
+
+void debugger::clear() {
+    breakpoints.reset();
+    conditions.clear();
+    watchpoints.clear();
+    update();
+}
+
+void debugger::resume() {
+    stop = none;
+    skip_once = true;
+}
+
+void debugger::update() {
+    exec_pages = 0;
+    for(unsigned page = 0; page < 16; ++page){
+        for(unsigned addr = page << 8; addr < (page+1) << 8; ++addr){
+            if(breakpoints.test(addr)){
+                exec_pages |= 1u << page;
+                break;
+            }
+        }
+    }
+    for(const auto &c : conditions)
+        exec_pages |= c.addr == anywhere ? 0xFFFF : 1u << (c.addr >> 8);
+
+    read_pages = 0;
+    write_pages = 0;
+    for(const auto &w : watchpoints){
+        if(w.on_read)
+            read_pages |= page_mask(w.begin,w.end);
+        if(w.on_write)
+            write_pages |= page_mask(w.begin,w.end);
+    }
+
+    ch8.armed_debugger = (exec_pages|read_pages|write_pages) ? this : nullptr;
+}
+
+bool debugger::stop_at(debugger::stop_reason why, unsigned short pc, unsigned short addr) {
+    stop = why;
+    stopped_pc = pc;
+    stopped_address = addr;
+    return true;
+}
+
+bool debugger::check(const chip8 &ch8) {
+    if(skip_once){
+        skip_once = false;
+        return false;
+    }
+
+    unsigned short pc = ch8.PC&0x0FFF;
+    if(exec_pages & (1u << (pc >> 8))){
+        if(breakpoints.test(pc))
+            return stop_at(breakpoint,pc,pc);
+        for(const auto &c : conditions){
+            if((c.addr == anywhere || c.addr == pc) && compare(ch8.VF[c.reg],c.cmp,c.value))
+                return stop_at(condition,pc,pc);
+        }
+    }
+
+    if((read_pages|write_pages) == 0)
+        return false;
+    unsigned begin, end;
+    bool writes;
+    if(!memory_access(ch8,begin,end,writes))
+        return false;
+    // accesses past 0xFFF wrap around to the start of memory, like in chip8::decode()
+    const unsigned ranges[2][2] = {{begin,std::min(end,0x1000u)},{0,end > 0x1000 ? end-0x1000 : 0}};
+    for(const auto &range : ranges){
+        if((page_mask(range[0],range[1]) & (writes ? write_pages : read_pages)) == 0)
+            continue;
+        for(const auto &w : watchpoints){
+            if((writes ? w.on_write : w.on_read) && range[0] < w.end && w.begin < range[1])
+                return stop_at(writes ? write : read,pc,std::max<unsigned>(range[0],w.begin));
+        }
+    }
+    return false;
+}
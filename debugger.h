@@ -0,0 +1,128 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_DEBUGGER_H
+#define CHIP_8_DEBUGGER_H
+
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+class chip8;
+
+// PC breakpoints, conditional breakpoints on registers and read/write watchpoints on memory ranges.
+// The debugger registers itself at the chip8 only while something is armed. chip8::cycle() then calls check() before
+// every instruction, otherwise the only cost is a single test of a pointer. Every kind of trigger has a bitmap of the
+// 256 byte pages it covers, so most instructions are rejected with one bit test.
+class debugger {
+public:
+    enum stop_reason {
+        none,
+        breakpoint, // PC reached a breakpoint
+        condition,  // a register condition became true
+        read,       // the next instruction reads a watched memory range
+        write       // the next instruction writes a watched memory range
+    };
+
+    enum comparison {
+        equal,
+        not_equal,
+        less,
+        greater
+    };
+
+    // any address, used for conditions which are checked before every instruction
+    static const unsigned short anywhere = 0xFFFF;
+
+    explicit debugger(chip8 &ch8);
+    ~debugger();
+
+    void add_breakpoint(unsigned short addr);
+    void remove_breakpoint(unsigned short addr);
+    bool has_breakpoint(unsigned short addr) const;
+
+    // stops at addr (or before every instruction for anywhere) if V[reg] <cmp> value
+    void add_condition(unsigned short addr, unsigned char reg, comparison cmp, unsigned char value);
+
+    // stops before an instruction which accesses memory in [begin, end)
+    void add_watchpoint(unsigned short begin, unsigned short end, bool on_read, bool on_write);
+
+    void clear();
+
+    // called by chip8::cycle() with the fetched opcode. Returns true if the instruction must not be executed
+    bool check(const chip8 &ch8);
+
+    // continues after a stop. The trigger which stopped the execution is ignored for one instruction
+    void resume();
+
+    stop_reason reason() const {
+        return stop;
+    }
+
+    // PC of the instruction which was stopped and the memory address which triggered a watchpoint
+    unsigned short stop_pc() const {
+        return stopped_pc;
+    }
+    unsigned short stop_address() const {
+        return stopped_address;
+    }
+
+private:
+    struct register_condition {
+        unsigned short addr;
+        unsigned char reg;
+        comparison cmp;
+        unsigned char value;
+    };
+
+    struct watchpoint {
+        unsigned short begin;
+        unsigned short end;
+        bool on_read;
+        bool on_write;
+    };
+
+    chip8 &ch8;
+
+    std::bitset<0x1000> breakpoints;
+    std::vector<register_condition> conditions;
+    std::vector<watchpoint> watchpoints;
+
+    // one bit per 256 byte page
+    uint16_t exec_pages {0};
+    uint16_t read_pages {0};
+    uint16_t write_pages {0};
+
+    stop_reason stop {none};
+    unsigned short stopped_pc {0};
+    unsigned short stopped_address {0};
+    bool skip_once {false};
+
+    // rebuilds the page bitmaps and registers at the chip8 if anything is armed
+    void update();
+
+    bool stop_at(stop_reason why, unsigned short pc, unsigned short addr);
+};
+
+#endif //CHIP_8_DEBUGGER_H
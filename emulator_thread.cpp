@@ -0,0 +1,87 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "emulator_thread.h"
+#include <chrono>
+#include <cstring>
+
+void emulator_thread::start() {
+    if(thread.joinable())
+        return;
+    quit.store(false,std::memory_order_relaxed);
+    active.store(true,std::memory_order_release);
+    thread = std::thread(&emulator_thread::run,this);
+}
+
+void emulator_thread::stop() {
+    quit.store(true,std::memory_order_relaxed);
+    if(thread.joinable())
+        thread.join();
+    active.store(false,std::memory_order_release);
+}
+
+void emulator_thread::run() {
+    const std::chrono::nanoseconds frame_time(1000000000/60);
+    auto deadline = std::chrono::steady_clock::now();
+
+    while(!quit.load(std::memory_order_relaxed)){
+        key_event event;
+        while(keys.pop(event))
+            ch8.key[event.key&0xF] = event.pressed;
+
+        bool completed;
+        uint64_t instructions = ch8.instructions_executed, unknown = ch8.unknown_opcodes;
+        auto started = std::chrono::steady_clock::now();
+        const unsigned char *pixels = ahead.frame(ch8,completed);
+        if(metrics != nullptr)
+            metrics->record_frames(1,ch8.instructions_executed-instructions,ch8.unknown_opcodes-unknown,
+                                   std::chrono::steady_clock::now()-started);
+        // the sound is never speculative
+        if(audio != nullptr)
+            audio->frame(ch8.beep);
+
+        frame &f = frames.back();
+        std::memcpy(f.pixels,pixels,sizeof(f.pixels));
+        f.number = ++frame_count;
+        frames.publish();
+        if(exporter != nullptr)
+            exporter->publish(pixels,frame_count);
+
+        // the debugger stopped the emulation
+        if(!completed)
+            break;
+
+        if(turbo.load(std::memory_order_relaxed)){
+            deadline = std::chrono::steady_clock::now();
+        } else {
+            // after a stall the lost frames are not made up, the emulation continues at normal speed
+            deadline += frame_time;
+            auto now = std::chrono::steady_clock::now();
+            if(now-deadline > 4*frame_time)
+                deadline = now;
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+    active.store(false,std::memory_order_release);
+}
@@ -0,0 +1,130 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_EMULATOR_THREAD_H
+#define CHIP_8_EMULATOR_THREAD_H
+
+#include "audio.h"
+#include "chip8.h"
+#include "metrics.h"
+#include "run_ahead.h"
+#include "shm_framebuffer.h"
+#include "spsc_ring.h"
+#include "triple_buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Runs a chip8 on its own thread at 60 frames per second, so the presentation can never slow down the emulation.
+// Completed frames are published through a triple buffer, key events arrive through a ring buffer. While the thread
+// runs, nobody else may touch the chip8.
+class emulator_thread {
+public:
+    struct frame {
+        unsigned char pixels[chip8::width*chip8::height];
+        uint64_t number;
+    };
+
+    struct key_event {
+        unsigned char key;
+        bool pressed;
+    };
+
+    explicit emulator_thread(chip8 &ch8) : ch8(ch8) {}
+    ~emulator_thread(){
+        stop();
+    }
+
+    void start();
+
+    // blocks until the thread has finished its current frame
+    void stop();
+
+    // false once the thread was stopped or the debugger stopped the emulation
+    bool running() const {
+        return active.load(std::memory_order_acquire);
+    }
+
+    // without pacing the frames are emulated as fast as possible
+    void set_turbo(bool enabled){
+        turbo.store(enabled,std::memory_order_relaxed);
+    }
+
+    // every published frame is also written to the shared memory segment. Only call while the thread is stopped
+    void set_export(shm_writer *writer){
+        exporter = writer;
+    }
+
+    // the sound of every frame is rendered to the stream. Only call while the thread is stopped
+    void set_audio(audio_stream *stream){
+        audio = stream;
+    }
+
+    // presents frames which are emulated this many frames ahead, see run_ahead.h. Only call while the thread is
+    // stopped
+    void set_run_ahead(unsigned int frames){
+        ahead.set_frames(frames);
+    }
+    // every frame is recorded in the metrics. Only call while the thread is stopped
+    void set_metrics(thread_metrics *m){
+        metrics = m;
+    }
+
+    // only valid while the thread is stopped
+    const run_ahead::statistics &run_ahead_stats() const {
+        return ahead.stats();
+    }
+
+    // called by the presentation thread. Returns false if the ring is full and the event was dropped
+    bool send_key(unsigned char key, bool pressed){
+        return keys.push({key,pressed});
+    }
+
+    // called by the presentation thread. Returns true if a new frame was published since the last call
+    bool update_frame(){
+        return frames.update();
+    }
+    const frame &latest_frame() const {
+        return frames.front();
+    }
+
+private:
+    chip8 &ch8;
+    std::thread thread;
+    std::atomic<bool> quit {false};
+    std::atomic<bool> active {false};
+    std::atomic<bool> turbo {false};
+    uint64_t frame_count {0};
+    shm_writer *exporter {nullptr};
+    audio_stream *audio {nullptr};
+    thread_metrics *metrics {nullptr};
+    run_ahead ahead;
+
+    spsc_ring<key_event,64> keys;
+    triple_buffer<frame> frames;
+
+    void run();
+};
+
+#endif //CHIP_8_EMULATOR_THREAD_H
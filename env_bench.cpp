@@ -0,0 +1,104 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "vector_env.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iterator>
+#include <vector>
+
+// chip8_env_bench [--envs N] [--steps N] [--threads N] [--frame-skip N] rom
+// steps a vector_env with random actions, like an agent which explores, and reports the environment steps per second
+int main(int argc, char **argv) {
+    static const option options[] = {
+            {"envs",required_argument,nullptr,'e'},
+            {"steps",required_argument,nullptr,'s'},
+            {"threads",required_argument,nullptr,'t'},
+            {"frame-skip",required_argument,nullptr,'f'},
+            {"help",no_argument,nullptr,'h'},
+            {nullptr,0,nullptr,0}
+    };
+    vector_env_options env_options;
+    env_options.envs = 256;
+    unsigned long steps = 1000;
+    int opt;
+    while((opt = getopt_long(argc,argv,"h",options,nullptr)) != -1){
+        switch (opt){
+            case 'e': env_options.envs = std::strtoul(optarg,nullptr,0); break;
+            case 's': steps = std::strtoul(optarg,nullptr,0); break;
+            case 't': env_options.threads = std::strtoul(optarg,nullptr,0); break;
+            case 'f': env_options.frame_skip = std::strtoul(optarg,nullptr,0); break;
+            default:
+                std::fprintf(stderr,"usage: %s [--envs N] [--steps N] [--threads N] [--frame-skip N] rom\n",argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(optind >= argc || env_options.envs == 0){
+        std::fprintf(stderr,"usage: %s [--envs N] [--steps N] [--threads N] [--frame-skip N] rom\n",argv[0]);
+        return 1;
+    }
+    std::ifstream file(argv[optind],std::ios::binary);
+    std::vector<unsigned char> rom((std::istreambuf_iterator<char>(file)),std::istreambuf_iterator<char>());
+    if(!file.is_open() || rom.empty()){
+        std::fprintf(stderr,"can not read %s\n",argv[optind]);
+        return 1;
+    }
+
+    vector_env env(rom.data(),rom.size(),env_options);
+    size_t n = env.size();
+    std::vector<uint64_t> seeds(n);
+    for(size_t i = 0; i < n; ++i)
+        seeds[i] = i;
+    std::vector<uint16_t> actions(n);
+    std::vector<unsigned char> observations(n*vector_env::observation_size);
+    std::vector<float> rewards(n);
+    std::vector<unsigned char> dones(n);
+    env.reset(seeds.data(),observations.data());
+
+    // one key or none per step
+    uint64_t random = 1;
+    double reward = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(unsigned long step = 0; step < steps; ++step){
+        for(size_t i = 0; i < n; ++i){
+            random = random*6364136223846793005ull+1442695040888963407ull;
+            unsigned int key = random >> 59;
+            actions[i] = key < 16 ? 1 << key : 0;
+        }
+        env.step(actions.data(),observations.data(),rewards.data(),dones.data());
+        reward += rewards[0];
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+
+    double env_steps = (double)n*steps;
+    std::printf("envs          %zu, frame skip %u\n",n,env_options.frame_skip);
+    std::printf("run           %.3fs, %.0f env steps/s, %.2f M frames/s\n",elapsed.count(),
+                env_steps/elapsed.count(),env_steps*env_options.frame_skip/elapsed.count()/1e6);
+    std::printf("episodes      %llu\n",(unsigned long long)env.episodes());
+    std::printf("checksum      %.0f\n",reward+observations[n*vector_env::observation_size/2]);
+    return 0;
+}
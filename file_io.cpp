@@ -0,0 +1,102 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "file_io.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void collect_files(const std::string &path, std::vector<std::string> &files) {
+    struct stat st;
+    if(stat(path.c_str(),&st) != 0)
+        return;
+    if(S_ISREG(st.st_mode)){
+        files.push_back(path);
+        return;
+    }
+    if(!S_ISDIR(st.st_mode))
+        return;
+    DIR *dir = opendir(path.c_str());
+    if(dir == nullptr)
+        return;
+    std::vector<std::string> children;
+    while(dirent *child = readdir(dir))
+        if(std::strcmp(child->d_name,".") != 0 && std::strcmp(child->d_name,"..") != 0)
+            children.push_back(path+"/"+child->d_name);
+    closedir(dir);
+    std::sort(children.begin(),children.end());
+    for(const std::string &child : children)
+        collect_files(child,files);
+}
+
+bool replace_file(const std::string &path, const std::vector<unsigned char> &data) {
+    std::string temporary = path+".tmp";
+    FILE *file = std::fopen(temporary.c_str(),"wb");
+    if(file == nullptr)
+        return false;
+    bool ok = std::fwrite(data.data(),1,data.size(),file) == data.size();
+    ok = std::fclose(file) == 0 && ok;
+    if(!ok || std::rename(temporary.c_str(),path.c_str()) != 0){
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+mapped_file::~mapped_file() {
+    close();
+}
+
+bool mapped_file::open(const std::string &path, std::string &error) {
+    close();
+    int fd = ::open(path.c_str(),O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd,&st) != 0 || st.st_size == 0){
+        if(fd >= 0)
+            ::close(fd);
+        error = "can not open "+path;
+        return false;
+    }
+    void *m = mmap(nullptr,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if(m == MAP_FAILED){
+        error = "can not map "+path;
+        return false;
+    }
+    base = static_cast<const unsigned char *>(m);
+    length = (size_t)st.st_size;
+    return true;
+}
+
+void mapped_file::close() {
+    if(base != nullptr)
+        munmap(const_cast<unsigned char *>(base),length);
+    base = nullptr;
+    length = 0;
+}
@@ -0,0 +1,67 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_FILE_IO_H
+#define CHIP_8_FILE_IO_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// File access shared by the tools which work on a ROM corpus and by the indexed files they write, see rom_pack.h
+// and golden.h.
+
+// appends path if it is a regular file, or the regular files below it if it is a directory. Directories are walked
+// in sorted order, so the results do not depend on the file system
+void collect_files(const std::string &path, std::vector<std::string> &files);
+
+// writes data to path.tmp and renames it to path, so readers never see a partial file. Returns false on I/O errors
+bool replace_file(const std::string &path, const std::vector<unsigned char> &data);
+
+// a whole file, mapped read only
+class mapped_file {
+public:
+    mapped_file() = default;
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+    ~mapped_file();
+
+    // returns false and sets error if the file can not be opened, is empty or can not be mapped
+    bool open(const std::string &path, std::string &error);
+    void close();
+
+    const unsigned char *data() const {
+        return base;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const unsigned char *base {nullptr};
+    size_t length {0};
+};
+
+#endif //CHIP_8_FILE_IO_H
@@ -0,0 +1,198 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "frame_cache.h"
+#include <cstring>
+
+namespace {
+    // the delta addresses memory, display and stack as one range
+    const size_t display_offset = sizeof(chip8::memory);
+    const size_t stack_offset = display_offset+chip8::width*chip8::height;
+
+    // unchanged bytes between two changes up to this number are stored, one run costs as much
+    const size_t merge_gap = sizeof(uint32_t);
+
+    // an estimate of the node of the index and of the list and of the allocations of the vectors
+    const size_t node_overhead = 96;
+}
+
+frame_cache::frame_cache(size_t memory_budget) : budget(memory_budget) {}
+
+void frame_cache::clear() {
+    lru.clear();
+    index.clear();
+    used = 0;
+    counters = statistics();
+}
+
+size_t frame_cache::cost(const entry &e) {
+    return sizeof(entry)+node_overhead+e.runs.size()*sizeof(run)+e.bytes.size()+e.info.size();
+}
+
+namespace {
+    template<typename Entry, typename Run>
+    void diff(const unsigned char *a, const unsigned char *b, size_t size, size_t base, Entry &e){
+        size_t i = 0;
+        while(i < size){
+            // equal 8 byte chunks are skipped at once, the compiler turns the memcmp into one load per side
+            while(i+8 <= size && std::memcmp(a+i,b+i,8) == 0)
+                i += 8;
+            while(i < size && a[i] == b[i])
+                ++i;
+            if(i == size)
+                break;
+            size_t end = i+1;
+            for(size_t j = end; j < size && j-end < merge_gap; ++j)
+                if(a[j] != b[j])
+                    end = j+1;
+            e.runs.push_back(Run{(uint16_t)(base+i),(uint16_t)(end-i)});
+            e.bytes.insert(e.bytes.end(),b+i,b+end);
+            i = end;
+        }
+    }
+}
+
+void frame_cache::record(const chip8 &before, const chip8 &after, entry &e) {
+    registers &r = e.after;
+    r.PC = after.PC;
+    r.I = after.I;
+    r.opcode = after.opcode;
+    std::memcpy(r.VF,after.VF,sizeof(r.VF));
+    r.SP = after.SP;
+    r.delay_timer = after.delay_timer;
+    r.sound_timer = after.sound_timer;
+    r.beep = after.beep;
+    r.vip_overrun = after.vip_overrun;
+    r.rng_state = after.rng_state;
+
+    diff<entry,run>(before.memory,after.memory,sizeof(after.memory),0,e);
+    diff<entry,run>(before.display,after.display,sizeof(after.display),display_offset,e);
+    diff<entry,run>(reinterpret_cast<const unsigned char *>(before.stack),
+                    reinterpret_cast<const unsigned char *>(after.stack),sizeof(after.stack),stack_offset,e);
+
+    e.instructions = after.instructions_executed-before.instructions_executed;
+    e.machine_cycles = after.machine_cycles-before.machine_cycles;
+    e.unknown_opcodes = after.unknown_opcodes-before.unknown_opcodes;
+    if(std::strcmp(before.info_string,after.info_string) != 0)
+        e.info = after.info_string;
+}
+
+void frame_cache::apply(const entry &e, chip8 &ch8) {
+    const registers &r = e.after;
+    ch8.PC = r.PC;
+    ch8.I = r.I;
+    ch8.opcode = r.opcode;
+    std::memcpy(ch8.VF,r.VF,sizeof(r.VF));
+    ch8.SP = r.SP;
+    ch8.delay_timer = r.delay_timer;
+    ch8.sound_timer = r.sound_timer;
+    ch8.beep = r.beep;
+    ch8.vip_overrun = r.vip_overrun;
+    ch8.rng_state = r.rng_state;
+
+    const unsigned char *bytes = e.bytes.data();
+    for(const run &changed : e.runs){
+        // runs never cross from one part to the next
+        unsigned char *target;
+        if(changed.offset < display_offset)
+            target = ch8.memory+changed.offset;
+        else if(changed.offset < stack_offset)
+            target = ch8.display+(changed.offset-display_offset);
+        else
+            target = reinterpret_cast<unsigned char *>(ch8.stack)+(changed.offset-stack_offset);
+        std::memcpy(target,bytes,changed.length);
+        bytes += changed.length;
+    }
+
+    ch8.instructions_executed += e.instructions;
+    ch8.machine_cycles += e.machine_cycles;
+    ch8.unknown_opcodes += e.unknown_opcodes;
+    if(!e.info.empty())
+        std::strncpy(ch8.info_string,e.info.c_str(),sizeof(ch8.info_string)-1);
+}
+
+void frame_cache::insert(entry &&e) {
+    size_t size = cost(e);
+    if(size > budget)
+        return;
+    lru.push_front(std::move(e));
+    index[lru.front().hash] = lru.begin();
+    used += size;
+    while(used > budget){
+        used -= cost(lru.back());
+        index.erase(lru.back().hash);
+        lru.pop_back();
+        ++counters.evictions;
+    }
+}
+
+bool frame_cache::run_frame(chip8 &ch8) {
+    if(ch8.armed_debugger != nullptr || ch8.profiler != nullptr){
+        ++counters.bypassed;
+        return ch8.run_frame();
+    }
+
+    ++counters.lookups;
+    uint64_t hash = ch8.state_hash();
+    auto found = index.find(hash);
+    if(found != index.end()){
+        ++counters.hits;
+        // most recently used first
+        lru.splice(lru.begin(),lru,found->second);
+        const entry &e = lru.front();
+        if(verify_one_in == 0 || counters.hits%verify_one_in != 0){
+            apply(e,ch8);
+            return true;
+        }
+
+        ++counters.verified;
+        if(!check)
+            check.reset(new chip8(ch8));
+        else
+            *check = ch8;
+        check->run_frame();
+        apply(e,ch8);
+        if(!ch8.same_state(*check) || ch8.instructions_executed != check->instructions_executed ||
+           ch8.machine_cycles != check->machine_cycles || ch8.unknown_opcodes != check->unknown_opcodes){
+            // a collision of the hash. The emulated frame is right, the entry is dropped
+            ++counters.mismatches;
+            ch8 = *check;
+            used -= cost(e);
+            lru.pop_front();
+            index.erase(found);
+        }
+        return true;
+    }
+
+    if(!before)
+        before.reset(new chip8(ch8));
+    else
+        *before = ch8;
+    bool completed = ch8.run_frame();
+    entry e;
+    e.hash = hash;
+    record(*before,ch8,e);
+    insert(std::move(e));
+    return completed;
+}
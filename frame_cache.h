@@ -0,0 +1,132 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_FRAME_CACHE_H
+#define CHIP_8_FRAME_CACHE_H
+
+#include "chip8.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memoizes whole frames. Before a frame the state is hashed with chip8::state_hash(), which includes the keys. If the
+// cache has seen the state before, the frame is not emulated. Instead the recorded delta is applied: the registers,
+// the changed runs of memory, display and stack, and the increments of the counters of chip8. Otherwise the frame is
+// emulated and its delta recorded. This pays off where the same states come up again and again, e.g. many VMs
+// which search or replay from common states, or menu and attract loops, and where frames are expensive compared to
+// the hash, which costs about as much as 50 instructions.
+//
+// Entries are evicted least recently used first once the memory budget is exceeded. The verify mode emulates every
+// Nth hit anyway and compares the results, to catch hash collisions. A machine with a debugger or profiler attached
+// always runs its frames, they have to see every instruction.
+class frame_cache {
+public:
+    struct statistics {
+        uint64_t lookups {0};
+        uint64_t hits {0};
+        uint64_t evictions {0};
+        uint64_t verified {0};
+        // verified hits whose delta did not match the emulation. The emulated result is kept
+        uint64_t mismatches {0};
+        // frames which bypassed the cache because of attached hooks
+        uint64_t bypassed {0};
+    };
+
+    explicit frame_cache(size_t memory_budget = 64 << 20);
+
+    // emulates every one_in-th hit and compares. 0 turns the verification off
+    void set_verify(unsigned int one_in){
+        verify_one_in = one_in;
+    }
+
+    // runs one frame of ch8 like chip8::run_frame(). ch8 may be any instance, the cache is shared by all of them
+    bool run_frame(chip8 &ch8);
+
+    const statistics &stats() const {
+        return counters;
+    }
+
+    double hit_rate() const {
+        return counters.lookups > 0 ? (double)counters.hits/counters.lookups : 0;
+    }
+
+    size_t entries() const {
+        return lru.size();
+    }
+
+    // estimated memory of all entries
+    size_t bytes() const {
+        return used;
+    }
+
+    void clear();
+
+private:
+    // everything except memory, display and stack is stored completely
+    struct registers {
+        unsigned short PC, I, opcode;
+        unsigned char VF[16];
+        unsigned char SP, delay_timer, sound_timer;
+        bool beep;
+        long vip_overrun;
+        uint64_t rng_state;
+    };
+
+    // a run of changed bytes of memory, display and stack, addressed as if they followed each other
+    struct run {
+        uint16_t offset;
+        uint16_t length;
+    };
+
+    struct entry {
+        uint64_t hash;
+        registers after;
+        std::vector<run> runs;
+        std::vector<unsigned char> bytes;
+        uint64_t instructions;
+        uint64_t machine_cycles;
+        uint64_t unknown_opcodes;
+        // info_string after the frame, only kept if it changed
+        std::string info;
+    };
+
+    size_t budget;
+    size_t used {0};
+    unsigned int verify_one_in {0};
+    statistics counters;
+    std::list<entry> lru;
+    std::unordered_map<uint64_t,std::list<entry>::iterator> index;
+    std::unique_ptr<chip8> before;
+    std::unique_ptr<chip8> check;
+
+    static size_t cost(const entry &e);
+    static void record(const chip8 &before, const chip8 &after, entry &e);
+    static void apply(const entry &e, chip8 &ch8);
+    void insert(entry &&e);
+};
+
+#endif //CHIP_8_FRAME_CACHE_H
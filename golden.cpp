@@ -0,0 +1,251 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "golden.h"
+#include "byte_order.h"
+#include "halt_detector.h"
+#include "hash.h"
+#include <algorithm>
+
+namespace {
+    // runs the ROM and hands every checkpoint to visit, until visit returns false
+    template<typename Visit>
+    void run(const unsigned char *rom, size_t size, const golden_options &options, Visit visit){
+        chip8 ch8;
+        ch8.load_program(rom,size);
+        ch8.seed(options.seed);
+        ch8.instructions_per_frame = options.instructions_per_frame;
+        halt_detector halts;
+        for(uint32_t frame = 1; frame <= options.frames; ++frame){
+            ch8.run_frame();
+            bool halted = halts.check(ch8,frame);
+            if(halted || frame == options.frames || (options.interval > 0 && frame%options.interval == 0)){
+                golden_checkpoint checkpoint;
+                checkpoint.frame = frame;
+                checkpoint.digest = ch8.digest();
+                checkpoint.framebuffer = fnv1a_64(ch8.framebuffer(),chip8::width*chip8::height);
+                if(!visit(checkpoint))
+                    return;
+            }
+            if(halted)
+                return;
+        }
+    }
+
+    // the frame of checkpoint i of a run which took frames frames
+    uint32_t checkpoint_frame(const golden_options &options, uint32_t frames, uint32_t i){
+        if(options.interval == 0)
+            return frames;
+        return std::min<uint64_t>((uint64_t)(i+1)*options.interval,frames);
+    }
+}
+
+std::vector<golden_checkpoint> golden_run(const unsigned char *rom, size_t size, const golden_options &options) {
+    std::vector<golden_checkpoint> checkpoints;
+    run(rom,size,options,[&checkpoints](const golden_checkpoint &checkpoint){
+        checkpoints.push_back(checkpoint);
+        return true;
+    });
+    return checkpoints;
+}
+
+golden_builder::result golden_builder::add(const unsigned char *rom, size_t size) {
+    if(size == 0 || size > chip8::max_program_size)
+        return rejected;
+    uint64_t hash = fnv1a_64(rom,size);
+    if(index.count(hash) != 0)
+        return duplicate;
+    index[hash] = entries.size();
+    entries.push_back(entry{hash,golden_run(rom,size,options)});
+    return added;
+}
+
+void golden_builder::encode(std::vector<unsigned char> &out) const {
+    std::vector<const entry *> sorted;
+    sorted.reserve(entries.size());
+    size_t checkpoints = 0;
+    for(const entry &e : entries){
+        sorted.push_back(&e);
+        checkpoints += e.checkpoints.size();
+    }
+    std::sort(sorted.begin(),sorted.end(),[](const entry *a, const entry *b){ return a->hash < b->hash; });
+
+    size_t entries_size = sorted.size()*golden_entry_size;
+    out.assign(golden_header_size+entries_size+checkpoints*golden_checkpoint_size,0);
+    unsigned char *header = out.data();
+    put32(header,golden_magic);
+    put16(header+4,golden_version);
+    put16(header+6,golden_entry_size);
+    put32(header+8,(uint32_t)sorted.size());
+    put32(header+12,options.frames);
+    put32(header+16,options.interval);
+    put32(header+20,options.instructions_per_frame);
+    put64(header+24,options.seed);
+    put32(header+32,(uint32_t)out.size());
+
+    size_t offset = golden_header_size+entries_size;
+    for(size_t i = 0; i < sorted.size(); ++i){
+        const entry &e = *sorted[i];
+        unsigned char *p = out.data()+golden_header_size+i*golden_entry_size;
+        put64(p,e.hash);
+        put32(p+8,(uint32_t)offset);
+        put32(p+12,(uint32_t)e.checkpoints.size());
+        put32(p+16,e.checkpoints.empty() ? 0 : e.checkpoints.back().frame);
+        for(const golden_checkpoint &checkpoint : e.checkpoints){
+            put64(out.data()+offset,checkpoint.digest);
+            put64(out.data()+offset+8,checkpoint.framebuffer);
+            offset += golden_checkpoint_size;
+        }
+    }
+    put64(header+40,fnv1a_64(out.data()+golden_header_size,out.size()-golden_header_size));
+}
+
+bool golden_builder::write(const std::string &path) const {
+    std::vector<unsigned char> bytes;
+    encode(bytes);
+    return replace_file(path,bytes);
+}
+
+golden_store::~golden_store() {
+    close();
+}
+
+bool golden_store::open(const std::string &path) {
+    close();
+    if(!file.open(path,message))
+        return false;
+    return attach(file.data(),file.size());
+}
+
+bool golden_store::open(const unsigned char *data, size_t size) {
+    close();
+    return attach(data,size);
+}
+
+void golden_store::close() {
+    file.close();
+    base = nullptr;
+    length = 0;
+    count = 0;
+}
+
+bool golden_store::attach(const unsigned char *data, size_t size) {
+    base = data;
+    length = size;
+    if(!validate()){
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool golden_store::validate() {
+    if(length < golden_header_size || get32(base) != golden_magic){
+        message = "not a golden store";
+        return false;
+    }
+    if(get16(base+4) != golden_version || get16(base+6) != golden_entry_size){
+        message = "golden store version "+std::to_string(get16(base+4))+" is not supported";
+        return false;
+    }
+    size_t n = get32(base+8);
+    size_t checkpoints_offset = golden_header_size+n*golden_entry_size;
+    if(get32(base+32) != length || checkpoints_offset > length){
+        message = "golden store is truncated";
+        return false;
+    }
+    if(fnv1a_64(base+golden_header_size,length-golden_header_size) != get64(base+40)){
+        message = "golden store checksum mismatch";
+        return false;
+    }
+    for(size_t i = 0; i < n; ++i){
+        const unsigned char *p = base+golden_header_size+i*golden_entry_size;
+        size_t offset = get32(p+8), checkpoints = get32(p+12);
+        if(offset < checkpoints_offset || offset+checkpoints*golden_checkpoint_size > length ||
+           (i > 0 && get64(p-golden_entry_size) >= get64(p))){
+            message = "golden store entry "+std::to_string(i)+" is invalid";
+            return false;
+        }
+    }
+    count = n;
+    recorded.frames = get32(base+12);
+    recorded.interval = get32(base+16);
+    recorded.instructions_per_frame = get32(base+20);
+    recorded.seed = get64(base+24);
+    return true;
+}
+
+const unsigned char *golden_store::find(uint64_t hash) const {
+    size_t low = 0, high = count;
+    while(low < high){
+        size_t mid = low+(high-low)/2;
+        const unsigned char *p = base+golden_header_size+mid*golden_entry_size;
+        uint64_t h = get64(p);
+        if(h == hash)
+            return p;
+        if(h < hash)
+            low = mid+1;
+        else
+            high = mid;
+    }
+    return nullptr;
+}
+
+golden_store::outcome golden_store::check(const unsigned char *rom, size_t size) const {
+    outcome result;
+    const unsigned char *e = find(fnv1a_64(rom,size));
+    if(e == nullptr)
+        return result;
+
+    const unsigned char *golden = base+get32(e+8);
+    uint32_t expected = get32(e+12), frames = get32(e+16);
+    result.result = pass;
+    run(rom,size,recorded,[&](const golden_checkpoint &checkpoint){
+        uint32_t i = result.checkpoints;
+        uint32_t frame = i < expected ? checkpoint_frame(recorded,frames,i) : frames;
+        const unsigned char *p = golden+i*golden_checkpoint_size;
+        if(i >= expected || checkpoint.frame != frame){
+            // the run halted at another frame than the golden one
+            result.result = diverged;
+            result.frame = std::min(checkpoint.frame,frame);
+            result.digest_differs = true;
+            return false;
+        }
+        result.frame = frame;
+        result.digest_differs = checkpoint.digest != get64(p);
+        result.framebuffer_differs = checkpoint.framebuffer != get64(p+8);
+        if(result.digest_differs || result.framebuffer_differs){
+            result.result = diverged;
+            return false;
+        }
+        ++result.checkpoints;
+        return true;
+    });
+    if(result.result == pass && result.checkpoints < expected){
+        result.result = diverged;
+        result.frame = checkpoint_frame(recorded,frames,result.checkpoints);
+        result.digest_differs = true;
+    }
+    return result;
+}
@@ -0,0 +1,183 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_GOLDEN_H
+#define CHIP_8_GOLDEN_H
+
+#include "chip8.h"
+#include "file_io.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A golden store keeps the expected run of every ROM of a corpus in one file. Each ROM is run from the same seed for
+// a fixed number of frames, and every interval frames a checkpoint records chip8::digest() and the FNV-1a of the
+// framebuffer. A checkpoint is also taken at the frame where the run ends early because the ROM halted, see
+// halt_detector.h. A later run compares at every checkpoint and stops at the first one that differs, so a
+// regression shows up at the frame where it happens and not only at the end. A run which passes does the same work
+// as before plus one digest per checkpoint. All integers are little endian:
+//   header   48 bytes
+//     0  uint32 magic "C8GS"
+//     4  uint16 version
+//     6  uint16 size of an entry, 24
+//     8  uint32 number of ROMs
+//    12  uint32 frames per ROM
+//    16  uint32 frames between checkpoints
+//    20  uint32 instructions per frame
+//    24  uint64 seed of every run
+//    32  uint32 size of the file
+//    36  uint32 reserved, 0
+//    40  uint64 FNV-1a of the entries and the checkpoints
+//   entries, sorted by hash
+//     0  uint64 FNV-1a of the ROM, like in rom_pack.h
+//     8  uint32 offset of the checkpoints
+//    12  uint32 number of checkpoints
+//    16  uint32 frames the run took, less than frames per ROM if it halted
+//    20  uint32 reserved, 0
+//   checkpoints, 16 bytes each
+//     0  uint64 chip8::digest()
+//     8  uint64 FNV-1a of the framebuffer
+const uint32_t golden_magic = 0x53473843;
+const uint16_t golden_version = 1;
+const size_t golden_header_size = 48;
+const size_t golden_entry_size = 24;
+const size_t golden_checkpoint_size = 16;
+
+struct golden_options {
+    uint32_t frames {600};
+    uint32_t interval {60};
+    uint32_t instructions_per_frame {10};
+    uint64_t seed {1};
+};
+
+struct golden_checkpoint {
+    uint32_t frame;
+    uint64_t digest;
+    uint64_t framebuffer;
+};
+
+// runs the ROM as a golden store does and returns its checkpoints
+std::vector<golden_checkpoint> golden_run(const unsigned char *rom, size_t size, const golden_options &options);
+
+class golden_builder {
+public:
+    enum result {
+        added,
+        // the ROM is already in the store
+        duplicate,
+        // empty or larger than the 0xE00 bytes which fit into memory
+        rejected
+    };
+
+    explicit golden_builder(const golden_options &options = golden_options()) : options(options) {}
+
+    // runs the ROM and keeps its checkpoints
+    result add(const unsigned char *rom, size_t size);
+
+    size_t roms() const {
+        return entries.size();
+    }
+
+    void encode(std::vector<unsigned char> &out) const;
+
+    // writes the store through a temporary file. Returns false on I/O errors
+    bool write(const std::string &path) const;
+
+private:
+    struct entry {
+        uint64_t hash;
+        std::vector<golden_checkpoint> checkpoints;
+    };
+
+    golden_options options;
+    std::vector<entry> entries;
+    std::unordered_map<uint64_t,size_t> index;
+};
+
+class golden_store {
+public:
+    enum verdict {
+        pass,
+        // a checkpoint differs
+        diverged,
+        // the store has no golden run of this ROM
+        missing
+    };
+
+    struct outcome {
+        verdict result {missing};
+        // the first checkpoint which differs, or the last one which was compared
+        uint32_t frame {0};
+        bool digest_differs {false};
+        bool framebuffer_differs {false};
+        // checkpoints which matched
+        uint32_t checkpoints {0};
+    };
+
+    golden_store() = default;
+    golden_store(const golden_store &) = delete;
+    golden_store &operator=(const golden_store &) = delete;
+    ~golden_store();
+
+    // maps the file. Returns false and sets error() if it is no valid store
+    bool open(const std::string &path);
+
+    // uses a store which is already in memory. The data has to outlive the store
+    bool open(const unsigned char *data, size_t size);
+
+    void close();
+
+    const std::string &error() const {
+        return message;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // the settings the store was recorded with
+    const golden_options &options() const {
+        return recorded;
+    }
+
+    // runs the ROM and compares it with its golden run up to the first checkpoint which differs
+    outcome check(const unsigned char *rom, size_t size) const;
+
+private:
+    const unsigned char *base {nullptr};
+    size_t length {0};
+    size_t count {0};
+    mapped_file file;
+    golden_options recorded;
+    std::string message;
+
+    // validates the data and keeps it, or closes the store
+    bool attach(const unsigned char *data, size_t size);
+    bool validate();
+    // the entry of the ROM with this hash or null
+    const unsigned char *find(uint64_t hash) const;
+};
+
+#endif //CHIP_8_GOLDEN_H
@@ -0,0 +1,159 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "golden.h"
+#include "rom_pack.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+    struct corpus_rom {
+        std::string name;
+        std::vector<unsigned char> data;
+    };
+
+    // the ROMs of the pack or of the files. Returns false if the pack can not be opened
+    bool read_corpus(const char *pack_path, const std::vector<std::string> &files, std::vector<corpus_rom> &roms){
+        if(pack_path != nullptr){
+            rom_pack pack;
+            if(!pack.open(pack_path)){
+                std::fprintf(stderr,"%s\n",pack.error().c_str());
+                return false;
+            }
+            for(size_t i = 0; i < pack.size(); ++i){
+                rom_pack::rom r = pack.at(i);
+                roms.push_back(corpus_rom{r.name,std::vector<unsigned char>(r.data,r.data+r.size)});
+            }
+            return true;
+        }
+        for(const std::string &file : files){
+            std::ifstream in(file,std::ios::binary);
+            std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+            if(!in.is_open())
+                std::fprintf(stderr,"can not read %s\n",file.c_str());
+            else
+                roms.push_back(corpus_rom{file,data});
+        }
+        return true;
+    }
+
+    void usage(const char *name){
+        std::fprintf(stderr,"usage: %s --record STORE [--frames N] [--interval N] [--seed N] file|directory...|--pack PACK\n"
+                            "       %s --check STORE file|directory...|--pack PACK\n",name,name);
+    }
+}
+
+// chip8_golden --record STORE [--frames N] [--interval N] [--seed N] file|directory...|--pack PACK
+// chip8_golden --check STORE file|directory...|--pack PACK
+// records the golden runs of a corpus or compares the corpus with them, see golden.h. Checking reports the frame at
+// which every ROM diverged and exits with 1 if one did
+int main(int argc, char **argv) {
+    static const option options[] = {
+            {"record",required_argument,nullptr,'r'},
+            {"check",required_argument,nullptr,'c'},
+            {"pack",required_argument,nullptr,'p'},
+            {"frames",required_argument,nullptr,'f'},
+            {"interval",required_argument,nullptr,'i'},
+            {"seed",required_argument,nullptr,'s'},
+            {"help",no_argument,nullptr,'h'},
+            {nullptr,0,nullptr,0}
+    };
+    std::string store_path;
+    bool recording = false;
+    const char *pack_path = nullptr;
+    golden_options golden;
+    int opt;
+    while((opt = getopt_long(argc,argv,"h",options,nullptr)) != -1){
+        switch (opt){
+            case 'r': store_path = optarg; recording = true; break;
+            case 'c': store_path = optarg; recording = false; break;
+            case 'p': pack_path = optarg; break;
+            case 'f': golden.frames = std::strtoul(optarg,nullptr,0); break;
+            case 'i': golden.interval = std::strtoul(optarg,nullptr,0); break;
+            case 's': golden.seed = std::strtoull(optarg,nullptr,0); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(store_path.empty() || (optind >= argc && pack_path == nullptr)){
+        usage(argv[0]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> files;
+    for(int i = optind; i < argc; ++i)
+        collect_files(argv[i],files);
+    std::vector<corpus_rom> roms;
+    if(!read_corpus(pack_path,files,roms))
+        return 1;
+
+    if(recording){
+        golden_builder builder(golden);
+        unsigned long counts[3] = {0};
+        for(const corpus_rom &rom : roms)
+            counts[builder.add(rom.data.data(),rom.data.size())]++;
+        if(!builder.write(store_path)){
+            std::fprintf(stderr,"writing %s failed\n",store_path.c_str());
+            return 1;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+        std::printf("roms       %zu\n",roms.size());
+        std::printf("recorded   %lu\n",counts[golden_builder::added]);
+        std::printf("duplicates %lu\n",counts[golden_builder::duplicate]);
+        std::printf("rejected   %lu\n",counts[golden_builder::rejected]);
+        std::printf("time       %.3fs\n",elapsed.count());
+        return 0;
+    }
+
+    golden_store store;
+    if(!store.open(store_path)){
+        std::fprintf(stderr,"%s\n",store.error().c_str());
+        return 1;
+    }
+    unsigned long counts[3] = {0};
+    for(const corpus_rom &rom : roms){
+        golden_store::outcome outcome = store.check(rom.data.data(),rom.data.size());
+        counts[outcome.result]++;
+        if(outcome.result == golden_store::diverged)
+            std::printf("%s: diverged at frame %u,%s%s differs\n",rom.name.c_str(),outcome.frame,
+                        outcome.digest_differs ? " state" : "",outcome.framebuffer_differs ? " framebuffer" : "");
+        else if(outcome.result == golden_store::missing)
+            std::printf("%s: no golden run\n",rom.name.c_str());
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+    std::printf("roms       %zu\n",roms.size());
+    std::printf("passed     %lu\n",counts[golden_store::pass]);
+    std::printf("diverged   %lu\n",counts[golden_store::diverged]);
+    std::printf("missing    %lu\n",counts[golden_store::missing]);
+    std::printf("time       %.3fs\n",elapsed.count());
+    return counts[golden_store::diverged] > 0 ? 1 : 0;
+}
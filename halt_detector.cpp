@@ -0,0 +1,99 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "halt_detector.h"
+
+halt_detector::halt_detector(unsigned int interval, size_t history)
+        : interval(interval > 0 ? interval : 1), history(history > 0 ? history : 1), countdown(this->interval) {
+}
+
+void halt_detector::reset() {
+    halt = halt_info();
+    countdown = interval;
+    states.clear();
+    order.clear();
+}
+
+const char *halt_detector::name(halt_reason reason) {
+    switch(reason){
+        case self_jump: return "jumps to itself";
+        case repeated_state: return "repeats its state";
+        default: return "running";
+    }
+}
+
+bool halt_detector::check(const chip8 &ch8, uint64_t frame) {
+    if(halt.reason != none)
+        return true;
+
+    unsigned short pc = ch8.PC & 0x0FFF;
+    unsigned short next = ch8.memory[pc] << 8 | ch8.memory[(pc+1) & 0x0FFF];
+    if(next == (0x1000 | pc) && ch8.delay_timer == 0 && ch8.sound_timer == 0){
+        halt.reason = self_jump;
+        halt.frame = frame;
+        halt.frame_instructions = ch8.instructions_executed;
+        return true;
+    }
+
+    // hashing the state costs several frames, it is done every interval calls
+    if(--countdown != 0)
+        return false;
+    countdown = interval;
+    uint64_t hash = ch8.state_hash();
+    auto it = states.find(hash);
+    if(it != states.end()){
+        uint64_t period = frame-it->second.frame;
+        if(confirm(ch8,period)){
+            halt.reason = repeated_state;
+            halt.frame = it->second.frame;
+            halt.frame_instructions = it->second.instructions;
+            halt.period = period;
+            return true;
+        }
+        // a hash collision. The newer state replaces the older one
+        it->second = {frame,ch8.instructions_executed};
+        return false;
+    }
+
+    states[hash] = {frame,ch8.instructions_executed};
+    order.push_back(hash);
+    if(order.size() > history){
+        states.erase(order.front());
+        order.pop_front();
+    }
+    return false;
+}
+
+bool halt_detector::confirm(const chip8 &ch8, uint64_t period) {
+    // the machine is deterministic, so a state which comes back after period frames repeats forever
+    if(!scratch)
+        scratch.reset(new chip8(ch8));
+    else
+        *scratch = ch8;
+    scratch->armed_debugger = nullptr;
+    scratch->profiler = nullptr;
+    for(uint64_t i = 0; i < period; ++i)
+        scratch->run_frame();
+    return scratch->same_state(ch8);
+}
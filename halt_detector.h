@@ -0,0 +1,92 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_HALT_DETECTOR_H
+#define CHIP_8_HALT_DETECTOR_H
+
+#include "chip8.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+// Finds out when a ROM without input can not do anything new anymore, so a batch run can stop early. It is checked
+// after every frame and recognizes two cases:
+//   self_jump       the next instruction is a 1NNN to itself and both timers are 0. Nothing changes ever again
+//   repeated_state  the machine is in a state it was in before. The state is hashed every interval calls, a
+//                   repeated hash is confirmed by emulating one period on a copy and comparing the states exactly
+// Both are exact as long as the keys do not change. A loop with a period of P frames is found after at most
+// P*interval frames, as long as P is at most history.
+class halt_detector {
+public:
+    enum halt_reason {
+        none,
+        self_jump,
+        repeated_state
+    };
+
+    struct halt_info {
+        halt_reason reason {none};
+        // frames emulated when the halt was detected. For repeated_state, the first frame of the repetition seen
+        uint64_t frame {0};
+        // chip8::instructions_executed at the end of frame. The halt is only seen between frames, a ROM which reached
+        // its self jump during the frame already spun on it for the rest of the frame
+        uint64_t frame_instructions {0};
+        // frames per repetition, 0 for self_jump
+        uint64_t period {0};
+    };
+
+    explicit halt_detector(unsigned int interval = 120, size_t history = 256);
+
+    // call after every frame with the number of frames emulated so far. Returns true once the machine halted
+    bool check(const chip8 &ch8, uint64_t frame);
+
+    const halt_info &info() const {
+        return halt;
+    }
+
+    // forgets the hashed states, e.g. after the keys changed
+    void reset();
+
+    static const char *name(halt_reason reason);
+
+private:
+    struct seen {
+        uint64_t frame;
+        uint64_t instructions;
+    };
+
+    unsigned int interval;
+    size_t history;
+    unsigned int countdown;
+    halt_info halt;
+    std::unordered_map<uint64_t,seen> states;
+    std::deque<uint64_t> order;
+    // runs the confirmation, allocated on the first repeated hash
+    std::unique_ptr<chip8> scratch;
+
+    bool confirm(const chip8 &ch8, uint64_t period);
+};
+
+#endif //CHIP_8_HALT_DETECTOR_H
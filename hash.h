@@ -0,0 +1,65 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_HASH_H
+#define CHIP_8_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 64 bit FNV-1a hash. It is not cryptographically secure, but fast and good enough to identify ROMs and emulator
+// states. Pass the result of a previous call as seed to hash several buffers as if they were one.
+static const uint64_t fnv1a_seed = 0xcbf29ce484222325ULL;
+
+inline uint64_t fnv1a_64(const void *data, size_t size, uint64_t hash = fnv1a_seed){
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; ++i){
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// hashes 32 bytes per step in four independent lanes, several times faster than fnv1a_64 on large buffers. The result
+// depends on the byte order of the host, so it must not be stored or sent to other machines
+inline uint64_t word_hash_64(const void *data, size_t size, uint64_t hash = fnv1a_seed){
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    const uint64_t k = 0x9E3779B97F4A7C15ULL;
+    uint64_t lanes[4] = {hash,hash^1,hash^2,hash^3};
+    size_t i = 0;
+    for(; i+32 <= size; i += 32){
+        for(int lane = 0; lane < 4; ++lane){
+            uint64_t word;
+            std::memcpy(&word,bytes+i+lane*8,8);
+            lanes[lane] = (lanes[lane]^word)*k;
+            lanes[lane] ^= lanes[lane] >> 32;
+        }
+    }
+    for(int lane = 0; lane < 4; ++lane)
+        hash = ((hash^lanes[lane])*k) ^ (hash >> 29);
+    return fnv1a_64(bytes+i,size-i,hash);
+}
+
+#endif //CHIP_8_HASH_H
@@ -0,0 +1,199 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "headless.h"
+#include "audio.h"
+#include "capture.h"
+#include "frame_cache.h"
+#include "halt_detector.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "profiler.h"
+#include "run_ahead.h"
+#include "savestate.h"
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+int run_headless(chip8 &ch8, const headless_options &options) {
+    frame_capture capture;
+    bool capturing = !options.capture_path.empty();
+    if(capturing && !capture.open(options.capture_path,frame_capture::format_of(options.capture_path),
+                                  chip8::width,chip8::height,options.capture_scale)){
+        std::fprintf(stderr,"can not create %s\n",options.capture_path.c_str());
+        return 1;
+    }
+
+    // without a WAV file no sound is generated at all
+    wav_writer wav;
+    audio_stream audio;
+    bool sound = !options.wav_path.empty();
+    if(sound){
+        if(!wav.open(options.wav_path,audio.generator().sample_rate())){
+            std::fprintf(stderr,"can not create %s\n",options.wav_path.c_str());
+            return 1;
+        }
+        audio.set_wav(&wav);
+    }
+
+    // the profiler only costs time if it is attached
+    std::unique_ptr<call_profiler> profiler;
+    if(!options.profile_path.empty())
+        profiler.reset(new call_profiler(ch8));
+
+    // opened before the run, opening the counters takes several system calls
+    std::unique_ptr<perf_counters> counters;
+    if(options.perf){
+        counters.reset(new perf_counters);
+        counters->start();
+    }
+
+    metrics_registry registry;
+    uint64_t instructions = ch8.instructions_executed, unknown = ch8.unknown_opcodes;
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long frame = 0;
+    run_ahead ahead(options.run_ahead_frames);
+    std::unique_ptr<frame_cache> cache;
+    if(options.frame_cache_bytes > 0){
+        cache.reset(new frame_cache(options.frame_cache_bytes));
+        cache->set_verify(options.frame_cache_verify);
+        ahead.set_cache(cache.get());
+    }
+    terminal_renderer terminal(options.terminal_mode);
+    halt_detector halts;
+    while(frame < options.frames){
+        bool completed;
+        const unsigned char *pixels = ahead.frame(ch8,completed);
+        if(capturing)
+            capture.add_frame(pixels);
+        if(options.render_cells)
+            terminal.render(pixels);
+        if(sound)
+            audio.frame(ch8.beep);
+        ++frame;
+        // nobody presses keys in a headless run, so a halted machine stays halted
+        if(options.stop_on_halt && halts.check(ch8,frame))
+            break;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+    perf_counters::sample perf;
+    if(counters)
+        perf = counters->stop();
+
+    std::printf("frames       %llu\n",frame);
+    if(ch8.timing == chip8::cosmac_vip)
+        std::printf("vip cycles   %llu\n",ch8.machine_cycles);
+    else
+        std::printf("instructions %llu\n",frame*ch8.instructions_per_frame);
+    std::printf("time         %.3fs (%.0f frames/s)\n",elapsed.count(),frame/elapsed.count());
+    std::printf("digest       0x%016llx\n",(unsigned long long)ch8.digest());
+    const halt_detector::halt_info &halt = halts.info();
+    if(halt.reason == halt_detector::self_jump)
+        std::printf("halted       by the end of frame %llu, instruction %llu: %s\n",(unsigned long long)halt.frame,
+                    (unsigned long long)(halt.frame_instructions-instructions),halt_detector::name(halt.reason));
+    else if(halt.reason == halt_detector::repeated_state)
+        std::printf("halted       by frame %llu, instruction %llu: %s every %llu frames\n",
+                    (unsigned long long)halt.frame,(unsigned long long)(halt.frame_instructions-instructions),
+                    halt_detector::name(halt.reason),(unsigned long long)halt.period);
+    if(ahead.frames() > 0 && frame > 0){
+        const run_ahead::statistics &stats = ahead.stats();
+        std::printf("run-ahead    %u frames: %.2fus real + %.2fus copy + %.2fus ahead per frame\n",ahead.frames(),
+                    stats.real_ns/1e3/frame,stats.copy_ns/1e3/frame,stats.ahead_ns/1e3/frame);
+    }
+
+    if(cache){
+        const frame_cache::statistics &stats = cache->stats();
+        std::printf("frame cache  %.1f%% hits of %llu frames, %llu entries in %llu bytes, %llu evicted\n",
+                    100*cache->hit_rate(),(unsigned long long)stats.lookups,(unsigned long long)cache->entries(),
+                    (unsigned long long)cache->bytes(),(unsigned long long)stats.evictions);
+        if(stats.verified > 0)
+            std::printf("             %llu hits verified, %llu mismatched\n",(unsigned long long)stats.verified,
+                        (unsigned long long)stats.mismatches);
+    }
+
+    // the number of instructions is only known with the fixed rate
+    if(counters)
+        std::fputs(perf_report(perf,ch8.timing == chip8::fixed_rate ? (double)frame*ch8.instructions_per_frame : 0)
+                           .c_str(),stdout);
+    if(options.render_cells && frame > 0)
+        std::printf("terminal     %.1f bytes per frame, %llu bytes\n",(double)terminal.bytes()/frame,
+                    (unsigned long long)terminal.bytes());
+
+    if(capturing){
+        if(!capture.close()){
+            std::fprintf(stderr,"writing %s failed\n",options.capture_path.c_str());
+            return 1;
+        }
+        std::printf("capture      %s, %llu unique of %llu frames, %llu bytes\n",options.capture_path.c_str(),
+                    (unsigned long long)capture.unique_frames(),(unsigned long long)capture.frames(),
+                    (unsigned long long)capture.bytes_written());
+    }
+    if(sound){
+        if(!wav.close()){
+            std::fprintf(stderr,"writing %s failed\n",options.wav_path.c_str());
+            return 1;
+        }
+        std::printf("sound        %s, %llu samples\n",options.wav_path.c_str(),(unsigned long long)wav.samples());
+    }
+    if(!options.metrics_path.empty()){
+        // the run is recorded as one batch, the histogram only gets the average frame time
+        thread_metrics &metrics = registry.add("headless");
+        metrics.record_frames(frame,ch8.instructions_executed-instructions,ch8.unknown_opcodes-unknown,
+                              std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed));
+        // the frames which a halt made unnecessary
+        if(ch8.timing == chip8::fixed_rate)
+            metrics.record_idle((options.frames-frame)*ch8.instructions_per_frame);
+        if(!registry.write_file(options.metrics_path)){
+            std::fprintf(stderr,"writing %s failed\n",options.metrics_path.c_str());
+            return 1;
+        }
+        std::printf("metrics      %s\n",options.metrics_path.c_str());
+    }
+    if(!options.save_state_path.empty()){
+        if(!save_savestate(ch8,options.save_state_path)){
+            std::fprintf(stderr,"%s\n",ch8.info_string);
+            return 1;
+        }
+        std::printf("savestate    %s\n",options.save_state_path.c_str());
+    }
+    if(profiler){
+        std::ofstream out(options.profile_path);
+        profiler->write_collapsed(out);
+        if(!out){
+            std::fprintf(stderr,"writing %s failed\n",options.profile_path.c_str());
+            return 1;
+        }
+        std::printf("profile      %s\n",options.profile_path.c_str());
+        std::printf("  routine       calls    inclusive    exclusive\n");
+        std::vector<call_profiler::routine> routines = profiler->routines();
+        double total = profiler->total() > 0 ? profiler->total() : 1;
+        for(size_t i = 0; i < routines.size() && i < 10; ++i){
+            const call_profiler::routine &r = routines[i];
+            std::printf("  0x%03x  %12llu  %10.1f%%  %10.1f%%\n",r.address,(unsigned long long)r.calls,
+                        100*r.inclusive/total,100*r.exclusive/total);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_HEADLESS_H
+#define CHIP_8_HEADLESS_H
+
+#include "chip8.h"
+#include "terminal_renderer.h"
+#include <string>
+
+struct headless_options {
+    // number of 60Hz frames to emulate
+    unsigned long long frames {600};
+
+    // records every frame to this file if not empty, see capture.h
+    std::string capture_path;
+    int capture_scale {1};
+
+    // writes the sound to this WAV file if not empty
+    std::string wav_path;
+
+    // presents, i.e. captures, frames which are emulated this many frames ahead, see run_ahead.h
+    unsigned int run_ahead_frames {0};
+
+    // profiles the subroutines and writes collapsed stacks to this file if not empty, see profiler.h
+    std::string profile_path;
+
+    // writes a savestate of the machine after the last frame to this file if not empty, see savestate.h
+    std::string save_state_path;
+
+    // draws the display with terminal_renderer instead of curses. Headless every frame is rendered without writing
+    // it to report the bytes a terminal would receive
+    bool render_cells {false};
+
+    // ends the run early once the ROM jumps to itself or repeats its state, see halt_detector.h
+    bool stop_on_halt {true};
+
+    // counts hardware events of the run, see perf_counters.h
+    bool perf {false};
+
+    // writes the metrics of the run in the Prometheus text format to this file if not empty, see metrics.h
+    std::string metrics_path;
+
+    // memoizes frames in a cache of this many bytes if not 0, see frame_cache.h. Every frame_cache_verify-th hit is
+    // emulated anyway and compared
+    size_t frame_cache_bytes {0};
+    unsigned int frame_cache_verify {0};
+    terminal_renderer::cell_mode terminal_mode {terminal_renderer::half_block};
+};
+
+// runs the loaded ROM without a terminal and as fast as possible, then prints a summary to stdout. Returns the exit
+// code for main
+int run_headless(chip8 &ch8, const headless_options &options);
+
+#endif //CHIP_8_HEADLESS_H
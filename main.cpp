@@ -24,10 +24,24 @@ SOFTWARE.
 
 #include <iostream>
 #include "chip8.h"
+#include "analyzer.h"
+#include "debugger.h"
+#include "emulator_thread.h"
+#include "headless.h"
+#include "savestate.h"
+#include "terminal_renderer.h"
+#include <chrono>
+#include <cstdlib>
+#include <getopt.h>
+#include <memory>
 #include <ncurses.h>
+#include <unistd.h>
 
 void print_registers(WINDOW *win,chip8 *ch8);
-void print_memory(WINDOW *win, int current_instruction,chip8 *ch8);
+void print_display(WINDOW *win,const unsigned char *pixels);
+int chip8_key(int character);
+void print_stop(debugger *dbg,char *info_string);
+void print_memory(WINDOW *win, int current_instruction,chip8 *ch8,const rom_analysis *analysis);
 
 
 std::vector<u_int16_t> chip8_logo = {
@@ -50,9 +64,148 @@ std::vector<u_int16_t> chip8_logo = {
 0x2a2a, 0x2b28, 0x2f20, 0x3f00, 0x2a2a, 0xea0a, 0xfa02, 0xfe00,
 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000};
 
-int main() {
+void usage(const char *name){
+    std::cerr << "usage: " << name << " [options] [rom]" << std::endl
+              << "  --shm NAME      export the framebuffer to the shared memory segment /NAME" << std::endl
+              << "  --headless      run without a terminal as fast as possible and print a summary" << std::endl
+              << "  --frames N      number of frames to run headless (default 600)" << std::endl
+              << "  --no-halt       run all frames, even after the ROM halted" << std::endl
+              << "  --capture FILE  record the headless run to FILE (.y4m or .ppm)" << std::endl
+              << "  --scale N       enlarge every captured pixel to NxN" << std::endl
+              << "  --wav FILE      write the sound to FILE" << std::endl
+              << "  --profile FILE  profile the subroutines of the headless run, FILE gets collapsed stacks" << std::endl
+              << "  --load-state F  restore the savestate F after loading the ROM" << std::endl
+              << "  --save-state F  write a savestate to F after the headless run" << std::endl
+              << "  --run-ahead N   show frames emulated N frames ahead to hide input latency" << std::endl
+              << "  --render MODE   draw the display with curses (default), half (1x2 pixels per cell) or braille (2x4)"
+              << std::endl
+              << "                  half and braille only send the changed cells. Headless they report the bytes"
+              << std::endl
+              << "  --perf          count instructions, branch and cache misses of the headless run" << std::endl
+              << "  --frame-cache MB" << std::endl
+              << "                  memoize the frames of the headless run in a cache of MB megabytes" << std::endl
+              << "  --verify-cache N" << std::endl
+              << "                  emulate every Nth hit of the frame cache anyway and compare" << std::endl
+              << "  --metrics FILE  keep FILE updated with Prometheus metrics of the emulation, every second" << std::endl
+              << "  --vip           run as fast as a COSMAC VIP instead of a fixed number of instructions per frame" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    static const option options[] = {
+            {"shm",required_argument,nullptr,'s'},
+            {"headless",no_argument,nullptr,'H'},
+            {"frames",required_argument,nullptr,'n'},
+            {"capture",required_argument,nullptr,'o'},
+            {"scale",required_argument,nullptr,'x'},
+            {"wav",required_argument,nullptr,'w'},
+            {"vip",no_argument,nullptr,'v'},
+            {"run-ahead",required_argument,nullptr,'a'},
+            {"profile",required_argument,nullptr,'p'},
+            {"load-state",required_argument,nullptr,'l'},
+            {"save-state",required_argument,nullptr,'S'},
+            {"render",required_argument,nullptr,'r'},
+            {"perf",no_argument,nullptr,'P'},
+            {"metrics",required_argument,nullptr,'m'},
+            {"no-halt",no_argument,nullptr,'N'},
+            {"frame-cache",required_argument,nullptr,'c'},
+            {"verify-cache",required_argument,nullptr,'V'},
+            {"help",no_argument,nullptr,'h'},
+            {nullptr,0,nullptr,0}
+    };
+    std::string shm_name;
+    bool headless = false;
+    headless_options headless_opts;
+    bool vip_timing = false;
+    std::string state_path;
+    int opt;
+    while((opt = getopt_long(argc,argv,"h",options,nullptr)) != -1){
+        switch (opt){
+            case 's':
+                shm_name = optarg[0] == '/' ? optarg : std::string("/")+optarg;
+                break;
+            case 'H':
+                headless = true;
+                break;
+            case 'n':
+                headless_opts.frames = std::strtoull(optarg,nullptr,0);
+                break;
+            case 'o':
+                headless_opts.capture_path = optarg;
+                break;
+            case 'x':
+                headless_opts.capture_scale = std::atoi(optarg);
+                break;
+            case 'w':
+                headless_opts.wav_path = optarg;
+                break;
+            case 'v':
+                vip_timing = true;
+                break;
+            case 'a':
+                headless_opts.run_ahead_frames = std::strtoul(optarg,nullptr,0);
+                break;
+            case 'p':
+                headless_opts.profile_path = optarg;
+                break;
+            case 'l':
+                state_path = optarg;
+                break;
+            case 'S':
+                headless_opts.save_state_path = optarg;
+                break;
+            case 'P':
+                headless_opts.perf = true;
+                break;
+            case 'm':
+                headless_opts.metrics_path = optarg;
+                break;
+            case 'N':
+                headless_opts.stop_on_halt = false;
+                break;
+            case 'c':
+                headless_opts.frame_cache_bytes = (size_t)(std::strtod(optarg,nullptr)*(1 << 20));
+                break;
+            case 'V':
+                headless_opts.frame_cache_verify = std::strtoul(optarg,nullptr,0);
+                break;
+            case 'r':
+                if(std::string(optarg) == "half" || std::string(optarg) == "braille"){
+                    headless_opts.render_cells = true;
+                    headless_opts.terminal_mode = optarg[0] == 'h' ? terminal_renderer::half_block :
+                                                  terminal_renderer::braille;
+                }else if(std::string(optarg) != "curses"){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
     chip8 ch8;
-    ch8.load_program(chip8_logo);
+    // without a ROM the chip-8 logo is shown
+    if(optind < argc){
+        if(!ch8.load_file(argv[optind])){
+            std::cerr << ch8.info_string << std::endl;
+            return 1;
+        }
+    } else {
+        ch8.load_program(chip8_logo);
+    }
+    if(vip_timing)
+        ch8.timing = chip8::cosmac_vip;
+    // the savestate includes the timing model, so it overrides --vip
+    if(!state_path.empty() && !load_savestate(ch8,state_path)){
+        std::cerr << ch8.info_string << std::endl;
+        return 1;
+    }
+    if(headless)
+        return run_headless(ch8,headless_opts);
+
+    // the analysis of the ROM tells the memory listing which bytes are instructions
+    std::shared_ptr<const rom_analysis> analysis = analyze_rom(&ch8.memory[0x200],ch8.program_size);
 
     WINDOW *registers_window;
     WINDOW *memory_window;
@@ -68,7 +221,12 @@ int main() {
     init_pair(2,COLOR_RED,COLOR_BLACK);
     refresh();
 
-    game_window = newwin(32,64,0,0);
+    // draws inside the border of game_window, which curses does not refresh again
+    std::unique_ptr<terminal_renderer> renderer;
+    if(headless_opts.render_cells)
+        renderer.reset(new terminal_renderer(headless_opts.terminal_mode,chip8::width,chip8::height,2,2));
+
+    game_window = renderer ? newwin(renderer->rows()+2,renderer->columns()+2,0,0) : newwin(32,64,0,0);
     wattron(game_window,COLOR_PAIR(2));
     box(game_window,0,0);
     wrefresh(game_window);
@@ -76,7 +234,7 @@ int main() {
 
     memory_window = newwin(32,33,0,65);
     wrefresh(memory_window);
-    print_memory(memory_window,ch8.PC,&ch8);
+    print_memory(memory_window,ch8.PC,&ch8,analysis.get());
 
     registers_window = newwin(16,33,33,65);
     wrefresh(registers_window);
@@ -85,14 +243,110 @@ int main() {
     info_window = newwin(16,64,33,0);
     wrefresh(info_window);
 
+    auto show = [&](const unsigned char *pixels){
+        if(renderer)
+            renderer->present(STDOUT_FILENO,pixels);
+        else
+            print_display(game_window,pixels);
+    };
+
+
+    debugger dbg(ch8);
+    emulator_thread emulator(ch8);
+    emulator.set_run_ahead(headless_opts.run_ahead_frames);
+
+    metrics_registry registry;
+    if(!headless_opts.metrics_path.empty())
+        emulator.set_metrics(&registry.add("emulator"));
+    auto next_export = std::chrono::steady_clock::now();
+
+    shm_writer exporter;
+    if(!shm_name.empty()){
+        if(!exporter.open(shm_name)){
+            endwin();
+            std::cerr << "can not create shared memory segment " << shm_name << std::endl;
+            return 1;
+        }
+        emulator.set_export(&exporter);
+    }
+
+    wav_writer wav;
+    audio_stream audio;
+    if(!headless_opts.wav_path.empty()){
+        if(!wav.open(headless_opts.wav_path,audio.generator().sample_rate())){
+            endwin();
+            std::cerr << "can not create " << headless_opts.wav_path << std::endl;
+            return 1;
+        }
+        audio.set_wav(&wav);
+        emulator.set_audio(&audio);
+    }
+
+    // terminals only report key presses. A key counts as held until it was not repeated for a while
+    const std::chrono::milliseconds key_hold(150);
+    std::chrono::steady_clock::time_point key_released[16];
+    bool key_held[16] {false};
 
     int character = 0;
     bool debugging = true;
+    bool step = true;
     while (true){
-        ch8.cycle();
+        if(!debugging){
+            // the emulation runs on its own thread, this thread only forwards keys and presents the latest frame
+            character = getch();
+            if(character == 27 || character == 'p'){
+                emulator.stop();
+                debugging = true;
+                step = false;
+                if(character == 27) //quit when pressing ESCAPE
+                    break;
+                continue;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            int k = chip8_key(character);
+            if(k >= 0){
+                if(!key_held[k])
+                    key_held[k] = emulator.send_key(k,true);
+                key_released[k] = now+key_hold;
+            }
+            for(k = 0; k < 16; ++k){
+                if(key_held[k] && now > key_released[k] && emulator.send_key(k,false))
+                    key_held[k] = false;
+            }
+
+            if(!headless_opts.metrics_path.empty() && now >= next_export){
+                registry.write_file(headless_opts.metrics_path);
+                next_export = now+std::chrono::seconds(1);
+            }
+
+            if(emulator.update_frame()){
+                show(emulator.latest_frame().pixels);
+                mvwprintw(info_window,0,0,"frame %llu",(unsigned long long)emulator.latest_frame().number);
+                wclrtoeol(info_window);
+                wrefresh(info_window);
+            }
+
+            // the debugger stopped the emulation
+            if(!emulator.running()){
+                emulator.stop();
+                for(k = 0; k < 16; ++k)
+                    key_held[k] = ch8.key[k] = false;
+                debugging = true;
+                step = false;
+                timeout(-1);
+            }
+            continue;
+        }
+
+        if(step)
+            ch8.cycle();
+        show(ch8.framebuffer());
         print_registers(registers_window,&ch8);
-        print_memory(memory_window,ch8.PC,&ch8);
+        print_memory(memory_window,ch8.PC,&ch8,analysis.get());
+        print_stop(&dbg,ch8.info_string);
         mvwprintw(info_window,0,0,"%s",ch8.info_string);
+        wclrtoeol(info_window);
         wrefresh(info_window);
         sprintf(ch8.info_string," "); //clear the infostring
 
@@ -101,6 +355,28 @@ int main() {
             character = getch();
             if(character == 27) //quit when pressing ESCAPE
                 break;
+
+            step = true;
+            if(character == 'b'){
+                // toggle a breakpoint at the current instruction
+                if(dbg.has_breakpoint(ch8.PC))
+                    dbg.remove_breakpoint(ch8.PC);
+                else
+                    dbg.add_breakpoint(ch8.PC);
+                sprintf(ch8.info_string,"breakpoint at 0x%03X %s",ch8.PC,dbg.has_breakpoint(ch8.PC) ? "set" : "removed");
+                step = false;
+            } else if(character == 'c' || character == 'f'){
+                // continue on the emulation thread until a breakpoint or watchpoint is hit or 'p' is pressed.
+                // 'f' runs as fast as possible instead of 60 frames per second
+                dbg.resume();
+                emulator.set_turbo(character == 'f');
+                emulator.start();
+                timeout(5);
+                debugging = false;
+            } else {
+                // a stopped instruction is executed by the next step
+                dbg.resume();
+            }
         }
     }
 
@@ -117,6 +393,14 @@ void print_registers(WINDOW *win,chip8 *ch8){
     mvwprintw(win,0,15,"DT = 0x%X",ch8->delay_timer);
     mvwprintw(win,1,15,"ST = 0x%X",ch8->sound_timer);
     mvwprintw(win,3,15,"OP = 0x%04X",ch8->opcode);
+    mvwprintw(win,4,15,"SP = %d",ch8->SP);
+    // the innermost return addresses
+    for(int i = 0; i < 8; ++i){
+        if(i < ch8->SP)
+            mvwprintw(win,5+i,15,"   0x%03X",ch8->stack_entry(ch8->SP-1-i));
+        else
+            mvwprintw(win,5+i,15,"        ");
+    }
 
     /*
     // print second column
@@ -127,21 +411,82 @@ void print_registers(WINDOW *win,chip8 *ch8){
     wrefresh(win);
 }
 
-void print_memory(WINDOW *win,int current_instruction,chip8 *ch8){
+void print_memory(WINDOW *win,int current_instruction,chip8 *ch8,const rom_analysis *analysis){
     int i = std::max(current_instruction-2,0);
     int to = std::min(0x1000,i+64);
     //std::cout << "DATA: " << i << "   " << to << "----" << current_instruction << std::endl;
     int y = 0;
+    char mnemonic[16];
     for(; i < to; i+=2){
         if(i == current_instruction)
             wattron(win,A_REVERSE);
+        unsigned short opcode = (ch8->memory[i]<<8)|ch8->memory[i+1];
+        // only code reached by the analyzer is disassembled, everything else is shown as raw data
+        if(analysis->is_code(i) || i == current_instruction)
+            disassemble(opcode,mnemonic,sizeof(mnemonic));
+        else
+            snprintf(mnemonic,sizeof(mnemonic),"data");
         if(i%2 == 0)
-            mvwprintw(win,y,0,"0x%X - 0x%04X      ????",i,(ch8->memory[i]<<8)|ch8->memory[i+1]);
+            mvwprintw(win,y,0,"0x%X - 0x%04X  %-13s",i,opcode,mnemonic);
         else
-            mvwprintw(win,y,0,"0x%X - 0x%04X       ????",i,(ch8->memory[i]<<8)|ch8->memory[i+1]);
+            mvwprintw(win,y,0,"0x%X - 0x%04X   %-12s",i,opcode,mnemonic);
         y++;
         if(i == current_instruction)
             wattroff(win,A_REVERSE);
     }
     wrefresh(win);
 }
+
+void print_stop(debugger *dbg,char *info_string){
+    switch (dbg->reason()){
+        case debugger::breakpoint:
+            sprintf(info_string,"breakpoint at 0x%03X",dbg->stop_pc());
+            break;
+        case debugger::condition:
+            sprintf(info_string,"condition true at 0x%03X",dbg->stop_pc());
+            break;
+        case debugger::read:
+            sprintf(info_string,"0x%03X reads watched memory at 0x%03X",dbg->stop_pc(),dbg->stop_address());
+            break;
+        case debugger::write:
+            sprintf(info_string,"0x%03X writes watched memory at 0x%03X",dbg->stop_pc(),dbg->stop_address());
+            break;
+        default:
+            break;
+    }
+}
+
+void print_display(WINDOW *win,const unsigned char *pixels){
+    for(int y = 0; y < chip8::height; ++y){
+        for(int x = 0; x < chip8::width; ++x)
+            mvwaddch(win,y,x,pixels[y*chip8::width+x] ? ' '|A_REVERSE : ' ');
+    }
+    wrefresh(win);
+}
+
+int chip8_key(int character){
+    // the hexadecimal keyboard of the COSMAC VIP is mapped to the left side of a qwerty keyboard
+    //  1 2 3 C      1 2 3 4
+    //  4 5 6 D  ->  q w e r
+    //  7 8 9 E      a s d f
+    //  A 0 B F      z x c v
+    switch (character){
+        case 'x': return 0x0;
+        case '1': return 0x1;
+        case '2': return 0x2;
+        case '3': return 0x3;
+        case 'q': return 0x4;
+        case 'w': return 0x5;
+        case 'e': return 0x6;
+        case 'a': return 0x7;
+        case 's': return 0x8;
+        case 'd': return 0x9;
+        case 'z': return 0xA;
+        case 'c': return 0xB;
+        case '4': return 0xC;
+        case 'r': return 0xD;
+        case 'f': return 0xE;
+        case 'v': return 0xF;
+        default: return -1;
+    }
+}
@@ -0,0 +1,148 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "metrics.h"
+#include "file_io.h"
+#include <cstdio>
+
+const double thread_metrics::bucket_bounds[thread_metrics::buckets] = {
+        // a frame of a busy server takes about a microsecond, one with idle waits or a slow host up to a frame
+        0.000001, 0.00001, 0.0001, 0.001, 0.005, 0.01, 1.0/60, 0.05, 0.1
+};
+
+void thread_metrics::record_frames(uint64_t count, uint64_t instructions, uint64_t unknown,
+                                   std::chrono::nanoseconds time) {
+    if(count == 0)
+        return;
+    frames.add(count);
+    this->instructions.add(instructions);
+    if(unknown != 0)
+        unknown_opcodes.add(unknown);
+    frame_time_ns.add(time.count());
+    double seconds = time.count()/1e9/count;
+    int bucket = 0;
+    while(bucket < buckets && seconds > bucket_bounds[bucket])
+        ++bucket;
+    frame_time_buckets[bucket].add(count);
+}
+
+thread_metrics &metrics_registry::add(const std::string &thread) {
+    std::lock_guard<std::mutex> lock(mutex);
+    threads.emplace_back(new thread_metrics(thread));
+    return *threads.back();
+}
+
+namespace {
+    void header(std::string &out, const char *name, const char *type, const char *help){
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += '\n';
+    }
+
+    void sample(std::string &out, const char *name, const std::string &thread, const char *le, const char *value){
+        char line[256];
+        if(le != nullptr)
+            std::snprintf(line,sizeof(line),"%s{thread=\"%s\",le=\"%s\"} %s\n",name,thread.c_str(),le,value);
+        else
+            std::snprintf(line,sizeof(line),"%s{thread=\"%s\"} %s\n",name,thread.c_str(),value);
+        out += line;
+    }
+
+    // counters are printed exactly, %g would round them once they pass 10 digits
+    void sample(std::string &out, const char *name, const std::string &thread, const char *le, uint64_t value){
+        char text[32];
+        std::snprintf(text,sizeof(text),"%llu",(unsigned long long)value);
+        sample(out,name,thread,le,text);
+    }
+
+    // gauges and sums
+    void sample(std::string &out, const char *name, const std::string &thread, const char *le, double value){
+        char text[32];
+        std::snprintf(text,sizeof(text),"%.10g",value);
+        sample(out,name,thread,le,text);
+    }
+}
+
+std::string metrics_registry::prometheus_text() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> since = now-last_export;
+    last_export = now;
+    last_instructions.resize(threads.size(),0);
+
+    struct counter {
+        const char *name;
+        const char *help;
+        metric_counter thread_metrics::*member;
+    };
+    static const counter counters[] = {
+            {"chip8_instructions_total","Instructions executed.",&thread_metrics::instructions},
+            {"chip8_frames_total","60Hz frames emulated.",&thread_metrics::frames},
+            {"chip8_idle_instructions_total","Instructions skipped because the machine was idle.",
+             &thread_metrics::idle_instructions},
+            {"chip8_unknown_opcodes_total","Unknown opcodes executed.",&thread_metrics::unknown_opcodes}
+    };
+
+    std::string out;
+    for(const counter &c : counters){
+        header(out,c.name,"counter",c.help);
+        for(const auto &t : threads)
+            sample(out,c.name,t->thread,nullptr,((*t).*c.member).get());
+    }
+
+    header(out,"chip8_instructions_per_second","gauge","Instructions executed per second since the last export.");
+    for(size_t i = 0; i < threads.size(); ++i){
+        uint64_t instructions = threads[i]->instructions.get();
+        double rate = since.count() <= 0 ? 0 : (instructions-last_instructions[i])/since.count();
+        last_instructions[i] = instructions;
+        sample(out,"chip8_instructions_per_second",threads[i]->thread,nullptr,rate);
+    }
+
+    header(out,"chip8_frame_seconds","histogram","Time to emulate a frame.");
+    for(const auto &t : threads){
+        uint64_t cumulative = 0;
+        char le[32];
+        for(int b = 0; b < thread_metrics::buckets; ++b){
+            cumulative += t->frame_time_buckets[b].get();
+            std::snprintf(le,sizeof(le),"%g",thread_metrics::bucket_bounds[b]);
+            sample(out,"chip8_frame_seconds_bucket",t->thread,le,cumulative);
+        }
+        cumulative += t->frame_time_buckets[thread_metrics::buckets].get();
+        sample(out,"chip8_frame_seconds_bucket",t->thread,"+Inf",cumulative);
+        sample(out,"chip8_frame_seconds_sum",t->thread,nullptr,t->frame_time_ns.get()/1e9);
+        sample(out,"chip8_frame_seconds_count",t->thread,nullptr,cumulative);
+    }
+    return out;
+}
+
+bool metrics_registry::write_file(const std::string &path) {
+    std::string text = prometheus_text();
+    return replace_file(path,std::vector<unsigned char>(text.begin(),text.end()));
+}
@@ -0,0 +1,103 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_METRICS_H
+#define CHIP_8_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A counter which exactly one thread increments and any thread reads. The increment is a relaxed load and store,
+// not a locked read-modify-write, so it costs as much as incrementing a plain integer
+class metric_counter {
+public:
+    void add(uint64_t n){
+        value.store(value.load(std::memory_order_relaxed)+n,std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value {0};
+};
+
+// The counters of one emulating thread. They are fed once per frame, or once per batch of frames, and never from
+// chip8::cycle(), which only bumps the plain counters of chip8 itself
+struct thread_metrics {
+    // upper bounds of the frame time buckets in seconds, the last bucket is unbounded
+    static const int buckets = 9;
+    static const double bucket_bounds[buckets];
+
+    explicit thread_metrics(const std::string &thread) : thread(thread) {}
+
+    // frames were emulated in time. The histogram gets their average time
+    void record_frames(uint64_t count, uint64_t instructions, uint64_t unknown, std::chrono::nanoseconds time);
+
+    // instructions which were not emulated because the machine was idle
+    void record_idle(uint64_t instructions){
+        idle_instructions.add(instructions);
+    }
+
+    const std::string thread;
+    metric_counter instructions;
+    metric_counter frames;
+    metric_counter idle_instructions;
+    metric_counter unknown_opcodes;
+    metric_counter frame_time_ns;
+    metric_counter frame_time_buckets[buckets+1];
+};
+
+// Collects the metrics of all threads and exports them in the Prometheus text format, e.g. for the textfile collector
+// of the node exporter. Registering is thread safe, the threads then update their own metrics without locks
+class metrics_registry {
+public:
+    metrics_registry() : last_export(std::chrono::steady_clock::now()) {}
+
+    // the returned metrics live as long as the registry
+    thread_metrics &add(const std::string &thread);
+
+    // the Prometheus text of all metrics. The instructions per second are measured since the previous call or the
+    // construction of the registry
+    std::string prometheus_text();
+
+    // writes the text to a temporary file and renames it to path, so a reader never sees a partial file. Returns
+    // false on I/O errors
+    bool write_file(const std::string &path);
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<thread_metrics>> threads;
+    // instructions of every thread at the previous export
+    std::vector<uint64_t> last_instructions;
+    std::chrono::steady_clock::time_point last_export;
+};
+
+#endif //CHIP_8_METRICS_H
@@ -0,0 +1,130 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "chip8.h"
+#include "perf_counters.h"
+#include "rom_pack.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+// chip8_multi_bench [--vms N] [--frames N] [--perf] rom|--pack PACK
+// steps many VMs round robin, one frame each, like a server which hosts thousands of them, and reports the throughput.
+// With a pack the VMs run its ROMs in turn
+int main(int argc, char **argv) {
+    static const option options[] = {
+            {"vms",required_argument,nullptr,'v'},
+            {"frames",required_argument,nullptr,'f'},
+            {"pack",required_argument,nullptr,'p'},
+            {"perf",no_argument,nullptr,'P'},
+            {"help",no_argument,nullptr,'h'},
+            {nullptr,0,nullptr,0}
+    };
+    unsigned long vm_count = 4096;
+    unsigned long frames = 200;
+    const char *pack_path = nullptr;
+    bool perf = false;
+    int opt;
+    while((opt = getopt_long(argc,argv,"h",options,nullptr)) != -1){
+        switch (opt){
+            case 'v': vm_count = std::strtoul(optarg,nullptr,0); break;
+            case 'f': frames = std::strtoul(optarg,nullptr,0); break;
+            case 'p': pack_path = optarg; break;
+            case 'P': perf = true; break;
+            default:
+                std::fprintf(stderr,"usage: %s [--vms N] [--frames N] [--perf] rom|--pack PACK\n",argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if((optind >= argc && pack_path == nullptr) || vm_count == 0){
+        std::fprintf(stderr,"usage: %s [--vms N] [--frames N] [--perf] rom|--pack PACK\n",argv[0]);
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    rom_pack pack;
+    std::vector<unsigned char> rom;
+    if(pack_path != nullptr){
+        if(!pack.open(pack_path)){
+            std::fprintf(stderr,"%s\n",pack.error().c_str());
+            return 1;
+        }
+        if(pack.size() == 0){
+            std::fprintf(stderr,"%s is empty\n",pack_path);
+            return 1;
+        }
+    }else{
+        std::ifstream file(argv[optind],std::ios::binary);
+        rom.assign(std::istreambuf_iterator<char>(file),std::istreambuf_iterator<char>());
+        if(!file.is_open() || rom.empty()){
+            std::fprintf(stderr,"can not read %s\n",argv[optind]);
+            return 1;
+        }
+    }
+
+    std::vector<std::unique_ptr<chip8>> vms;
+    vms.reserve(vm_count);
+    for(unsigned long i = 0; i < vm_count; ++i){
+        vms.emplace_back(new chip8);
+        vms.back()->seed(i);
+        if(pack_path == nullptr)
+            vms.back()->load_program(rom.data(),rom.size());
+        else if(!pack.load(i % pack.size(),*vms.back())){
+            std::fprintf(stderr,"%s\n",vms.back()->info_string);
+            return 1;
+        }
+    }
+    std::chrono::duration<double> setup = std::chrono::steady_clock::now()-start;
+
+    std::unique_ptr<perf_counters> counters;
+    if(perf)
+        counters.reset(new perf_counters);
+    if(counters)
+        counters->start();
+    start = std::chrono::steady_clock::now();
+    for(unsigned long frame = 0; frame < frames; ++frame)
+        for(auto &vm : vms)
+            vm->run_frame();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+    perf_counters::sample sample;
+    if(counters)
+        sample = counters->stop();
+
+    uint64_t check = 0;
+    for(auto &vm : vms)
+        check += vm->digest();
+    double vm_frames = (double)vm_count*frames;
+    std::printf("sizeof(chip8) %zu bytes, %.1f MB for %lu VMs\n",sizeof(chip8),sizeof(chip8)*vm_count/1e6,vm_count);
+    std::printf("setup         %.3fs (%.0f VMs/s)\n",setup.count(),vm_count/setup.count());
+    std::printf("run           %.3fs, %.2f M VM frames/s, %.1f M instructions/s\n",elapsed.count(),
+                vm_frames/elapsed.count()/1e6,vm_frames*vms[0]->instructions_per_frame/elapsed.count()/1e6);
+    std::printf("digest        0x%016llx\n",(unsigned long long)check);
+    if(counters)
+        std::fputs(perf_report(sample,vm_frames*vms[0]->instructions_per_frame).c_str(),stdout);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "rom_pack.h"
+#include <chrono>
+#include <cstdio>
+#include <getopt.h>
+#include <string>
+#include <vector>
+
+namespace {
+    void print_flags(uint16_t flags){
+        static const char *names[] = {"schip","unknown","shift","load-store","jump","logic","random","input"};
+        bool first = true;
+        for(int bit = 0; bit < 8; ++bit)
+            if(flags & (1 << bit)){
+                std::printf("%s%s",first ? "" : ",",names[bit]);
+                first = false;
+            }
+        if(first)
+            std::printf("-");
+    }
+
+    int list(const char *path){
+        rom_pack pack;
+        if(!pack.open(path)){
+            std::fprintf(stderr,"%s\n",pack.error().c_str());
+            return 1;
+        }
+        std::printf("hash                size  code  data  copies  flags  name\n");
+        for(size_t i = 0; i < pack.size(); ++i){
+            rom_pack::rom r = pack.at(i);
+            std::printf("%016llx  %4u  %4u  %4u  %6u  ",(unsigned long long)r.metadata.hash,r.size,
+                        r.metadata.code_bytes,r.metadata.data_bytes,r.duplicates+1);
+            print_flags(r.metadata.flags);
+            std::printf("  %s\n",r.name);
+        }
+        return 0;
+    }
+
+    void usage(const char *name){
+        std::fprintf(stderr,"usage: %s --output PACK file|directory...\n       %s --list PACK\n",name,name);
+    }
+}
+
+// chip8_pack --output PACK file|directory...
+// ingests a ROM corpus into one pack file, see rom_pack.h. Directories are searched recursively
+int main(int argc, char **argv) {
+    static const option options[] = {
+            {"output",required_argument,nullptr,'o'},
+            {"list",required_argument,nullptr,'l'},
+            {"help",no_argument,nullptr,'h'},
+            {nullptr,0,nullptr,0}
+    };
+    std::string output;
+    int opt;
+    while((opt = getopt_long(argc,argv,"h",options,nullptr)) != -1){
+        switch (opt){
+            case 'o': output = optarg; break;
+            case 'l': return list(optarg);
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(output.empty() || optind >= argc){
+        usage(argv[0]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> files;
+    for(int i = optind; i < argc; ++i)
+        collect_files(argv[i],files);
+
+    rom_pack_builder builder;
+    unsigned long counts[5] = {0};
+    unsigned long unreadable = 0;
+    for(const std::string &file : files){
+        rom_pack_builder::result outcome;
+        std::string error;
+        if(!builder.add_file(file,outcome,error)){
+            std::fprintf(stderr,"%s\n",error.c_str());
+            ++unreadable;
+            continue;
+        }
+        if(outcome == rom_pack_builder::too_large)
+            std::fprintf(stderr,"%s is larger than 0xE00 bytes\n",file.c_str());
+        else if(outcome == rom_pack_builder::collision)
+            std::fprintf(stderr,"%s has the hash of another ROM\n",file.c_str());
+        counts[outcome]++;
+    }
+    if(!builder.write(output)){
+        std::fprintf(stderr,"writing %s failed\n",output.c_str());
+        return 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+    std::printf("files      %zu\n",files.size());
+    std::printf("added      %lu\n",counts[rom_pack_builder::added]);
+    std::printf("duplicates %lu\n",counts[rom_pack_builder::duplicate]);
+    std::printf("rejected   %lu (%lu empty, %lu too large, %lu collisions, %lu unreadable)\n",
+                counts[rom_pack_builder::empty]+counts[rom_pack_builder::too_large]+
+                counts[rom_pack_builder::collision]+unreadable,counts[rom_pack_builder::empty],
+                counts[rom_pack_builder::too_large],counts[rom_pack_builder::collision],unreadable);
+    std::printf("time       %.3fs\n",elapsed.count());
+    return 0;
+}
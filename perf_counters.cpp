@@ -0,0 +1,148 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "perf_counters.h"
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    // value, time enabled and time running, see PERF_FORMAT_TOTAL_TIME_ENABLED
+    struct reading {
+        uint64_t value;
+        uint64_t enabled;
+        uint64_t running;
+    };
+
+    int open_counter(uint32_t type, uint64_t config){
+        perf_event_attr attr;
+        std::memset(&attr,0,sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        // user space only, which perf_event_paranoid 2 still allows
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return (int)syscall(SYS_perf_event_open,&attr,0,-1,-1,0);
+    }
+
+    uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result){
+        return cache | op << 8 | result << 16;
+    }
+}
+
+perf_counters::perf_counters() {
+    fds[instructions] = open_counter(PERF_TYPE_HARDWARE,PERF_COUNT_HW_INSTRUCTIONS);
+    fds[cycles] = open_counter(PERF_TYPE_HARDWARE,PERF_COUNT_HW_CPU_CYCLES);
+    fds[branch_misses] = open_counter(PERF_TYPE_HARDWARE,PERF_COUNT_HW_BRANCH_MISSES);
+    fds[l1d_misses] = open_counter(PERF_TYPE_HW_CACHE,cache_event(PERF_COUNT_HW_CACHE_L1D,PERF_COUNT_HW_CACHE_OP_READ,
+                                                                  PERF_COUNT_HW_CACHE_RESULT_MISS));
+    fds[llc_misses] = open_counter(PERF_TYPE_HARDWARE,PERF_COUNT_HW_CACHE_MISSES);
+}
+
+perf_counters::~perf_counters() {
+    for(int fd : fds)
+        if(fd >= 0)
+            close(fd);
+}
+
+bool perf_counters::available() const {
+    for(int fd : fds)
+        if(fd >= 0)
+            return true;
+    return false;
+}
+
+void perf_counters::start() {
+    for(int fd : fds)
+        if(fd >= 0){
+            ioctl(fd,PERF_EVENT_IOC_RESET,0);
+            ioctl(fd,PERF_EVENT_IOC_ENABLE,0);
+        }
+    started = std::chrono::steady_clock::now();
+}
+
+perf_counters::sample perf_counters::stop() {
+    sample s;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-started;
+    s.seconds = elapsed.count();
+    for(int c = 0; c < counter_count; ++c){
+        if(fds[c] < 0)
+            continue;
+        ioctl(fds[c],PERF_EVENT_IOC_DISABLE,0);
+        reading r;
+        if(read(fds[c],&r,sizeof(r)) != (ssize_t)sizeof(r) || r.running == 0)
+            continue;
+        s.valid[c] = true;
+        s.value[c] = r.running < r.enabled ? (double)r.value*r.enabled/r.running : (double)r.value;
+    }
+    return s;
+}
+
+const char *perf_counters::name(counter c) {
+    switch(c){
+        case instructions: return "instructions";
+        case cycles: return "cycles";
+        case branch_misses: return "branch misses";
+        case l1d_misses: return "L1d misses";
+        case llc_misses: return "LLC misses";
+        default: return "?";
+    }
+}
+
+std::string perf_report(const perf_counters::sample &sample, double emulated_instructions) {
+    std::string report;
+    char line[160];
+    bool any = false;
+    for(int c = 0; c < perf_counters::counter_count; ++c){
+        if(!sample.valid[c])
+            continue;
+        any = true;
+        int n = std::snprintf(line,sizeof(line),"perf         %-14s %16.0f",
+                              perf_counters::name((perf_counters::counter)c),sample.value[c]);
+        if(emulated_instructions > 0)
+            n += std::snprintf(line+n,sizeof(line)-n,"  %10.3f per emulated instruction",
+                               sample.value[c]/emulated_instructions);
+        if(c == perf_counters::cycles && sample.valid[perf_counters::instructions] && sample.value[c] > 0)
+            n += std::snprintf(line+n,sizeof(line)-n,"  IPC %.2f",sample.value[perf_counters::instructions]/
+                                                                sample.value[c]);
+        report.append(line,n);
+        report += '\n';
+    }
+    if(!any)
+        report += "perf         hardware counters are not available, wall clock only\n";
+    int n = std::snprintf(line,sizeof(line),"perf         %-14s %16.6fs","time",sample.seconds);
+    if(emulated_instructions > 0)
+        n += std::snprintf(line+n,sizeof(line)-n,"  %10.3f ns per emulated instruction",
+                           sample.seconds*1e9/emulated_instructions);
+    report.append(line,n);
+    report += '\n';
+    return report;
+}
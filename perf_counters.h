@@ -0,0 +1,79 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_PERF_COUNTERS_H
+#define CHIP_8_PERF_COUNTERS_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Counts hardware events of this process with perf_event_open while a run or a benchmark is measured, to tell whether
+// a slowdown comes from the instructions executed, branch mispredictions or cache misses. Each counter is opened on
+// its own, so a CPU or a virtual machine which lacks some events still reports the others. If the kernel refuses all
+// of them (no PMU, perf_event_paranoid, seccomp) only the wall clock time is measured. Threads which are created
+// after the counters were opened are included. The values are scaled if the kernel had to multiplex the counters.
+class perf_counters {
+public:
+    enum counter {
+        instructions,
+        cycles,
+        branch_misses,
+        l1d_misses,
+        llc_misses,
+        counter_count
+    };
+
+    struct sample {
+        double seconds {0};
+        bool valid[counter_count] {false};
+        double value[counter_count] {0};
+    };
+
+    perf_counters();
+    perf_counters(const perf_counters &) = delete;
+    perf_counters &operator=(const perf_counters &) = delete;
+    ~perf_counters();
+
+    // true if at least one hardware counter could be opened
+    bool available() const;
+
+    // resets and starts all counters and the clock
+    void start();
+
+    // stops the counters and returns what happened since start()
+    sample stop();
+
+    static const char *name(counter c);
+
+private:
+    int fds[counter_count];
+    std::chrono::steady_clock::time_point started;
+};
+
+// the report of a measurement, per emulated instruction if their number is not 0. One line per value, each starts
+// with the label "perf"
+std::string perf_report(const perf_counters::sample &sample, double emulated_instructions);
+
+#endif //CHIP_8_PERF_COUNTERS_H
@@ -0,0 +1,114 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "profiler.h"
+#include "chip8.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+
+call_profiler::call_profiler(chip8 &ch8) : ch8(ch8) {
+    reset();
+    ch8.profiler = this;
+}
+
+call_profiler::~call_profiler() {
+    if(ch8.profiler == this)
+        ch8.profiler = nullptr;
+}
+
+void call_profiler::reset() {
+    nodes.assign(1,node{ch8.PC,0,1,0});
+    children.clear();
+    current = 0;
+}
+
+void call_profiler::call(unsigned short address) {
+    uint64_t key = ((uint64_t)current << 16) | address;
+    auto it = children.find(key);
+    if(it == children.end()){
+        it = children.emplace(key,(uint32_t)nodes.size()).first;
+        nodes.push_back(node{address,current,0,0});
+    }
+    current = it->second;
+    ++nodes[current].calls;
+}
+
+void call_profiler::ret() {
+    // a return without a call, e.g. because the profiler was attached inside a subroutine, stays at the root
+    current = nodes[current].parent;
+}
+
+uint64_t call_profiler::total() const {
+    uint64_t sum = 0;
+    for(const node &n : nodes)
+        sum += n.exclusive;
+    return sum;
+}
+
+std::vector<call_profiler::routine> call_profiler::routines() const {
+    // children are always created after their parent, so walking backwards sums the subtrees
+    std::vector<uint64_t> subtree(nodes.size());
+    for(size_t i = nodes.size(); i-- > 0;){
+        subtree[i] += nodes[i].exclusive;
+        if(i != 0)
+            subtree[nodes[i].parent] += subtree[i];
+    }
+
+    std::map<unsigned short,routine> by_address;
+    for(size_t i = 0; i < nodes.size(); ++i){
+        const node &n = nodes[i];
+        routine &r = by_address.emplace(n.address,routine{n.address,0,0,0}).first->second;
+        r.calls += n.calls;
+        r.exclusive += n.exclusive;
+        // a node below another call of the same routine is already part of that call's inclusive cost
+        bool recursive = false;
+        for(uint32_t p = i; p != 0 && !recursive;){
+            p = nodes[p].parent;
+            recursive = nodes[p].address == n.address;
+        }
+        if(!recursive)
+            r.inclusive += subtree[i];
+    }
+
+    std::vector<routine> result;
+    for(const auto &entry : by_address)
+        result.push_back(entry.second);
+    std::sort(result.begin(),result.end(),[](const routine &a, const routine &b){
+        return a.inclusive > b.inclusive;
+    });
+    return result;
+}
+
+void call_profiler::write_collapsed(std::ostream &out) const {
+    std::vector<std::string> paths(nodes.size());
+    char name[8];
+    for(size_t i = 0; i < nodes.size(); ++i){
+        std::snprintf(name,sizeof(name),"0x%03x",nodes[i].address);
+        paths[i] = i == 0 ? name : paths[nodes[i].parent] + ";" + name;
+        if(nodes[i].exclusive > 0)
+            out << paths[i] << ' ' << nodes[i].exclusive << '\n';
+    }
+}
@@ -0,0 +1,89 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_PROFILER_H
+#define CHIP_8_PROFILER_H
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+class chip8;
+
+// Call graph profiler. While it is attached, chip8 reports every executed instruction and every 2NNN and 00EE. Each
+// instruction costs one unit, or its machine cycles with the cosmac_vip timing. The cost is charged to the current
+// node of a call tree, whose nodes are the distinct call paths from the program start. From the tree follow the
+// inclusive and exclusive cost of every subroutine and collapsed stacks, which flamegraph.pl and speedscope read.
+class call_profiler {
+public:
+    struct routine {
+        // entry address, the program start for the code outside of subroutines
+        unsigned short address;
+        uint64_t calls;
+        // cost of the routine itself
+        uint64_t exclusive;
+        // cost of the routine and everything it calls. Recursive calls are only counted once
+        uint64_t inclusive;
+    };
+
+    // attaches to ch8. The root of the call tree is the current PC
+    explicit call_profiler(chip8 &ch8);
+    ~call_profiler();
+    call_profiler(const call_profiler &) = delete;
+    call_profiler &operator=(const call_profiler &) = delete;
+
+    void count(unsigned int cost){
+        nodes[current].exclusive += cost;
+    }
+    void call(unsigned short address);
+    void ret();
+
+    // forgets everything that was measured
+    void reset();
+
+    uint64_t total() const;
+
+    // one entry per subroutine, sorted by inclusive cost, largest first
+    std::vector<routine> routines() const;
+
+    // one line per call path: the entry addresses from the root, separated by ';', and the exclusive cost
+    void write_collapsed(std::ostream &out) const;
+
+private:
+    struct node {
+        unsigned short address;
+        uint32_t parent;
+        uint64_t calls;
+        uint64_t exclusive;
+    };
+
+    chip8 &ch8;
+    std::vector<node> nodes;
+    // children of every node by (parent << 16) | address
+    std::unordered_map<uint64_t,uint32_t> children;
+    uint32_t current {0};
+};
+
+#endif //CHIP_8_PROFILER_H
@@ -0,0 +1,328 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "recompiler.h"
+#include "analyzer.h"
+#include "chip8.h"
+#include <cstdio>
+#include <map>
+#include <vector>
+
+namespace {
+    std::string hex(unsigned value, int digits){
+        char buffer[16];
+        snprintf(buffer,sizeof(buffer),"0x%0*X",digits,value);
+        return buffer;
+    }
+
+    class block_writer {
+    public:
+        block_writer(const std::string &name, const std::map<unsigned short,size_t> &index, std::ostream &out)
+                : name(name), index(index), out(out) {}
+
+        // pointer to the translated block which starts at addr or nullptr
+        std::string successor(unsigned short addr) const {
+            auto it = index.find(addr&0x0FFF);
+            if(it == index.end())
+                return "nullptr";
+            return "&" + name + "_blocks[" + std::to_string(it->second) + "]";
+        }
+
+        // leaves the block after executed instructions. The last executed instruction was opcode
+        void exit(const std::string &indent, unsigned short opcode, unsigned executed, const std::string &pc,
+                  const std::string &next){
+            out << indent << "ch8.opcode = " << hex(opcode,4) << ";\n";
+            out << indent << "ch8.PC = " << pc << ";\n";
+            out << indent << "executed += " << executed << ";\n";
+            out << indent << "return " << next << ";\n";
+        }
+
+        void exit(const std::string &indent, unsigned short opcode, unsigned executed, unsigned short pc){
+            exit(indent,opcode,executed,hex(pc&0x0FFF,3),successor(pc));
+        }
+
+        // translates the block. memory contains the ROM at 0x200
+        void write(const basic_block &block, const unsigned char *memory){
+            out << "static const aot_block *" << name << "_block_" << hex(block.start,3)
+                << "(chip8 &ch8, unsigned long long &executed){\n";
+            out << "    unsigned char *V = ch8.VF;\n";
+            out << "    (void)V;\n";
+
+            unsigned count = 0;
+            for(unsigned short pc = block.start; pc <= block.end; pc += 2){
+                unsigned short opcode = (memory[pc] << 8) | memory[pc+1];
+                ++count;
+                char mnemonic[16];
+                disassemble(opcode,mnemonic,sizeof(mnemonic));
+                out << "    // " << hex(pc,3) << " " << mnemonic << "\n";
+                if(!instruction(opcode,pc,count))
+                    generic(opcode,pc,count);
+                if(pc < block.end && writes_memory(opcode))
+                    check_rest(opcode,pc,block.end,count);
+            }
+
+            // the block was cut because another block starts after it or the control flow runs into data
+            unsigned short last = (memory[block.end] << 8) | memory[block.end+1];
+            if(!terminates(last))
+                exit("    ",last,count,block.end+2);
+            out << "}\n\n";
+        }
+
+    private:
+        const std::string &name;
+        const std::map<unsigned short,size_t> &index;
+        std::ostream &out;
+
+        static bool terminates(unsigned short opcode){
+            switch (opcode&0xF000){
+                case 0x1000: case 0x2000: case 0x3000: case 0x4000: case 0x5000: case 0x9000: case 0xB000:
+                case 0xE000:
+                    return true;
+                case 0x0000:
+                    return opcode == 0x00EE;
+                default:
+                    return false;
+            }
+        }
+
+        // FX33 and FX55 store to memory. Opcodes which decode() executes are checked as well, so the translation stays
+        // right if decode() learns to write memory
+        bool writes_memory(unsigned short opcode) const {
+            if(terminates(opcode))
+                return false;
+            switch (opcode&0xF000){
+                case 0x6000: case 0x7000: case 0x8000: case 0xA000:
+                    return false;
+                case 0xF000:
+                    switch (opcode&0x00FF){
+                        case 0x07: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x65:
+                            return false;
+                        default:
+                            return true;
+                    }
+                default:
+                    return true;
+            }
+        }
+
+        // leaves the block if the instruction at pc overwrote one of the instructions after it up to end. The
+        // dispatcher then interprets the new code
+        void check_rest(unsigned short opcode, unsigned short pc, unsigned short end, unsigned count){
+            out << "    if(!aot_intact(ch8," << name << "_rom," << hex(pc+2,3) << "," << hex(end+2,3) << ")){\n";
+            exit("        ",opcode,count,hex(pc+2,3),"nullptr");
+            out << "    }\n";
+        }
+
+        // opcodes which are not translated are executed by the interpreter
+        void generic(unsigned short opcode, unsigned short pc, unsigned count){
+            out << "    ch8.PC = " << hex(pc,3) << ";\n";
+            out << "    ch8.opcode = " << hex(opcode,4) << ";\n";
+            out << "    ch8.decode();\n";
+            if(terminates(opcode)){
+                out << "    executed += " << count << ";\n";
+                out << "    return nullptr;\n";
+                return;
+            }
+            // decode() did not continue with the next instruction, e.g. because the opcode is not implemented
+            out << "    if(ch8.PC != " << hex(pc+2,3) << "){\n";
+            out << "        executed += " << count << ";\n";
+            out << "        return nullptr;\n";
+            out << "    }\n";
+        }
+
+        // skip instructions end the block
+        void skip(const std::string &condition, unsigned short opcode, unsigned short pc, unsigned count){
+            out << "    if(" << condition << "){\n";
+            exit("        ",opcode,count,pc+4);
+            out << "    }\n";
+            exit("    ",opcode,count,pc+2);
+        }
+
+        // emits the translation of opcode. Returns false if the opcode has to be executed by the interpreter
+        bool instruction(unsigned short opcode, unsigned short pc, unsigned count){
+            std::string x = "V[" + hex((opcode & 0x0F00) >> 8,1) + "]";
+            std::string y = "V[" + hex((opcode & 0x00F0) >> 4,1) + "]";
+            std::string nn = hex(opcode&0x00FF,2);
+            std::string nnn = hex(opcode&0x0FFF,3);
+            unsigned vX = (opcode & 0x0F00) >> 8;
+
+            switch (opcode&0xF000){
+                case 0x1000:
+                    exit("    ",opcode,count,opcode&0x0FFF);
+                    return true;
+                case 0x3000:
+                    skip(x + " == " + nn,opcode,pc,count);
+                    return true;
+                case 0x4000:
+                    skip(x + " != " + nn,opcode,pc,count);
+                    return true;
+                case 0x5000:
+                    skip(x + " == " + y,opcode,pc,count);
+                    return true;
+                case 0x9000:
+                    skip(x + " != " + y,opcode,pc,count);
+                    return true;
+                case 0x6000:
+                    out << "    " << x << " = " << nn << ";\n";
+                    return true;
+                case 0x7000:
+                    out << "    " << x << " += " << nn << ";\n";
+                    return true;
+                case 0x8000:
+                    switch (opcode&0x000F){
+                        case 0x0: out << "    " << x << " = " << y << ";\n"; return true;
+                        case 0x1: out << "    " << x << " |= " << y << ";\n"; return true;
+                        case 0x2: out << "    " << x << " &= " << y << ";\n"; return true;
+                        case 0x3: out << "    " << x << " ^= " << y << ";\n"; return true;
+                        case 0x4:
+                            out << "    {\n";
+                            out << "        unsigned short sum = " << x << " + " << y << ";\n";
+                            out << "        " << x << " = sum;\n";
+                            out << "        V[0xF] = (sum & 0x100)>>8;\n";
+                            out << "    }\n";
+                            return true;
+                        case 0x5:
+                            out << "    {\n";
+                            out << "        unsigned char flag = " << y << " > " << x << " ? 0 : 1;\n";
+                            out << "        " << x << " -= " << y << ";\n";
+                            out << "        V[0xF] = flag;\n";
+                            out << "    }\n";
+                            return true;
+                        case 0x6:
+                            out << "    {\n";
+                            out << "        unsigned char flag = " << x << " & 0x1;\n";
+                            out << "        " << x << " >>= 1;\n";
+                            out << "        V[0xF] = flag;\n";
+                            out << "    }\n";
+                            return true;
+                        case 0x7:
+                            out << "    {\n";
+                            out << "        unsigned char flag = " << x << " > " << y << " ? 0 : 1;\n";
+                            out << "        " << x << " = " << y << " - " << x << ";\n";
+                            out << "        V[0xF] = flag;\n";
+                            out << "    }\n";
+                            return true;
+                        case 0xE:
+                            out << "    {\n";
+                            out << "        unsigned char flag = (" << x << " & 0x80) >> 7;\n";
+                            out << "        " << x << " <<= 1;\n";
+                            out << "        V[0xF] = flag;\n";
+                            out << "    }\n";
+                            return true;
+                        default:
+                            return false;
+                    }
+                case 0xA000:
+                    out << "    ch8.I = " << nnn << ";\n";
+                    return true;
+                case 0xB000:
+                    exit("    ",opcode,count,"(V[0x0] + " + nnn + ") & 0x0FFF","nullptr");
+                    return true;
+                case 0xE000:
+                    if((opcode&0x00FF) == 0x9E){
+                        skip("ch8.key[" + x + " & 0xF]",opcode,pc,count);
+                        return true;
+                    }
+                    if((opcode&0x00FF) == 0xA1){
+                        skip("!ch8.key[" + x + " & 0xF]",opcode,pc,count);
+                        return true;
+                    }
+                    return false;
+                case 0xF000:
+                    switch (opcode&0x00FF){
+                        case 0x07: out << "    " << x << " = ch8.delay_timer;\n"; return true;
+                        case 0x15: out << "    ch8.delay_timer = " << x << ";\n"; return true;
+                        case 0x18: out << "    ch8.sound_timer = " << x << ";\n"; return true;
+                        case 0x1E: out << "    ch8.I += " << x << ";\n"; return true;
+                        case 0x29: out << "    ch8.I = (" << x << " & 0xF)*5;\n"; return true;
+                        case 0x33:
+                            out << "    ch8.memory[ch8.I & 0x0FFF] =     (unsigned char)  " << x << "/100;\n";
+                            out << "    ch8.memory[(ch8.I+1) & 0x0FFF] = (unsigned char) (" << x << " % 100)/10;\n";
+                            out << "    ch8.memory[(ch8.I+2) & 0x0FFF] = (unsigned char)  " << x << " % 10;\n";
+                            return true;
+                        case 0x55:
+                            for(unsigned offset = 0; offset <= vX; ++offset)
+                                out << "    ch8.memory[(ch8.I+" << offset << ") & 0x0FFF] = V[" << hex(offset,1) << "];\n";
+                            return true;
+                        case 0x65:
+                            for(unsigned offset = 0; offset <= vX; ++offset)
+                                out << "    V[" << hex(offset,1) << "] = ch8.memory[(ch8.I+" << offset << ") & 0x0FFF];\n";
+                            return true;
+                        default:
+                            return false;
+                    }
+                default:
+                    return false;
+            }
+        }
+    };
+}
+
+bool recompile(const unsigned char *rom, size_t size, const std::string &name, std::ostream &out) {
+    // the ROM becomes an array, which must not be empty
+    if(size == 0)
+        return false;
+    if(size > chip8::max_program_size)
+        size = chip8::max_program_size;
+    std::vector<unsigned char> memory(0x1000,0);
+    std::copy(rom,rom+size,memory.begin()+0x200);
+    std::shared_ptr<const rom_analysis> cached = analyze_rom(rom,size);
+    const rom_analysis &analysis = *cached;
+
+    std::map<unsigned short,size_t> index;
+    for(size_t i = 0; i < analysis.blocks.size(); ++i)
+        index[analysis.blocks[i].start] = i;
+
+    out << "// Generated by chip8_aot from a ROM with hash " << hex(analysis.hash>>32,8)
+        << hex(analysis.hash&0xFFFFFFFF,8).substr(2) << ". Do not edit.\n\n";
+    out << "#include \"aot.h\"\n\n";
+
+    out << "static const unsigned char " << name << "_rom[" << size << "] = {";
+    for(size_t i = 0; i < size; ++i)
+        out << (i%16 == 0 ? "\n    " : " ") << hex(rom[i],2) << ",";
+    out << "\n};\n\n";
+
+    // the table is declared first, so blocks can link directly to their successors
+    if(!analysis.blocks.empty()){
+        out << "extern const aot_block " << name << "_blocks[" << analysis.blocks.size() << "];\n\n";
+
+        block_writer writer(name,index,out);
+        for(const auto &block : analysis.blocks)
+            writer.write(block,memory.data());
+
+        out << "const aot_block " << name << "_blocks[" << analysis.blocks.size() << "] = {\n";
+        for(const auto &block : analysis.blocks){
+            out << "    {" << hex(block.start,3) << ", " << hex(block.end,3) << ", " << (block.end-block.start)/2+1
+                << ", " << name << "_block_" << hex(block.start,3) << "},\n";
+        }
+        out << "};\n\n";
+    }
+
+    out << "extern const aot_program " << name << " = {\n";
+    out << "    " << name << "_rom, " << size << ", " << hex(analysis.hash>>32,8)
+        << hex(analysis.hash&0xFFFFFFFF,8).substr(2) << "ULL,\n";
+    out << "    " << (analysis.blocks.empty() ? "nullptr" : name + "_blocks") << ", " << analysis.blocks.size() << "\n";
+    out << "};\n";
+    return true;
+}
@@ -0,0 +1,41 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_RECOMPILER_H
+#define CHIP_8_RECOMPILER_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+// Translates a ROM ahead of time into a C++ translation unit. The generated code defines
+//
+//     extern const aot_program <name>;
+//
+// which is executed by aot_runtime (see aot.h). Every basic block found by the analyzer becomes one function. The
+// opcode semantics are the same as in chip8::decode(), opcodes which are not worth translating (2NNN, 00EE, CXNN,
+// DXYN, ...) call decode() directly. Returns false and writes nothing for an empty ROM.
+bool recompile(const unsigned char *rom, size_t size, const std::string &name, std::ostream &out);
+
+#endif //CHIP_8_RECOMPILER_H
@@ -0,0 +1,323 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "rom_pack.h"
+#include "analyzer.h"
+#include "byte_order.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+    // flags which the instruction adds to the ROM
+    uint16_t classify(unsigned short op){
+        unsigned short nn = op & 0xFF;
+        switch(op >> 12){
+            case 0x0:
+                if((op & 0xFFF0) == 0x00C0 || (op >= 0x00FB && op <= 0x00FF))
+                    return rom_superchip;
+                return 0;
+            case 0x5:
+            case 0x9:
+                return (op & 0xF) == 0 ? 0 : rom_unknown_opcodes;
+            case 0x8:
+                switch(op & 0xF){
+                    case 0x1: case 0x2: case 0x3: return rom_quirk_logic;
+                    case 0x6: case 0xE: return rom_quirk_shift;
+                    case 0x0: case 0x4: case 0x5: case 0x7: return 0;
+                    default: return rom_unknown_opcodes;
+                }
+            case 0xB:
+                return rom_quirk_jump;
+            case 0xC:
+                return rom_random;
+            case 0xD:
+                return (op & 0xF) == 0 ? rom_superchip : 0;
+            case 0xE:
+                return nn == 0x9E || nn == 0xA1 ? rom_input : rom_unknown_opcodes;
+            case 0xF:
+                switch(nn){
+                    case 0x0A: return rom_input;
+                    case 0x55: case 0x65: return rom_quirk_load_store;
+                    case 0x07: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x33: return 0;
+                    case 0x30: case 0x75: case 0x85: return rom_superchip;
+                    default: return rom_unknown_opcodes;
+                }
+            default:
+                return 0;
+        }
+    }
+}
+
+rom_metadata describe_rom(const unsigned char *rom, size_t size) {
+    rom_metadata metadata;
+    size = std::min(size,chip8::max_program_size);
+    metadata.hash = fnv1a_64(rom,size);
+
+    std::vector<unsigned char> memory(0x1000,0);
+    std::memcpy(&memory[0x200],rom,size);
+    std::shared_ptr<const rom_analysis> cached = analyze_rom(rom,size);
+    const rom_analysis &analysis = *cached;
+    for(const basic_block &block : analysis.blocks)
+        for(unsigned int addr = block.start; addr <= block.end; addr += 2){
+            unsigned short op = memory[addr] << 8 | memory[(addr+1) & 0xFFF];
+            metadata.flags |= classify(op);
+            metadata.histogram[op >> 12]++;
+        }
+    // the analyzer stops at opcodes it does not know, e.g. those of the SUPER-CHIP. They are found where a path ends
+    // without a jump or a return, or where a branch leads outside of the code
+    std::vector<unsigned short> stops {0x200};
+    for(const basic_block &block : analysis.blocks){
+        stops.insert(stops.end(),block.successors.begin(),block.successors.end());
+        if(block.successors.empty() && !block.returns && !block.computed_jump)
+            stops.push_back(block.end+2);
+    }
+    std::sort(stops.begin(),stops.end());
+    stops.erase(std::unique(stops.begin(),stops.end()),stops.end());
+    for(size_t addr : stops)
+        if(addr >= 0x200 && addr+1 < 0x200+size && !analysis.is_code(addr))
+            metadata.flags |= classify(memory[addr] << 8 | memory[addr+1]);
+
+    for(size_t addr = 0x200; addr < 0x200+size; ++addr)
+        if(analysis.is_code(addr))
+            metadata.code_bytes++;
+    metadata.data_bytes = size-metadata.code_bytes;
+    return metadata;
+}
+
+rom_pack_builder::result rom_pack_builder::add(const unsigned char *rom, size_t size, const std::string &name) {
+    if(size == 0)
+        return empty;
+    if(size > chip8::max_program_size)
+        return too_large;
+    uint64_t hash = fnv1a_64(rom,size);
+    auto it = index.find(hash);
+    if(it != index.end()){
+        entry &existing = entries[it->second];
+        if(existing.rom.size() != size || std::memcmp(existing.rom.data(),rom,size) != 0)
+            return collision;
+        existing.duplicates++;
+        return duplicate;
+    }
+
+    entry e;
+    e.metadata = describe_rom(rom,size);
+    e.rom.assign(rom,rom+size);
+    e.name = name;
+    e.duplicates = 0;
+    index[hash] = entries.size();
+    entries.push_back(std::move(e));
+    return added;
+}
+
+bool rom_pack_builder::add_file(const std::string &path, result &outcome, std::string &error) {
+    std::ifstream file(path,std::ios::binary);
+    if(!file.is_open()){
+        error = "can not open "+path;
+        return false;
+    }
+    // one byte more than the limit is enough to reject the file
+    std::vector<unsigned char> rom(chip8::max_program_size+1);
+    file.read(reinterpret_cast<char *>(rom.data()),rom.size());
+    if(file.bad()){
+        error = "can not read "+path;
+        return false;
+    }
+    outcome = add(rom.data(),(size_t)file.gcount(),path);
+    return true;
+}
+
+void rom_pack_builder::encode(std::vector<unsigned char> &out) const {
+    std::vector<const entry *> sorted;
+    sorted.reserve(entries.size());
+    for(const entry &e : entries)
+        sorted.push_back(&e);
+    std::sort(sorted.begin(),sorted.end(),[](const entry *a, const entry *b){
+        return a->metadata.hash < b->metadata.hash;
+    });
+
+    size_t roms_offset = rom_pack_header_size+sorted.size()*rom_pack_entry_size;
+    size_t names_offset = roms_offset;
+    for(const entry *e : sorted)
+        names_offset += e->rom.size();
+    size_t file_size = names_offset;
+    for(const entry *e : sorted)
+        file_size += e->name.size()+1;
+
+    size_t start = out.size();
+    out.resize(start+file_size,0);
+    unsigned char *base = &out[start];
+    size_t rom_offset = roms_offset;
+    size_t name_offset = names_offset;
+    for(size_t i = 0; i < sorted.size(); ++i){
+        const entry &e = *sorted[i];
+        unsigned char *p = base+rom_pack_header_size+i*rom_pack_entry_size;
+        put64(p,e.metadata.hash);
+        put32(p+8,(uint32_t)rom_offset);
+        put16(p+12,(uint16_t)e.rom.size());
+        put16(p+14,e.metadata.flags);
+        put16(p+16,e.metadata.code_bytes);
+        put16(p+18,e.metadata.data_bytes);
+        put32(p+20,(uint32_t)name_offset);
+        put32(p+24,e.duplicates);
+        for(int nibble = 0; nibble < 16; ++nibble)
+            put16(p+32+nibble*2,e.metadata.histogram[nibble]);
+        std::memcpy(base+rom_offset,e.rom.data(),e.rom.size());
+        std::memcpy(base+name_offset,e.name.c_str(),e.name.size()+1);
+        rom_offset += e.rom.size();
+        name_offset += e.name.size()+1;
+    }
+
+    put32(base,rom_pack_magic);
+    put16(base+4,rom_pack_version);
+    put16(base+6,rom_pack_entry_size);
+    put32(base+8,(uint32_t)sorted.size());
+    put32(base+12,(uint32_t)names_offset);
+    put32(base+16,(uint32_t)file_size);
+    uint64_t checksum = fnv1a_64(base+rom_pack_header_size,roms_offset-rom_pack_header_size);
+    put64(base+24,fnv1a_64(base+names_offset,file_size-names_offset,checksum));
+}
+
+bool rom_pack_builder::write(const std::string &path) const {
+    std::vector<unsigned char> bytes;
+    encode(bytes);
+    return replace_file(path,bytes);
+}
+
+rom_pack::~rom_pack() {
+    close();
+}
+
+bool rom_pack::open(const std::string &path) {
+    close();
+    if(!file.open(path,message))
+        return false;
+    return attach(file.data(),file.size());
+}
+
+bool rom_pack::open(const unsigned char *data, size_t size) {
+    close();
+    return attach(data,size);
+}
+
+void rom_pack::close() {
+    file.close();
+    base = nullptr;
+    length = 0;
+    count = 0;
+}
+
+bool rom_pack::attach(const unsigned char *data, size_t size) {
+    base = data;
+    length = size;
+    if(!validate()){
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool rom_pack::validate() {
+    if(length < rom_pack_header_size || get32(base) != rom_pack_magic){
+        message = "not a ROM pack";
+        return false;
+    }
+    if(get16(base+4) != rom_pack_version || get16(base+6) != rom_pack_entry_size){
+        message = "ROM pack version "+std::to_string(get16(base+4))+" is not supported";
+        return false;
+    }
+    size_t n = get32(base+8);
+    size_t names_offset = get32(base+12);
+    size_t roms_offset = rom_pack_header_size+n*rom_pack_entry_size;
+    if(get32(base+16) != length || roms_offset > names_offset || names_offset > length){
+        message = "ROM pack is truncated";
+        return false;
+    }
+    uint64_t checksum = fnv1a_64(base+rom_pack_header_size,roms_offset-rom_pack_header_size);
+    if(fnv1a_64(base+names_offset,length-names_offset,checksum) != get64(base+24)){
+        message = "ROM pack checksum mismatch";
+        return false;
+    }
+    // the metadata is intact, but the offsets could still have been written by a broken builder
+    for(size_t i = 0; i < n; ++i){
+        const unsigned char *p = base+rom_pack_header_size+i*rom_pack_entry_size;
+        size_t rom = get32(p+8), name = get32(p+20);
+        if(rom < roms_offset || rom+get16(p+12) > names_offset || get16(p+12) > chip8::max_program_size ||
+           name < names_offset || name >= length || base[length-1] != 0){
+            message = "ROM pack is corrupt";
+            return false;
+        }
+    }
+    count = n;
+    return true;
+}
+
+rom_pack::rom rom_pack::at(size_t i) const {
+    const unsigned char *p = base+rom_pack_header_size+i*rom_pack_entry_size;
+    rom r;
+    r.metadata.hash = get64(p);
+    r.data = base+get32(p+8);
+    r.size = get16(p+12);
+    r.metadata.flags = get16(p+14);
+    r.metadata.code_bytes = get16(p+16);
+    r.metadata.data_bytes = get16(p+18);
+    r.name = reinterpret_cast<const char *>(base+get32(p+20));
+    r.duplicates = get32(p+24);
+    for(int nibble = 0; nibble < 16; ++nibble)
+        r.metadata.histogram[nibble] = get16(p+32+nibble*2);
+    return r;
+}
+
+bool rom_pack::find(uint64_t hash, rom &out) const {
+    size_t low = 0, high = count;
+    while(low < high){
+        size_t mid = low+(high-low)/2;
+        uint64_t h = get64(base+rom_pack_header_size+mid*rom_pack_entry_size);
+        if(h == hash){
+            out = at(mid);
+            return true;
+        }
+        if(h < hash)
+            low = mid+1;
+        else
+            high = mid;
+    }
+    return false;
+}
+
+bool rom_pack::load(size_t i, chip8 &ch8) const {
+    const unsigned char *p = base+rom_pack_header_size+i*rom_pack_entry_size;
+    const unsigned char *data = base+get32(p+8);
+    uint16_t size = get16(p+12);
+    if(fnv1a_64(data,size) != get64(p)){
+        snprintf(ch8.info_string,sizeof(ch8.info_string),"ROM 0x%016llx of the pack is corrupt",
+                 (unsigned long long)get64(p));
+        return false;
+    }
+    ch8.load_program(data,size);
+    return true;
+}
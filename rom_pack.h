@@ -0,0 +1,188 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_ROM_PACK_H
+#define CHIP_8_ROM_PACK_H
+
+#include "chip8.h"
+#include "file_io.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A pack holds a deduplicated ROM corpus and the metadata of every ROM in one file which is memory mapped, so a job
+// finds any ROM without touching the file system. All integers are little endian:
+//   header   32 bytes
+//     0  uint32 magic "C8PK"
+//     4  uint16 version
+//     6  uint16 size of an entry, 64
+//     8  uint32 number of ROMs
+//    12  uint32 offset of the names
+//    16  uint32 size of the file
+//    20  uint32 reserved, 0
+//    24  uint64 FNV-1a of the entries and the names
+//   entries, sorted by hash
+//     0  uint64 FNV-1a of the ROM
+//     8  uint32 offset of the ROM
+//    12  uint16 size of the ROM
+//    14  uint16 flags, see rom_flags
+//    16  uint16 bytes reached by the control flow, see analyzer.h
+//    18  uint16 the other bytes of the ROM
+//    20  uint32 offset of the name, a zero terminated path of the first file with this content
+//    24  uint32 number of further files with this content
+//    28  uint32 reserved, 0
+//    32  16 * uint16 reachable instructions by their first nibble
+//   ROMs
+//   names
+// The checksum only covers the metadata, so opening a pack stays cheap. The ROMs are verified against their hash
+// when they are loaded.
+const uint32_t rom_pack_magic = 0x4B503843;
+const uint16_t rom_pack_version = 1;
+const size_t rom_pack_header_size = 32;
+const size_t rom_pack_entry_size = 64;
+
+// what the static analysis found in a ROM. The quirk flags mark instructions whose behaviour differs between the
+// interpreters, so a ROM without them runs the same everywhere
+enum rom_flags : uint16_t {
+    // 00CN, 00FB - 00FF, DXY0, FX30, FX75 or FX85 is reachable
+    rom_superchip = 1 << 0,
+    // an opcode which no variant knows is reachable
+    rom_unknown_opcodes = 1 << 1,
+    // 8XY6 or 8XYE, which shift VY on the VIP and VX later
+    rom_quirk_shift = 1 << 2,
+    // FX55 or FX65, which increment I on the VIP
+    rom_quirk_load_store = 1 << 3,
+    // BNNN, which adds VX instead of V0 on the SUPER-CHIP
+    rom_quirk_jump = 1 << 4,
+    // 8XY1, 8XY2 or 8XY3, which reset VF on the VIP
+    rom_quirk_logic = 1 << 5,
+    // CXNN
+    rom_random = 1 << 6,
+    // FX0A, EX9E or EXA1
+    rom_input = 1 << 7
+};
+
+struct rom_metadata {
+    uint64_t hash {0};
+    uint16_t flags {0};
+    uint16_t code_bytes {0};
+    uint16_t data_bytes {0};
+    uint16_t histogram[16] {0};
+};
+
+// analyzes a ROM for the pack
+rom_metadata describe_rom(const unsigned char *rom, size_t size);
+
+class rom_pack_builder {
+public:
+    enum result {
+        added,
+        duplicate,
+        empty,
+        // larger than the 0xE00 bytes which fit into memory
+        too_large,
+        // another ROM of the pack has the same hash, the pack is keyed by it
+        collision
+    };
+
+    result add(const unsigned char *rom, size_t size, const std::string &name);
+
+    // reads the file and adds it. Sets error and returns false if the file can not be read
+    bool add_file(const std::string &path, result &outcome, std::string &error);
+
+    size_t roms() const {
+        return entries.size();
+    }
+
+    void encode(std::vector<unsigned char> &out) const;
+
+    // writes the pack through a temporary file. Returns false on I/O errors
+    bool write(const std::string &path) const;
+
+private:
+    struct entry {
+        rom_metadata metadata;
+        std::vector<unsigned char> rom;
+        std::string name;
+        uint32_t duplicates;
+    };
+
+    std::vector<entry> entries;
+    // hash to index into entries
+    std::unordered_map<uint64_t,size_t> index;
+};
+
+class rom_pack {
+public:
+    struct rom {
+        rom_metadata metadata;
+        const unsigned char *data;
+        uint16_t size;
+        const char *name;
+        uint32_t duplicates;
+    };
+
+    rom_pack() = default;
+    rom_pack(const rom_pack &) = delete;
+    rom_pack &operator=(const rom_pack &) = delete;
+    ~rom_pack();
+
+    // maps the file. Returns false and sets error() if it is no valid pack
+    bool open(const std::string &path);
+
+    // uses a pack which is already in memory. The data has to outlive the pack
+    bool open(const unsigned char *data, size_t size);
+
+    void close();
+
+    const std::string &error() const {
+        return message;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    rom at(size_t i) const;
+
+    // binary search by the hash of the ROM. Returns false if the pack does not contain it
+    bool find(uint64_t hash, rom &out) const;
+
+    // loads the ROM into ch8. Returns false and sets info_string if the ROM does not match its hash
+    bool load(size_t i, chip8 &ch8) const;
+
+private:
+    const unsigned char *base {nullptr};
+    size_t length {0};
+    size_t count {0};
+    mapped_file file;
+    std::string message;
+
+    // validates the data and keeps it, or closes the pack
+    bool attach(const unsigned char *data, size_t size);
+    bool validate();
+};
+
+#endif //CHIP_8_ROM_PACK_H
@@ -0,0 +1,64 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "run_ahead.h"
+#include <chrono>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<chip8>::value,"run-ahead copies the state with an assignment");
+
+namespace {
+    uint64_t nanoseconds_since(std::chrono::steady_clock::time_point start){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+    }
+}
+
+const unsigned char *run_ahead::frame(chip8 &ch8, bool &completed) {
+    auto start = std::chrono::steady_clock::now();
+    completed = cache != nullptr ? cache->run_frame(ch8) : ch8.run_frame();
+    ++measured.frames;
+    measured.real_ns += nanoseconds_since(start);
+    if(ahead_frames == 0 || !completed)
+        return ch8.framebuffer();
+
+    start = std::chrono::steady_clock::now();
+    if(!scratch)
+        scratch.reset(new chip8);
+    // chip8 is trivially copyable, this is a single memcpy of the state
+    *scratch = ch8;
+    // breakpoints and the profiler only see real frames
+    scratch->armed_debugger = nullptr;
+    scratch->profiler = nullptr;
+    measured.copy_ns += nanoseconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < ahead_frames; ++i){
+        if(cache != nullptr)
+            cache->run_frame(*scratch);
+        else
+            scratch->run_frame();
+    }
+    measured.ahead_ns += nanoseconds_since(start);
+    return scratch->framebuffer();
+}
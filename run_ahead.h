@@ -0,0 +1,76 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_RUN_AHEAD_H
+#define CHIP_8_RUN_AHEAD_H
+
+#include "chip8.h"
+#include "frame_cache.h"
+#include <cstdint>
+#include <memory>
+
+// Run-ahead hides the input latency of a ROM. After every real frame the state is copied to a scratch instance, which
+// emulates the next N frames with the keys that are pressed now, and the last of them is presented. The real machine
+// never sees the speculative frames, so the result is as if the frames were saved and restored. A key press shows
+// up N frames earlier, for N+1 times the emulation work and one state copy per frame.
+class run_ahead {
+public:
+    explicit run_ahead(unsigned int frames = 0) : ahead_frames(frames) {}
+
+    void set_frames(unsigned int frames){
+        ahead_frames = frames;
+    }
+    unsigned int frames() const {
+        return ahead_frames;
+    }
+
+    // runs the real and the speculative frames through cache. All but the last speculative frame repeat one of the
+    // previous real frame, as long as the keys do not change, see frame_cache.h
+    void set_cache(frame_cache *c){
+        cache = c;
+    }
+
+    // emulates one real frame of ch8 and returns the pixels to present. completed is the result of
+    // ch8.run_frame(). If the debugger stopped the frame, the real display is presented
+    const unsigned char *frame(chip8 &ch8, bool &completed);
+
+    // time spent per real frame, to choose N
+    struct statistics {
+        uint64_t frames {0};
+        uint64_t copy_ns {0};
+        uint64_t real_ns {0};
+        uint64_t ahead_ns {0};
+    };
+    const statistics &stats() const {
+        return measured;
+    }
+
+private:
+    unsigned int ahead_frames;
+    std::unique_ptr<chip8> scratch;
+    frame_cache *cache {nullptr};
+    statistics measured;
+};
+
+#endif //CHIP_8_RUN_AHEAD_H
@@ -0,0 +1,209 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "savestate.h"
+#include "byte_order.h"
+#include "file_io.h"
+#include "hash.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    // size of the payload without the memory pages
+    const size_t fixed_size = 6+16+5+4+24+2+chip8::stack_size*2+2+chip8::width*chip8::height/8+2;
+    const int pages = 0x1000/savestate_page_size;
+
+    bool zero_page(const unsigned char *page){
+        for(size_t i = 0; i < savestate_page_size; ++i)
+            if(page[i] != 0)
+                return false;
+        return true;
+    }
+}
+
+void encode_savestate(const chip8 &ch8, bool sparse, std::vector<unsigned char> &out) {
+    uint16_t present = 0;
+    for(int page = 0; page < pages; ++page)
+        if(!sparse || !zero_page(ch8.memory+page*savestate_page_size))
+            present |= 1 << page;
+    size_t payload_size = fixed_size;
+    for(int page = 0; page < pages; ++page)
+        if(present & (1 << page))
+            payload_size += savestate_page_size;
+
+    size_t start = out.size();
+    out.resize(start+savestate_header_size+payload_size);
+    unsigned char *header = &out[start];
+    unsigned char *p = header+savestate_header_size;
+
+    put16(p,ch8.PC);
+    put16(p+2,ch8.opcode);
+    put16(p+4,ch8.I);
+    p += 6;
+    std::memcpy(p,ch8.VF,16);
+    p += 16;
+    p[0] = ch8.SP;
+    p[1] = ch8.delay_timer;
+    p[2] = ch8.sound_timer;
+    p[3] = ch8.beep;
+    p[4] = ch8.timing;
+    p += 5;
+    put32(p,ch8.instructions_per_frame);
+    put64(p+4,ch8.machine_cycles);
+    put64(p+12,(uint64_t)(int64_t)ch8.vip_overrun);
+    put64(p+20,ch8.rng_state);
+    put16(p+28,ch8.program_size);
+    p += 30;
+    for(int i = 0; i < chip8::stack_size; ++i)
+        put16(p+i*2,ch8.stack[i]);
+    p += chip8::stack_size*2;
+    uint16_t keys = 0;
+    for(int i = 0; i < 16; ++i)
+        if(ch8.key[i])
+            keys |= 1 << i;
+    put16(p,keys);
+    p += 2;
+    for(int i = 0; i < chip8::width*chip8::height/8; ++i){
+        unsigned char bits = 0;
+        for(int bit = 0; bit < 8; ++bit)
+            bits |= (ch8.display[i*8+bit] != 0) << (7-bit);
+        p[i] = bits;
+    }
+    p += chip8::width*chip8::height/8;
+    put16(p,present);
+    p += 2;
+    for(int page = 0; page < pages; ++page)
+        if(present & (1 << page)){
+            std::memcpy(p,ch8.memory+page*savestate_page_size,savestate_page_size);
+            p += savestate_page_size;
+        }
+
+    const unsigned char *payload = header+savestate_header_size;
+    put32(header,savestate_magic);
+    put16(header+4,savestate_version);
+    put16(header+6,sparse ? savestate_sparse : 0);
+    put32(header+8,(uint32_t)payload_size);
+    put32(header+12,0);
+    put64(header+16,fnv1a_64(payload,payload_size));
+    put64(header+24,0);
+}
+
+bool decode_savestate(const unsigned char *data, size_t size, chip8 &ch8) {
+    if(size < savestate_header_size || get32(data) != savestate_magic){
+        snprintf(ch8.info_string,sizeof(ch8.info_string),"not a savestate");
+        return false;
+    }
+    if(get16(data+4) != savestate_version){
+        snprintf(ch8.info_string,sizeof(ch8.info_string),"savestate version %u is not supported",get16(data+4));
+        return false;
+    }
+    size_t payload_size = get32(data+8);
+    const unsigned char *p = data+savestate_header_size;
+    if(payload_size < fixed_size || size-savestate_header_size < payload_size){
+        snprintf(ch8.info_string,sizeof(ch8.info_string),"savestate is truncated");
+        return false;
+    }
+    if(fnv1a_64(p,payload_size) != get64(data+16)){
+        snprintf(ch8.info_string,sizeof(ch8.info_string),"savestate checksum mismatch");
+        return false;
+    }
+
+    // validate everything before ch8 is touched
+    const unsigned char *registers = p+22;
+    const unsigned char *pages_field = p+fixed_size-2;
+    uint16_t present = get16(pages_field);
+    size_t page_count = 0;
+    for(int page = 0; page < pages; ++page)
+        page_count += (present >> page) & 1;
+    uint32_t instructions_per_frame = get32(registers+5);
+    int64_t vip_overrun = (int64_t)get64(registers+17);
+    if(registers[0] > chip8::stack_size || registers[4] > chip8::cosmac_vip ||
+       instructions_per_frame == 0 || instructions_per_frame > chip8::max_instructions_per_frame ||
+       vip_overrun < 0 || vip_overrun >= chip8::vip_max_cycles ||
+       get16(registers+33) > sizeof(ch8.memory)-0x200 || payload_size != fixed_size+page_count*savestate_page_size){
+        snprintf(ch8.info_string,sizeof(ch8.info_string),"savestate is corrupt");
+        return false;
+    }
+
+    ch8.PC = get16(p);
+    ch8.opcode = get16(p+2);
+    ch8.I = get16(p+4);
+    p += 6;
+    std::memcpy(ch8.VF,p,16);
+    p += 16;
+    ch8.SP = p[0];
+    ch8.delay_timer = p[1];
+    ch8.sound_timer = p[2];
+    ch8.beep = p[3] != 0;
+    ch8.timing = (chip8::timing_model)p[4];
+    p += 5;
+    ch8.instructions_per_frame = get32(p);
+    ch8.machine_cycles = get64(p+4);
+    ch8.vip_overrun = (long)(int64_t)get64(p+12);
+    ch8.rng_state = get64(p+20);
+    ch8.program_size = get16(p+28);
+    p += 30;
+    for(int i = 0; i < chip8::stack_size; ++i)
+        ch8.stack[i] = get16(p+i*2);
+    p += chip8::stack_size*2;
+    uint16_t keys = get16(p);
+    for(int i = 0; i < 16; ++i)
+        ch8.key[i] = (keys >> i) & 1;
+    p += 2;
+    for(int i = 0; i < chip8::width*chip8::height/8; ++i)
+        for(int bit = 0; bit < 8; ++bit)
+            ch8.display[i*8+bit] = (p[i] >> (7-bit)) & 1;
+    p += chip8::width*chip8::height/8+2;
+    for(int page = 0; page < pages; ++page){
+        unsigned char *target = ch8.memory+page*savestate_page_size;
+        if(present & (1 << page)){
+            std::memcpy(target,p,savestate_page_size);
+            p += savestate_page_size;
+        }else{
+            std::memset(target,0,savestate_page_size);
+        }
+    }
+    return true;
+}
+
+bool save_savestate(chip8 &ch8, const std::string &path, bool sparse) {
+    std::vector<unsigned char> bytes;
+    encode_savestate(ch8,sparse,bytes);
+
+    if(!replace_file(path,bytes)){
+        snprintf(ch8.info_string,sizeof(ch8.info_string),"can not write %s",path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_savestate(chip8 &ch8, const std::string &path) {
+    mapped_file file;
+    std::string error;
+    if(!file.open(path,error)){
+        snprintf(ch8.info_string,sizeof(ch8.info_string),"%s",error.c_str());
+        return false;
+    }
+    return decode_savestate(file.data(),file.size(),ch8);
+}
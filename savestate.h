@@ -0,0 +1,77 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_SAVESTATE_H
+#define CHIP_8_SAVESTATE_H
+
+#include "chip8.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary savestates which can be handed between machines. All integers are little endian:
+//   header   32 bytes
+//     0  uint32 magic "C8ST"
+//     4  uint16 version
+//     6  uint16 flags, savestate_sparse if zero pages were left out
+//     8  uint32 payload size
+//    12  uint32 reserved, 0
+//    16  uint64 FNV-1a of the payload
+//    24  uint64 reserved, 0
+//   payload
+//          uint16 PC, opcode, I
+//          16 bytes V0 - VF
+//          uint8 SP, delay timer, sound timer, beep, timing model
+//          uint32 instructions per frame
+//          uint64 machine cycles, VIP overrun, random number generator
+//          uint16 program size
+//          24 * uint16 stack
+//          uint16 keys, bit X is key X
+//          256 bytes display, one bit per pixel, row major, MSB first
+//          uint16 pages, bit X is set if the 256 byte page at X*0x100 follows
+//          the pages in ascending order
+// Without savestate_sparse every page is stored, so the file of a state is always the same size. The hooks
+// (debugger, profiler) and info_string are not part of the state.
+const uint32_t savestate_magic = 0x54533843;
+const uint16_t savestate_version = 1;
+const uint16_t savestate_sparse = 1;
+
+const size_t savestate_header_size = 32;
+const size_t savestate_page_size = 0x100;
+
+// appends the state of ch8 to out. With sparse, memory pages which are all zero are left out
+void encode_savestate(const chip8 &ch8, bool sparse, std::vector<unsigned char> &out);
+
+// restores a state from the bytes of a savestate. Returns false and sets info_string if the data is truncated,
+// corrupt or of another version. ch8 is only changed if the state is valid
+bool decode_savestate(const unsigned char *data, size_t size, chip8 &ch8);
+
+// writes the file through a temporary file, so a crash never leaves a partial state at path. Returns false and sets
+// info_string on I/O errors
+bool save_savestate(chip8 &ch8, const std::string &path, bool sparse = true);
+
+// maps the file into memory and decodes it in place, see decode_savestate()
+bool load_savestate(chip8 &ch8, const std::string &path);
+
+#endif //CHIP_8_SAVESTATE_H
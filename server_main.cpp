@@ -0,0 +1,88 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "control.h"
+#include <csignal>
+#include <chrono>
+#include <cstdio>
+#include <getopt.h>
+#include <string>
+
+namespace {
+    control_server *running_server = nullptr;
+
+    void on_signal(int){
+        if(running_server != nullptr)
+            running_server->stop();
+    }
+}
+
+// chip8_server [--metrics FILE] SOCKET
+// hosts chip8 instances for clients which speak the protocol in control.h, until it is interrupted. With --metrics
+// the Prometheus text of the metrics in metrics.h is rewritten to FILE every second
+int main(int argc, char **argv) {
+    static const option options[] = {
+            {"metrics",required_argument,nullptr,'m'},
+            {"help",no_argument,nullptr,'h'},
+            {nullptr,0,nullptr,0}
+    };
+    std::string metrics_path;
+    int opt;
+    while((opt = getopt_long(argc,argv,"h",options,nullptr)) != -1){
+        switch (opt){
+            case 'm': metrics_path = optarg; break;
+            default:
+                std::fprintf(stderr,"usage: %s [--metrics FILE] SOCKET\n",argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(optind >= argc){
+        std::fprintf(stderr,"usage: %s [--metrics FILE] SOCKET\n",argv[0]);
+        return 1;
+    }
+    control_server server;
+    if(!server.open(argv[optind])){
+        std::fprintf(stderr,"can not listen on %s\n",argv[optind]);
+        return 1;
+    }
+    metrics_registry registry;
+    if(!metrics_path.empty())
+        server.set_metrics(&registry.add("server"));
+
+    // stop cleanly, so the socket file is removed
+    running_server = &server;
+    std::signal(SIGINT,on_signal);
+    std::signal(SIGTERM,on_signal);
+    auto next_export = std::chrono::steady_clock::now();
+    while(!server.stopped()){
+        server.poll(100);
+        auto now = std::chrono::steady_clock::now();
+        if(!metrics_path.empty() && now >= next_export){
+            if(!registry.write_file(metrics_path))
+                std::fprintf(stderr,"writing %s failed\n",metrics_path.c_str());
+            next_export = now+std::chrono::seconds(1);
+        }
+    }
+    return 0;
+}
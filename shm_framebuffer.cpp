@@ -0,0 +1,119 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "shm_framebuffer.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+shm_writer::~shm_writer() {
+    if(shared != nullptr){
+        munmap(shared,sizeof(shm_frame));
+        shm_unlink(name.c_str());
+    }
+}
+
+bool shm_writer::open(const std::string &segment) {
+    int fd = shm_open(segment.c_str(),O_CREAT | O_RDWR,0644);
+    if(fd < 0)
+        return false;
+    if(ftruncate(fd,sizeof(shm_frame)) != 0){
+        close(fd);
+        shm_unlink(segment.c_str());
+        return false;
+    }
+    void *memory = mmap(nullptr,sizeof(shm_frame),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if(memory == MAP_FAILED){
+        shm_unlink(segment.c_str());
+        return false;
+    }
+
+    name = segment;
+    shared = static_cast<shm_frame *>(memory);
+    shared->width = chip8::width;
+    shared->height = chip8::height;
+    shared->version = shm_frame::current_version;
+    shared->sequence.store(0,std::memory_order_relaxed);
+    shared->frame.store(0,std::memory_order_relaxed);
+    std::memset(shared->pixels,0,sizeof(shared->pixels));
+    // readers only accept the segment once the magic is there
+    std::atomic_thread_fence(std::memory_order_release);
+    shared->magic = shm_frame::magic_value;
+    return true;
+}
+
+void shm_writer::publish(const unsigned char *pixels, uint64_t frame) {
+    uint32_t sequence = shared->sequence.load(std::memory_order_relaxed);
+    shared->sequence.store(sequence+1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(shared->pixels,pixels,sizeof(shared->pixels));
+    shared->frame.store(frame,std::memory_order_relaxed);
+    shared->sequence.store(sequence+2,std::memory_order_release);
+}
+
+shm_reader::~shm_reader() {
+    if(shared != nullptr)
+        munmap(const_cast<shm_frame *>(shared),sizeof(shm_frame));
+}
+
+bool shm_reader::open(const std::string &segment) {
+    int fd = shm_open(segment.c_str(),O_RDONLY,0);
+    if(fd < 0)
+        return false;
+    struct stat info {};
+    if(fstat(fd,&info) != 0 || info.st_size < (off_t)sizeof(shm_frame)){
+        close(fd);
+        return false;
+    }
+    void *memory = mmap(nullptr,sizeof(shm_frame),PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if(memory == MAP_FAILED)
+        return false;
+
+    shared = static_cast<const shm_frame *>(memory);
+    if(shared->magic != shm_frame::magic_value || shared->version != shm_frame::current_version ||
+       shared->width != chip8::width || shared->height != chip8::height){
+        munmap(memory,sizeof(shm_frame));
+        shared = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool shm_reader::read(unsigned char *pixels, uint64_t &frame) const {
+    for(int attempt = 0; attempt < 100; ++attempt){
+        uint32_t before = shared->sequence.load(std::memory_order_acquire);
+        if(before & 1)
+            continue;
+        std::memcpy(pixels,shared->pixels,sizeof(shared->pixels));
+        frame = shared->frame.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(shared->sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_SHM_FRAMEBUFFER_H
+#define CHIP_8_SHM_FRAMEBUFFER_H
+
+#include "chip8.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Exports the framebuffer through a named POSIX shared memory segment (/dev/shm/<name>), so viewers, recorders and
+// bots in other processes can read frames without copies through sockets or pipes. The segment is protected by a
+// sequence lock: the writer makes the sequence odd, updates the frame and makes it even again. Readers retry if the
+// sequence was odd or changed while they copied. The writer never waits for readers.
+struct shm_frame {
+    static const uint32_t magic_value = 0x38504843; // "CHP8"
+    static const uint32_t current_version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint64_t> frame;
+    // one byte per pixel which is either 0 or 1, row major
+    unsigned char pixels[chip8::width*chip8::height];
+};
+
+class shm_writer {
+public:
+    shm_writer() = default;
+    shm_writer(const shm_writer &) = delete;
+    shm_writer &operator=(const shm_writer &) = delete;
+    // unmaps and removes the segment
+    ~shm_writer();
+
+    // creates the segment. name must start with a '/'. Returns false if the segment can not be created
+    bool open(const std::string &name);
+
+    void publish(const unsigned char *pixels, uint64_t frame);
+
+private:
+    std::string name;
+    shm_frame *shared {nullptr};
+};
+
+class shm_reader {
+public:
+    shm_reader() = default;
+    shm_reader(const shm_reader &) = delete;
+    shm_reader &operator=(const shm_reader &) = delete;
+    ~shm_reader();
+
+    // maps an existing segment read-only. Returns false if it does not exist or has an unknown layout
+    bool open(const std::string &name);
+
+    // copies a consistent frame. Returns false if the writer was busy for every attempt
+    bool read(unsigned char *pixels, uint64_t &frame) const;
+
+private:
+    const shm_frame *shared {nullptr};
+};
+
+#endif //CHIP_8_SHM_FRAMEBUFFER_H
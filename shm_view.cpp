@@ -0,0 +1,63 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "shm_framebuffer.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// chip8_shm_view NAME
+// prints every new frame of an emulator which was started with --shm NAME
+int main(int argc, char **argv) {
+    if(argc < 2){
+        std::fprintf(stderr,"usage: %s NAME\n",argv[0]);
+        return 1;
+    }
+    std::string name = argv[1][0] == '/' ? argv[1] : std::string("/")+argv[1];
+    shm_reader reader;
+    if(!reader.open(name)){
+        std::fprintf(stderr,"can not open shared memory segment %s\n",name.c_str());
+        return 1;
+    }
+
+    unsigned char pixels[chip8::width*chip8::height];
+    uint64_t frame = 0;
+    uint64_t shown = 0;
+    while(true){
+        if(reader.read(pixels,frame) && frame != shown){
+            std::string text = "\x1b[H";
+            for(int y = 0; y < chip8::height; ++y){
+                for(int x = 0; x < chip8::width; ++x)
+                    text += pixels[y*chip8::width+x] ? '#' : ' ';
+                text += '\n';
+            }
+            text += "frame " + std::to_string(frame) + "\n";
+            std::fwrite(text.data(),1,text.size(),stdout);
+            std::fflush(stdout);
+            shown = frame;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(33));
+    }
+}
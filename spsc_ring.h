@@ -0,0 +1,94 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_SPSC_RING_H
+#define CHIP_8_SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+// Lock free ring buffer for exactly one producer and one consumer thread. Capacity has to be a power of two.
+template<typename T, size_t Capacity>
+class spsc_ring {
+    static_assert((Capacity & (Capacity-1)) == 0,"capacity has to be a power of two");
+
+public:
+    // producer: returns false if the ring is full
+    bool push(const T &value){
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h-tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[h & (Capacity-1)] = value;
+        head.store(h+1,std::memory_order_release);
+        return true;
+    }
+
+    // consumer: returns false if the ring is empty
+    bool pop(T &value){
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t == head.load(std::memory_order_acquire))
+            return false;
+        value = items[t & (Capacity-1)];
+        tail.store(t+1,std::memory_order_release);
+        return true;
+    }
+
+    // producer: pushes as many of the count values as fit. Returns the number of pushed values
+    size_t push(const T *values, size_t count){
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free = Capacity-(h-tail.load(std::memory_order_acquire));
+        if(count > free)
+            count = free;
+        for(size_t i = 0; i < count; ++i)
+            items[(h+i) & (Capacity-1)] = values[i];
+        head.store(h+count,std::memory_order_release);
+        return count;
+    }
+
+    // consumer: pops up to count values. Returns the number of popped values
+    size_t pop(T *values, size_t count){
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t available = head.load(std::memory_order_acquire)-t;
+        if(count > available)
+            count = available;
+        for(size_t i = 0; i < count; ++i)
+            values[i] = items[(t+i) & (Capacity-1)];
+        tail.store(t+count,std::memory_order_release);
+        return count;
+    }
+
+    // number of items which can be popped. Exact for the consumer, a lower bound for the producer
+    size_t size() const {
+        return head.load(std::memory_order_acquire)-tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[Capacity] {};
+
+    // head and tail live on separate cache lines, so producer and consumer do not invalidate each other
+    alignas(64) std::atomic<size_t> head {0};
+    alignas(64) std::atomic<size_t> tail {0};
+};
+
+#endif //CHIP_8_SPSC_RING_H
@@ -0,0 +1,166 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "terminal_renderer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+
+const uint16_t terminal_renderer::unknown;
+
+terminal_renderer::terminal_renderer(cell_mode mode, int width, int height, int row, int column)
+        : mode(mode), width(width), height(height), row(row), column(column) {
+    int cell_width = mode == braille ? 2 : 1;
+    int cell_height = mode == braille ? 4 : 2;
+    cell_columns = (width+cell_width-1)/cell_width;
+    cell_rows = (height+cell_height-1)/cell_height;
+    cells.assign(cell_columns*cell_rows,unknown);
+    next.resize(cells.size());
+    // a full redraw of braille cells is 3 bytes per cell plus a cursor move per row
+    sequence.reserve(cells.size()*3+cell_rows*16+16);
+}
+
+void terminal_renderer::invalidate() {
+    std::fill(cells.begin(),cells.end(),unknown);
+}
+
+uint16_t terminal_renderer::pattern(const unsigned char *pixels, int x, int y) const {
+    auto pixel = [&](int px, int py){
+        return px < width && py < height && pixels[py*width+px] != 0;
+    };
+    if(mode == half_block)
+        return pixel(x,y) | pixel(x,y+1) << 1;
+    // the dots of a braille cell are numbered down the left column, down the right column, then the bottom row
+    return pixel(x,y) | pixel(x,y+1) << 1 | pixel(x,y+2) << 2 | pixel(x+1,y) << 3 | pixel(x+1,y+1) << 4 |
+           pixel(x+1,y+2) << 5 | pixel(x,y+3) << 6 | pixel(x+1,y+3) << 7;
+}
+
+void terminal_renderer::glyph(uint16_t pattern) {
+    if(pattern == 0){
+        sequence += ' ';
+        return;
+    }
+    unsigned int code;
+    if(mode == half_block)
+        code = pattern == 1 ? 0x2580 : pattern == 2 ? 0x2584 : 0x2588;
+    else
+        code = 0x2800+pattern;
+    sequence += (char)(0xE0 | code >> 12);
+    sequence += (char)(0x80 | ((code >> 6) & 0x3F));
+    sequence += (char)(0x80 | (code & 0x3F));
+}
+
+namespace {
+    // appends the control sequence ESC [ n final, the count is left out if it is 1
+    void csi(std::string &out, int n, char final){
+        char buffer[16];
+        int length = n == 1 ? std::snprintf(buffer,sizeof(buffer),"\x1b[%c",final) :
+                     std::snprintf(buffer,sizeof(buffer),"\x1b[%d%c",n,final);
+        out.append(buffer,length);
+    }
+}
+
+void terminal_renderer::move(int from_row, int from_column, int to_row, int to_column, const uint16_t *patterns) {
+    char absolute[24];
+    int absolute_length = std::snprintf(absolute,sizeof(absolute),"\x1b[%d;%dH",row+to_row,column+to_column);
+    if(from_row < 0){
+        sequence.append(absolute,absolute_length);
+        return;
+    }
+
+    // the same move relative to the cursor. Unchanged cells right of the cursor in the same row can also be drawn
+    // again instead of moving over them
+    std::string &relative = scratch;
+    relative.clear();
+    if(to_row > from_row)
+        csi(relative,to_row-from_row,'B');
+    if(to_column > from_column){
+        size_t repeat = 0;
+        for(int c = from_column; c < to_column && to_row == from_row; ++c)
+            repeat += patterns[c] == 0 ? 1 : 3;
+        csi(relative,to_column-from_column,'C');
+        if(to_row == from_row && repeat <= relative.size()){
+            relative.clear();
+            for(int c = from_column; c < to_column; ++c)
+                glyph(patterns[c]);
+            return;
+        }
+    }else if(to_column < from_column){
+        csi(relative,from_column-to_column,'D');
+    }
+    if(relative.size() < (size_t)absolute_length)
+        sequence += relative;
+    else
+        sequence.append(absolute,absolute_length);
+}
+
+const std::string &terminal_renderer::render(const unsigned char *pixels) {
+    // save the cursor and the attributes, they are restored after the update
+    sequence.assign("\x1b" "7");
+    int cell_width = mode == braille ? 2 : 1;
+    int cell_height = mode == braille ? 4 : 2;
+    for(int r = 0; r < cell_rows; ++r)
+        for(int c = 0; c < cell_columns; ++c)
+            next[r*cell_columns+c] = pattern(pixels,c*cell_width,r*cell_height);
+
+    // the cell after the last glyph, where the cursor is
+    int cursor_row = -1, cursor_column = -1;
+    for(int r = 0; r < cell_rows; ++r){
+        const uint16_t *old_row = &cells[r*cell_columns];
+        const uint16_t *new_row = &next[r*cell_columns];
+        for(int c = 0; c < cell_columns; ++c){
+            if(old_row[c] == new_row[c])
+                continue;
+            if(cursor_row != r || cursor_column != c)
+                move(cursor_row,cursor_column,r,c,new_row);
+            glyph(new_row[c]);
+            cursor_row = r;
+            cursor_column = c+1;
+        }
+    }
+    cells.swap(next);
+
+    if(sequence.size() == 2)
+        sequence.clear();
+    else
+        sequence += "\x1b" "8";
+    ++frame_count;
+    byte_count += sequence.size();
+    return sequence;
+}
+
+bool terminal_renderer::present(int fd, const unsigned char *pixels) {
+    const std::string &s = render(pixels);
+    size_t written = 0;
+    while(written < s.size()){
+        ssize_t n = ::write(fd,s.data()+written,s.size()-written);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        written += n;
+    }
+    return true;
+}
@@ -0,0 +1,100 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_TERMINAL_RENDERER_H
+#define CHIP_8_TERMINAL_RENDERER_H
+
+#include "chip8.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Draws a framebuffer with several pixels per terminal cell and without curses. Each frame becomes one escape
+// sequence which only touches the cells that changed, and is written with a single write(). Unchanged cells between
+// two changed ones are skipped with an absolute or relative cursor move or drawn again, whatever is shorter. The
+// sequence saves and restores the cursor, so it can be mixed with the output of curses as long as curses does not
+// draw over it.
+//   half_block  1x2 pixels per cell with the glyphs ▀ ▄ █, a 64x32 display takes 64x16 cells
+//   braille     2x4 pixels per cell with the braille patterns, a 128x64 display takes 64x16 cells
+// The terminal has to understand UTF-8.
+class terminal_renderer {
+public:
+    enum cell_mode {
+        half_block,
+        braille
+    };
+
+    // the display is drawn with its top left corner at the terminal cell row, column, counted from 1
+    explicit terminal_renderer(cell_mode mode, int width = chip8::width, int height = chip8::height, int row = 1,
+                               int column = 1);
+
+    int columns() const {
+        return cell_columns;
+    }
+
+    int rows() const {
+        return cell_rows;
+    }
+
+    // builds the escape sequence which brings the terminal from the last rendered frame to pixels, one byte per
+    // pixel and row major. Empty if nothing changed
+    const std::string &render(const unsigned char *pixels);
+
+    // renders and writes the sequence to fd. Returns false on errors
+    bool present(int fd, const unsigned char *pixels);
+
+    // the next frame redraws every cell, e.g. after the screen was cleared
+    void invalidate();
+
+    uint64_t frames() const {
+        return frame_count;
+    }
+
+    // bytes of all sequences rendered so far
+    uint64_t bytes() const {
+        return byte_count;
+    }
+
+private:
+    cell_mode mode;
+    int width, height;
+    int row, column;
+    int cell_columns, cell_rows;
+    // pixel pattern of each cell as it is on the terminal, unknown after invalidate()
+    std::vector<uint16_t> cells;
+    std::vector<uint16_t> next;
+    std::string sequence;
+    std::string scratch;
+    uint64_t frame_count {0};
+    uint64_t byte_count {0};
+
+    static const uint16_t unknown = 0xFFFF;
+
+    uint16_t pattern(const unsigned char *pixels, int x, int y) const;
+    void glyph(uint16_t pattern);
+    // moves the cursor with the shortest sequence. patterns is the new content of the row the cursor is in
+    void move(int from_row, int from_column, int to_row, int to_column, const uint16_t *patterns);
+};
+
+#endif //CHIP_8_TERMINAL_RENDERER_H
@@ -26,6 +26,35 @@ SOFTWARE.
 
 #include "catch.h"
 #include "chip8.h"
+#include "analyzer.h"
+#include "aot.h"
+#include "audio.h"
+#include "byte_order.h"
+#include "capture.h"
+#include "conformance.h"
+#include "control.h"
+#include "debugger.h"
+#include "emulator_thread.h"
+#include "frame_cache.h"
+#include "golden.h"
+#include "halt_detector.h"
+#include "hash.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "profiler.h"
+#include "recompiler.h"
+#include "rom_pack.h"
+#include "run_ahead.h"
+#include "savestate.h"
+#include "shm_framebuffer.h"
+#include "terminal_renderer.h"
+#include "vector_env.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
 
 TEST_CASE("opcode 1NNN","[opcodes] [decode]"){
     // Jumps to address NNN.
@@ -548,3 +577,1195 @@ TEST_CASE("load program"," "){
     REQUIRE(ch8.memory[0x205] == 0xBB);
     REQUIRE(ch8.memory[0x206] == 0);
  }
+
+TEST_CASE("rom analysis"," "){
+    // control flow graph and code/data map of a small ROM which uses every kind of branch
+    std::vector<unsigned char> rom = {
+            0x60, 0x00, // 0x200 LD V0,0x00
+            0x30, 0x01, // 0x202 SE V0,0x01
+            0x12, 0x08, // 0x204 JP 0x208
+            0x22, 0x0C, // 0x206 CALL 0x20C
+            0xB0, 0x00, // 0x208 JP V0,0x000
+            0xAB, 0xCD, // 0x20A data
+            0x00, 0xEE  // 0x20C RET
+    };
+    std::shared_ptr<const rom_analysis> cached = analyze_rom(rom.data(),rom.size());
+    const rom_analysis &analysis = *cached;
+    REQUIRE(analysis.blocks.size() == 5);
+    REQUIRE(analysis.blocks[0].start == 0x200);
+    REQUIRE(analysis.blocks[0].end == 0x202);
+    REQUIRE(analysis.blocks[0].successors == std::vector<unsigned short>{0x204,0x206});
+    REQUIRE(analysis.blocks[1].successors == std::vector<unsigned short>{0x208});
+    REQUIRE(analysis.blocks[2].successors == std::vector<unsigned short>{0x20C,0x208});
+    REQUIRE(analysis.blocks[3].computed_jump);
+    REQUIRE(analysis.blocks[4].returns);
+    REQUIRE(analysis.computed_jumps == std::vector<unsigned short>{0x208});
+    REQUIRE(analysis.subroutines == std::vector<unsigned short>{0x20C});
+    REQUIRE(analysis.is_code(0x208));
+    REQUIRE(analysis.map[0x20A] == rom_analysis::data);
+    REQUIRE(analysis.map[0x20B] == rom_analysis::data);
+    REQUIRE(analysis.block_at(0x202) == &analysis.blocks[0]);
+    REQUIRE(analysis.block_at(0x20A) == nullptr);
+    // the second call is served from the cache, a ROM with other bytes is analyzed on its own
+    REQUIRE(analyze_rom(rom.data(),rom.size()) == cached);
+    std::vector<unsigned char> other = rom;
+    other[0xA] = 0xEF;
+    REQUIRE(analyze_rom(other.data(),other.size()) != cached);
+    REQUIRE(analyze_rom(rom.data(),rom.size()-2) != cached);
+    // the cache is bounded, evicted results stay valid while they are referenced
+    for(size_t i = 0; i <= analysis_cache_size; ++i){
+        std::vector<unsigned char> filler = {0x60, (unsigned char)i, 0x61, (unsigned char)(i >> 8), 0x12, 0x04};
+        analyze_rom(filler.data(),filler.size());
+    }
+    REQUIRE(analysis.blocks.size() == 5);
+    REQUIRE(analyze_rom(rom.data(),rom.size()) != cached);
+
+    char mnemonic[16];
+    disassemble(0xD125,mnemonic,sizeof(mnemonic));
+    REQUIRE(std::string(mnemonic) == "DRW V1,V2,5");
+    disassemble(0xABCD,mnemonic,sizeof(mnemonic));
+    REQUIRE(std::string(mnemonic) == "LD I,0xBCD");
+}
+
+TEST_CASE("load program from bytes"," "){
+    chip8 ch8;
+    unsigned char rom[] = {0x12, 0x34, 0xAB};
+    ch8.load_program(rom,sizeof(rom));
+    REQUIRE(ch8.PC == 0x200);
+    REQUIRE(ch8.program_size == 3);
+    REQUIRE(ch8.memory[0x200] == 0x12);
+    REQUIRE(ch8.memory[0x202] == 0xAB);
+    REQUIRE(ch8.memory[0x203] == 0);
+}
+
+TEST_CASE("state digest"," "){
+    // the digest only depends on the machine state
+    chip8 a, b;
+    REQUIRE(a.digest() == b.digest());
+    a.VF[3] = 1;
+    REQUIRE(a.digest() != b.digest());
+    b.VF[3] = 1;
+    REQUIRE(a.digest() == b.digest());
+    b.memory[0xFFF] = 1;
+    REQUIRE(a.digest() != b.digest());
+}
+
+TEST_CASE("breakpoints","[debugger]"){
+    // the instruction at a breakpoint is not executed until the debugger resumes
+    chip8 ch8;
+    std::vector<uint16_t> data = {0x6001, 0x6102, 0x1200};
+    ch8.load_program(data);
+    debugger dbg(ch8);
+    REQUIRE(ch8.armed_debugger == nullptr);
+    dbg.add_breakpoint(0x202);
+    REQUIRE(ch8.armed_debugger == &dbg);
+    ch8.cycle();
+    ch8.cycle();
+    REQUIRE(ch8.PC == 0x202);
+    REQUIRE(dbg.reason() == debugger::breakpoint);
+    REQUIRE(ch8.VF[1] == 0);
+    dbg.resume();
+    ch8.cycle();
+    REQUIRE(ch8.PC == 0x204);
+    REQUIRE(ch8.VF[1] == 2);
+    dbg.remove_breakpoint(0x202);
+    REQUIRE(ch8.armed_debugger == nullptr);
+
+    // only the instructions before the breakpoint count as executed
+    for(chip8::timing_model timing : {chip8::fixed_rate, chip8::cosmac_vip}){
+        chip8 frame;
+        frame.timing = timing;
+        frame.load_program(data);
+        debugger stop(frame);
+        stop.add_breakpoint(0x202);
+        REQUIRE_FALSE(frame.run_frame());
+        REQUIRE(stop.reason() == debugger::breakpoint);
+        REQUIRE(frame.instructions_executed == 1);
+    }
+}
+
+TEST_CASE("conditional breakpoints","[debugger]"){
+    chip8 ch8;
+    std::vector<uint16_t> data = {0x7001, 0x1200};
+    ch8.load_program(data);
+    debugger dbg(ch8);
+    dbg.add_condition(debugger::anywhere,0,debugger::equal,5);
+    for(int i = 0; i < 100 && dbg.reason() == debugger::none; ++i)
+        ch8.cycle();
+    REQUIRE(dbg.reason() == debugger::condition);
+    REQUIRE(ch8.VF[0] == 5);
+}
+
+TEST_CASE("watchpoints","[debugger]"){
+    chip8 ch8;
+    // FX33 writes to I, I+1 and I+2
+    std::vector<uint16_t> data = {0xA300, 0xF033, 0xA400, 0xF165, 0x1200};
+    ch8.load_program(data);
+    debugger dbg(ch8);
+    dbg.add_watchpoint(0x302,0x303,false,true);
+    dbg.add_watchpoint(0x401,0x410,true,false);
+    ch8.cycle();
+    ch8.cycle();
+    REQUIRE(dbg.reason() == debugger::write);
+    REQUIRE(dbg.stop_pc() == 0x202);
+    REQUIRE(dbg.stop_address() == 0x302);
+    dbg.resume();
+    ch8.cycle();
+    ch8.cycle();
+    ch8.cycle();
+    REQUIRE(dbg.reason() == debugger::read);
+    REQUIRE(dbg.stop_address() == 0x401);
+
+    // FX55 from I = 0xFFF wraps around and writes 0x000 to 0x002
+    chip8 wrap;
+    std::vector<uint16_t> store = {0xAFFF, 0xF355, 0x1200};
+    wrap.load_program(store);
+    debugger wrapped(wrap);
+    wrapped.add_watchpoint(0x000,0x010,false,true);
+    wrap.cycle();
+    wrap.cycle();
+    REQUIRE(wrapped.reason() == debugger::write);
+    REQUIRE(wrapped.stop_address() == 0x000);
+}
+
+TEST_CASE("opcode 00E0", "[opcodes] [decode]"){
+    // 00E0 clears the display
+    unsigned short PC{0};
+    unsigned short opcode = 0xD005;
+    chip8 ch8(PC,opcode);
+    ch8.decode();
+    ch8.opcode = 0x00E0;
+    ch8.decode();
+    REQUIRE(ch8.PC == 4);
+    for(int i = 0; i < chip8::width*chip8::height; ++i)
+        REQUIRE(ch8.framebuffer()[i] == 0);
+}
+
+TEST_CASE("opcode DXYN", "[opcodes] [decode]"){
+    // DXYN draws a sprite at (VX, VY). VF is set to 1 if a pixel is turned off
+    unsigned short PC{0};
+    unsigned short opcode = 0xD015;
+    chip8 ch8(PC,opcode);
+    // the sprite of 0
+    ch8.I = 0;
+    ch8.VF[0] = 62;
+    ch8.VF[1] = 1;
+    ch8.decode();
+    REQUIRE(ch8.PC == 2);
+    REQUIRE(ch8.VF[0xF] == 0);
+    // 0xF0 at the right edge, the sprite is clipped
+    REQUIRE(ch8.framebuffer()[1*64+62] == 1);
+    REQUIRE(ch8.framebuffer()[1*64+63] == 1);
+    REQUIRE(ch8.framebuffer()[2*64+0] == 0);
+    // 0x90
+    REQUIRE(ch8.framebuffer()[2*64+62] == 1);
+    REQUIRE(ch8.framebuffer()[2*64+63] == 0);
+    ch8.decode();
+    REQUIRE(ch8.VF[0xF] == 1);
+    REQUIRE(ch8.framebuffer()[1*64+62] == 0);
+    // the start position wraps around
+    ch8.VF[0] = 64+8;
+    ch8.decode();
+    REQUIRE(ch8.framebuffer()[1*64+8] == 1);
+}
+
+TEST_CASE("run frame"," "){
+    // a frame executes instructions_per_frame instructions and counts the timers down
+    chip8 ch8;
+    std::vector<uint16_t> data = {0x7001, 0x1200};
+    ch8.load_program(data);
+    ch8.delay_timer = 2;
+    ch8.sound_timer = 1;
+    ch8.instructions_per_frame = 10;
+    REQUIRE(ch8.run_frame());
+    REQUIRE(ch8.VF[0] == 5);
+    REQUIRE(ch8.delay_timer == 1);
+    REQUIRE(ch8.sound_timer == 0);
+}
+
+TEST_CASE("vip timing"," "){
+    chip8 ch8;
+    // sprites cost more per row if they are not aligned to a byte
+    ch8.VF[0] = 8;
+    REQUIRE(ch8.vip_cycles(0xD005) == 40+26+5*22);
+    ch8.VF[0] = 3;
+    REQUIRE(ch8.vip_cycles(0xD005) == 40+26+5*34);
+    REQUIRE(ch8.vip_cycles(0xD00F) > ch8.vip_cycles(0xD005));
+
+    // 7001 and 1200 take 102 cycles together, the frame ends after 3668 cycles and the overrun is taken from the
+    // next frame
+    std::vector<uint16_t> data = {0x7001, 0x1200};
+    ch8.load_program(data);
+    ch8.VF[0] = 0;
+    ch8.timing = chip8::cosmac_vip;
+    ch8.delay_timer = 2;
+    REQUIRE(ch8.run_frame());
+    REQUIRE(ch8.VF[0] == 36);
+    REQUIRE(ch8.machine_cycles == 36*102);
+    REQUIRE(ch8.delay_timer == 1);
+    REQUIRE(ch8.run_frame());
+    REQUIRE(ch8.VF[0] == 72);
+
+    // DXYN waits for the next frame
+    data = {0x6001, 0xD015, 0x1202};
+    ch8.load_program(data);
+    REQUIRE(ch8.run_frame());
+    REQUIRE(ch8.PC == 0x202);
+    REQUIRE(ch8.machine_cycles == 46);
+    REQUIRE(ch8.run_frame());
+    REQUIRE(ch8.PC == 0x202);
+    REQUIRE(ch8.machine_cycles == 46+236+52);
+
+    // a taken skip costs 4 cycles more
+    data = {0x3000, 0x0000, 0x1200};
+    ch8.load_program(data);
+    ch8.VF[0] = 0;
+    REQUIRE(ch8.run_frame());
+    REQUIRE(ch8.machine_cycles == 35*(50+4+52));
+}
+
+TEST_CASE("2NNN and 00EE"," "){
+    chip8 ch8;
+    // 0x200 calls 0x206, which calls 0x20A, which returns twice
+    std::vector<uint16_t> data = {0x2206, 0x1202, 0x0000, 0x220A, 0x00EE, 0x00EE};
+    ch8.load_program(data);
+    ch8.cycle();
+    REQUIRE(ch8.PC == 0x206);
+    REQUIRE(ch8.SP == 1);
+    REQUIRE(ch8.stack_entry(0) == 0x202);
+    ch8.cycle();
+    REQUIRE(ch8.PC == 0x20A);
+    REQUIRE(ch8.SP == 2);
+    ch8.cycle();
+    REQUIRE(ch8.PC == 0x208);
+    ch8.cycle();
+    REQUIRE(ch8.PC == 0x202);
+    REQUIRE(ch8.SP == 0);
+
+    // returning with an empty stack stops at the 00EE
+    data = {0x00EE};
+    ch8.load_program(data);
+    ch8.cycle();
+    REQUIRE(ch8.PC == 0x200);
+    REQUIRE(std::string(ch8.info_string) == "stack underflow at 0x200");
+
+    // a subroutine which calls itself fills the stack and stops
+    data = {0x2200};
+    ch8.load_program(data);
+    for(int i = 0; i < chip8::stack_size+1; ++i)
+        ch8.cycle();
+    REQUIRE(ch8.SP == chip8::stack_size);
+    REQUIRE(std::string(ch8.info_string) == "stack overflow at 0x200");
+}
+
+TEST_CASE("call profiler"," "){
+    chip8 ch8;
+    // main calls 0x20A twice, which calls 0x210 once per call
+    std::vector<uint16_t> data = {0x220A, 0x220A, 0x1204, 0x0000, 0x0000, 0x6001, 0x2210, 0x00EE, 0x7001,
+                                  0x00EE};
+    ch8.load_program(data);
+    call_profiler profiler(ch8);
+    REQUIRE(ch8.profiler == &profiler);
+    for(int i = 0; i < 13; ++i)
+        ch8.cycle();
+    // main: 220A, 220A, 1204  0x20A: 6001, 2210, 00EE twice  0x210: 7001, 00EE twice
+    REQUIRE(profiler.total() == 13);
+
+    std::vector<call_profiler::routine> routines = profiler.routines();
+    REQUIRE(routines.size() == 3);
+    REQUIRE(routines[0].address == 0x200);
+    REQUIRE(routines[0].inclusive == 13);
+    REQUIRE(routines[0].exclusive == 3);
+    REQUIRE(routines[1].address == 0x20A);
+    REQUIRE(routines[1].calls == 2);
+    REQUIRE(routines[1].inclusive == 10);
+    REQUIRE(routines[1].exclusive == 6);
+    REQUIRE(routines[2].address == 0x210);
+    REQUIRE(routines[2].inclusive == 4);
+
+    std::ostringstream collapsed;
+    profiler.write_collapsed(collapsed);
+    REQUIRE(collapsed.str() == "0x200 3\n0x200;0x20a 6\n0x200;0x20a;0x210 4\n");
+}
+
+TEST_CASE("state layout"," "){
+    // the registers share the first cache line, memory and display make up most of the rest
+    REQUIRE(alignof(chip8) == 64);
+    REQUIRE(sizeof(chip8) < 0x1000+chip8::width*chip8::height+512);
+    std::unique_ptr<chip8> ch8(new chip8);
+    REQUIRE(reinterpret_cast<uintptr_t>(ch8.get())%64 == 0);
+    const char *base = reinterpret_cast<const char *>(ch8.get());
+    REQUIRE(reinterpret_cast<const char *>(&ch8->profiler)+sizeof(ch8->profiler)-base <= 64);
+    REQUIRE(std::equal(std::begin(chip8::fonts),std::end(chip8::fonts),ch8->memory));
+
+    // the same seed gives the same random numbers
+    chip8 a, b;
+    a.seed(42);
+    b.seed(42);
+    for(int i = 0; i < 100; ++i)
+        REQUIRE(a.random_256() == b.random_256());
+}
+
+TEST_CASE("run ahead"," "){
+    // draws the font sprite of V0 at a new position every frame
+    std::vector<uint16_t> data = {0x7001, 0xF029, 0xD005, 0x1200};
+    chip8 real, plain;
+    real.instructions_per_frame = plain.instructions_per_frame = 4;
+    real.load_program(data);
+    plain.load_program(data);
+
+    run_ahead ahead(3);
+    for(int frame = 0; frame < 10; ++frame){
+        bool completed;
+        const unsigned char *presented = ahead.frame(real,completed);
+        REQUIRE(completed);
+        plain.run_frame();
+        // the real machine is not affected by the frames which were emulated ahead
+        REQUIRE(real.digest() == plain.digest());
+
+        chip8 future = plain;
+        for(int i = 0; i < 3; ++i)
+            future.run_frame();
+        REQUIRE(std::equal(presented,presented+chip8::width*chip8::height,future.framebuffer()));
+    }
+    REQUIRE(ahead.stats().frames == 10);
+
+    // without frames ahead, the real display is presented
+    ahead.set_frames(0);
+    bool completed;
+    REQUIRE(ahead.frame(real,completed) == real.framebuffer());
+}
+
+TEST_CASE("triple buffer"," "){
+    triple_buffer<int> buffer;
+    REQUIRE_FALSE(buffer.update());
+    buffer.back() = 1;
+    buffer.publish();
+    buffer.back() = 2;
+    buffer.publish();
+    // the reader only sees the latest buffer
+    REQUIRE(buffer.update());
+    REQUIRE(buffer.front() == 2);
+    REQUIRE_FALSE(buffer.update());
+}
+
+TEST_CASE("spsc ring"," "){
+    spsc_ring<int,4> ring;
+    for(int i = 0; i < 4; ++i)
+        REQUIRE(ring.push(i));
+    REQUIRE_FALSE(ring.push(4));
+    int value;
+    REQUIRE(ring.pop(value));
+    REQUIRE(value == 0);
+    REQUIRE(ring.size() == 3);
+}
+
+TEST_CASE("emulator thread"," "){
+    // frames are published while the emulation runs on its own thread
+    chip8 ch8;
+    std::vector<uint16_t> data = {0x7001, 0x1200};
+    ch8.load_program(data);
+    emulator_thread emulator(ch8);
+    emulator.set_turbo(true);
+    emulator.send_key(0xA,true);
+    emulator.start();
+    while(!emulator.update_frame())
+        std::this_thread::yield();
+    emulator.stop();
+    REQUIRE(emulator.latest_frame().number > 0);
+    REQUIRE(ch8.key[0xA]);
+}
+
+TEST_CASE("shared memory framebuffer"," "){
+    shm_writer writer;
+    REQUIRE(writer.open("/chip8_test_framebuffer"));
+    shm_reader reader;
+    REQUIRE(reader.open("/chip8_test_framebuffer"));
+
+    unsigned char pixels[chip8::width*chip8::height] {0};
+    pixels[3] = 1;
+    writer.publish(pixels,42);
+
+    unsigned char copy[chip8::width*chip8::height] {0};
+    uint64_t frame = 0;
+    REQUIRE(reader.read(copy,frame));
+    REQUIRE(frame == 42);
+    REQUIRE(copy[3] == 1);
+    REQUIRE_FALSE(reader.open("/chip8_test_missing"));
+}
+
+TEST_CASE("frame capture"," "){
+    // identical consecutive frames are stored once with a repeat count
+    std::string path = "chip8_test_capture.y4m";
+    frame_capture capture;
+    REQUIRE(capture.open(path,frame_capture::format_of(path),chip8::width,chip8::height));
+    unsigned char pixels[chip8::width*chip8::height] {0};
+    for(int i = 0; i < 10; ++i)
+        capture.add_frame(pixels);
+    pixels[0] = 1;
+    capture.add_frame(pixels);
+    REQUIRE(capture.close());
+    REQUIRE(capture.frames() == 11);
+    REQUIRE(capture.unique_frames() == 2);
+
+    std::ifstream in(path,std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+    std::remove(path.c_str());
+    std::string header = "YUV4MPEG2 W64 H32 F60:1 Ip A1:1 Cmono\n";
+    REQUIRE(content.compare(0,header.size(),header) == 0);
+    REQUIRE(content.find("FRAME Xrepeat=10\n") == header.size());
+    REQUIRE(content.size() == header.size()+17+2048+6+2048);
+    REQUIRE(capture.bytes_written() == content.size());
+}
+
+TEST_CASE("beeper"," "){
+    // one frame at 48kHz has 800 samples. At the default pitch the square wave has a period of 16 bits at
+    // 4000 bits per second, which is 192 samples
+    beeper tone(48000);
+    std::vector<int16_t> block(tone.samples_per_frame());
+    REQUIRE(tone.render_frame(false,block.data()) == 800);
+    REQUIRE(std::all_of(block.begin(),block.end(),[](int16_t s){ return s == 0; }));
+    REQUIRE(tone.render_frame(true,block.data()) == 800);
+    REQUIRE(block[0] > 0);
+    REQUIRE(block[90] > 0);
+    REQUIRE(block[100] < 0);
+    REQUIRE(block[190] < 0);
+    REQUIRE(block[200] > 0);
+
+    // 44.1kHz does not divide into frames, the fraction is carried over
+    beeper cd(44100);
+    size_t samples = 0;
+    for(int i = 0; i < 60; ++i)
+        samples += cd.render_frame(false,block.data());
+    REQUIRE(samples == 44100);
+}
+
+TEST_CASE("sound timer"," "){
+    // the beeper sounds in every frame in which the sound timer is active
+    chip8 ch8;
+    std::vector<uint16_t> data = {0x6002, 0xF018, 0x1204};
+    ch8.load_program(data);
+    REQUIRE(ch8.run_frame());
+    REQUIRE(ch8.beep);
+    REQUIRE(ch8.sound_timer == 1);
+    REQUIRE(ch8.run_frame());
+    REQUIRE(ch8.beep);
+    REQUIRE(ch8.run_frame());
+    REQUIRE_FALSE(ch8.beep);
+}
+
+TEST_CASE("control server"," "){
+    control_server server;
+    REQUIRE(server.open("/tmp/chip8_test_control.sock"));
+    std::thread thread([&server]{ server.serve(); });
+
+    control_client client;
+    REQUIRE(client.connect("/tmp/chip8_test_control.sock"));
+    control_request request(7);
+    request.create();
+    request.create();
+    std::vector<control_result> results;
+    REQUIRE(client.call(request,results));
+    REQUIRE(results.size() == 2);
+    REQUIRE(results[0].status == control_ok);
+    uint32_t a = results[0].value, b = results[1].value;
+    REQUIRE(a != b);
+
+    // both VMs run the same ROM in one request, the unknown VM fails without affecting the others
+    const unsigned char rom[] = {0x70, 0x01, 0xD0, 0x15, 0x12, 0x00};
+    request.clear(8);
+    for(uint32_t vm : {a, b}){
+        request.load(vm,rom,sizeof(rom));
+        request.step(vm,3);
+        request.digest(vm);
+    }
+    request.step(12345,1);
+    request.framebuffer(a);
+    REQUIRE(client.call(request,results));
+    REQUIRE(results.size() == 8);
+    for(int i = 0; i < 6; ++i)
+        REQUIRE(results[i].status == control_ok);
+    REQUIRE(results[2].op == control_digest);
+    REQUIRE(results[2].value == results[5].value);
+    REQUIRE(results[6].status == control_no_such_vm);
+
+    // the same ROM in a local chip8 gives the same state
+    chip8 ch8;
+    ch8.init();
+    ch8.seed(0);
+    ch8.load_program(rom,sizeof(rom));
+    for(int i = 0; i < 3; ++i)
+        ch8.run_frame();
+    REQUIRE(results[2].value == ch8.digest());
+    for(int i = 0; i < chip8::width*chip8::height; ++i)
+        REQUIRE(((results[7].pixels[i/8] >> (7-i%8)) & 1) == ch8.framebuffer()[i]);
+
+    request.clear(9);
+    request.destroy(a);
+    request.destroy(a);
+    REQUIRE(client.call(request,results));
+    REQUIRE(results[0].status == control_ok);
+    REQUIRE(results[1].status == control_no_such_vm);
+
+    server.stop();
+    thread.join();
+    REQUIRE(server.vm_count() == 1);
+
+    // a truncated command ends the request
+    std::vector<unsigned char> reply;
+    const unsigned char truncated[] = {1, 0, 0, 0, 1, 0, control_step, 2, 0, 0, 0};
+    server.handle(truncated,sizeof(truncated),reply);
+    uint32_t tag;
+    REQUIRE(parse_control_reply(reply.data()+4,reply.size()-4,tag,results));
+    REQUIRE(tag == 1);
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].status == control_bad_request);
+
+    // empty ROMs and ROMs which do not fit into memory are rejected, the commands after them still run
+    std::vector<unsigned char> large(0x1000-0x200+1,0x12);
+    request.clear(10);
+    request.load(b,large.data(),large.size());
+    request.load(b,rom,0);
+    request.load(b,large.data(),large.size()-1);
+    const std::vector<unsigned char> &message = request.message();
+    reply.clear();
+    server.handle(message.data()+4,message.size()-4,reply);
+    REQUIRE(parse_control_reply(reply.data()+4,reply.size()-4,tag,results));
+    REQUIRE(results.size() == 3);
+    REQUIRE(results[0].status == control_bad_request);
+    REQUIRE(results[1].status == control_bad_request);
+    REQUIRE(results[2].status == control_ok);
+
+    // the 16 bit command count does not wrap, a full request refuses more commands
+    request.clear(11);
+    bool appended = true;
+    for(uint32_t i = 0; i < control_max_commands; ++i)
+        appended = request.digest(b) && appended;
+    REQUIRE(appended);
+    size_t full = request.message().size();
+    REQUIRE(!request.step(b,1));
+    REQUIRE(request.commands() == control_max_commands);
+    REQUIRE(request.message().size() == full);
+}
+
+TEST_CASE("FX55 and FX65 include VX"," "){
+    chip8 ch8;
+    ch8.I = 0x300;
+    for(int i = 0; i < 16; ++i)
+        ch8.VF[i] = i+1;
+    ch8.opcode = 0xF255;
+    ch8.decode();
+    REQUIRE(ch8.memory[0x302] == 3);
+    REQUIRE(ch8.memory[0x303] == 0);
+    ch8.VF[0] = 0;
+    ch8.opcode = 0xF065;
+    ch8.decode();
+    REQUIRE(ch8.VF[0] == 1);
+    REQUIRE(ch8.I == 0x300);
+}
+
+TEST_CASE("opcode conformance"," "){
+    // every opcode against the specification, see conformance.h
+    conformance_options options;
+    options.states_per_opcode = 8;
+    conformance_report report = conformance_engine(options).run();
+    REQUIRE(report.cases == 0x10000*8);
+    for(const conformance_failure &failure : report.failures)
+        INFO(conformance_engine::describe(failure));
+    CHECK(report.failed_cases == 0);
+}
+
+TEST_CASE("conformance check"," "){
+    vm_state before;
+    std::memset(&before,0,sizeof(before));
+    before.PC = 0x200;
+    before.V[1] = 0xFF;
+    before.V[2] = 0x02;
+    before.V[7] = 0x55;
+    before.memory[0x400] = 0x12;
+    vm_state expected = before;
+    reference_step(expected,0x8124,0);
+    REQUIRE(expected.V[1] == 0x01);
+    REQUIRE(expected.V[0xF] == 1);
+    REQUIRE(expected.PC == 0x202);
+
+    chip8 ch8;
+    vm_state actual;
+    REQUIRE(conformance_engine::check(ch8,0x8124,before,expected,actual));
+    // FX33 at the end of memory wraps around
+    before.I = 0xFFF;
+    before.V[7] = 123;
+    REQUIRE(conformance_engine::check(ch8,0xF733,before,expected,actual));
+    REQUIRE(actual.memory[0xFFF] == 1);
+    REQUIRE(actual.memory[0x000] == 2);
+    REQUIRE(actual.memory[0x001] == 3);
+}
+
+TEST_CASE("savestate round trip"," "){
+    // draws random sprites, so the display, I, the generator and the timers all change
+    chip8 ch8;
+    ch8.seed(7);
+    ch8.load_program(std::vector<uint16_t>{0xC0FF,0xC13F,0xF015,0xA000,0xD015,0x2210,0x1200,0x0000,0x7201,0x00EE});
+    for(int i = 0; i < 10; ++i)
+        ch8.run_frame();
+    ch8.key[3] = true;
+
+    std::vector<unsigned char> dense, sparse;
+    encode_savestate(ch8,false,dense);
+    encode_savestate(ch8,true,sparse);
+    REQUIRE(dense.size() == savestate_header_size+365+0x1000);
+    // only the fonts and the program are not zero
+    REQUIRE(sparse.size() == savestate_header_size+365+2*savestate_page_size);
+
+    for(const std::vector<unsigned char> *bytes : {&dense,&sparse}){
+        chip8 copy;
+        copy.load_program(std::vector<uint16_t>{0x1234,0x5678});
+        REQUIRE(decode_savestate(bytes->data(),bytes->size(),copy));
+        REQUIRE(copy.digest() == ch8.digest());
+        REQUIRE(copy.key[3]);
+        REQUIRE(!copy.key[2]);
+        // the generator continues where it stopped
+        chip8 original = ch8;
+        for(int i = 0; i < 10; ++i){
+            original.run_frame();
+            copy.run_frame();
+        }
+        REQUIRE(copy.digest() == original.digest());
+    }
+}
+
+TEST_CASE("savestate rejects corrupt data"," "){
+    chip8 ch8;
+    ch8.load_program(std::vector<uint16_t>{0x6005,0x1202});
+    ch8.run_frame();
+    std::vector<unsigned char> bytes;
+    encode_savestate(ch8,true,bytes);
+
+    chip8 other;
+    uint64_t digest = other.digest();
+    std::vector<unsigned char> corrupt = bytes;
+    corrupt[savestate_header_size+100] ^= 1;
+    REQUIRE(!decode_savestate(corrupt.data(),corrupt.size(),other));
+    REQUIRE(std::string(other.info_string) == "savestate checksum mismatch");
+    REQUIRE(!decode_savestate(bytes.data(),bytes.size()-1,other));
+    corrupt = bytes;
+    corrupt[4] = 2;
+    REQUIRE(!decode_savestate(corrupt.data(),corrupt.size(),other));
+    REQUIRE(!decode_savestate(bytes.data(),3,other));
+
+    // fields which pass the checksum but would stall run_frame
+    const size_t payload = savestate_header_size, registers = payload+22;
+    auto resealed = [&](size_t offset, uint64_t value, int width){
+        std::vector<unsigned char> state = bytes;
+        if(width == 4)
+            put32(&state[offset],(uint32_t)value);
+        else
+            put64(&state[offset],value);
+        put64(&state[16],fnv1a_64(&state[payload],state.size()-payload));
+        return state;
+    };
+    REQUIRE(!decode_savestate(resealed(registers+5,0,4).data(),bytes.size(),other));
+    REQUIRE(!decode_savestate(resealed(registers+5,chip8::max_instructions_per_frame+1,4).data(),bytes.size(),other));
+    REQUIRE(!decode_savestate(resealed(registers+17,(uint64_t)-(int64_t(1) << 40),8).data(),bytes.size(),other));
+    REQUIRE(!decode_savestate(resealed(registers+17,chip8::vip_max_cycles,8).data(),bytes.size(),other));
+    REQUIRE(std::string(other.info_string) == "savestate is corrupt");
+    // a failed load leaves the machine as it was
+    REQUIRE(other.digest() == digest);
+    REQUIRE(decode_savestate(resealed(registers+17,chip8::vip_max_cycles-1,8).data(),bytes.size(),other));
+}
+
+TEST_CASE("savestate file"," "){
+    chip8 ch8;
+    ch8.timing = chip8::cosmac_vip;
+    ch8.load_program(std::vector<uint16_t>{0x7001,0x1200});
+    ch8.run_frame();
+    std::string path = "savestate_test.c8s";
+    REQUIRE(save_savestate(ch8,path));
+
+    chip8 copy;
+    REQUIRE(load_savestate(copy,path));
+    REQUIRE(copy.digest() == ch8.digest());
+    REQUIRE(copy.timing == chip8::cosmac_vip);
+    REQUIRE(copy.machine_cycles == ch8.machine_cycles);
+    std::remove(path.c_str());
+    REQUIRE(!load_savestate(copy,path));
+}
+
+TEST_CASE("rom pack"," "){
+    // CLS, V0 = random, skip if key V0 is up, restart, jump to itself, data
+    const unsigned char a[] = {0x00,0xE0,0xC0,0x0F,0xE0,0xA1,0x12,0x00,0x12,0x08,0xAA,0xBB};
+    // 8XY6 and SUPER-CHIP scroll
+    const unsigned char b[] = {0x81,0x26,0x00,0xFB,0x12,0x00};
+    std::vector<unsigned char> large(0xE01,0);
+
+    rom_pack_builder builder;
+    REQUIRE(builder.add(a,sizeof(a),"a.ch8") == rom_pack_builder::added);
+    REQUIRE(builder.add(b,sizeof(b),"b.ch8") == rom_pack_builder::added);
+    REQUIRE(builder.add(a,sizeof(a),"copy of a.ch8") == rom_pack_builder::duplicate);
+    REQUIRE(builder.add(large.data(),large.size(),"large.ch8") == rom_pack_builder::too_large);
+    REQUIRE(builder.add(a,0,"empty.ch8") == rom_pack_builder::empty);
+    REQUIRE(builder.roms() == 2);
+
+    std::vector<unsigned char> bytes;
+    builder.encode(bytes);
+    rom_pack pack;
+    REQUIRE(pack.open(bytes.data(),bytes.size()));
+    REQUIRE(pack.size() == 2);
+    // sorted by hash
+    REQUIRE(pack.at(0).metadata.hash < pack.at(1).metadata.hash);
+
+    rom_pack::rom r;
+    REQUIRE(pack.find(fnv1a_64(a,sizeof(a)),r));
+    REQUIRE(r.size == sizeof(a));
+    REQUIRE(std::memcmp(r.data,a,sizeof(a)) == 0);
+    REQUIRE(std::string(r.name) == "a.ch8");
+    REQUIRE(r.duplicates == 1);
+    REQUIRE(r.metadata.code_bytes == 10);
+    REQUIRE(r.metadata.data_bytes == 2);
+    REQUIRE(r.metadata.flags == (rom_random | rom_input));
+    REQUIRE(r.metadata.histogram[0x0] == 1);
+    REQUIRE(r.metadata.histogram[0xC] == 1);
+    REQUIRE(r.metadata.histogram[0xE] == 1);
+    REQUIRE(r.metadata.histogram[0x1] == 2);
+
+    REQUIRE(pack.find(fnv1a_64(b,sizeof(b)),r));
+    REQUIRE(r.metadata.flags == (rom_superchip | rom_quirk_shift));
+    REQUIRE(!pack.find(1234,r));
+
+    chip8 ch8;
+    size_t index = pack.at(0).size == sizeof(a) ? 0 : 1;
+    REQUIRE(pack.load(index,ch8));
+    REQUIRE(ch8.program_size == sizeof(a));
+    REQUIRE(std::memcmp(&ch8.memory[0x200],a,sizeof(a)) == 0);
+
+    // a damaged ROM is found when it is loaded, damaged metadata when the pack is opened
+    std::vector<unsigned char> damaged = bytes;
+    damaged[pack.at(index).data-bytes.data()] ^= 1;
+    rom_pack other;
+    REQUIRE(other.open(damaged.data(),damaged.size()));
+    REQUIRE(!other.load(index,ch8));
+    damaged = bytes;
+    damaged[rom_pack_header_size+14] ^= 1;
+    REQUIRE(!other.open(damaged.data(),damaged.size()));
+    REQUIRE(other.error() == "ROM pack checksum mismatch");
+    REQUIRE(!other.open(bytes.data(),bytes.size()-1));
+}
+
+TEST_CASE("terminal renderer"," "){
+    unsigned char pixels[chip8::width*chip8::height] {0};
+    terminal_renderer half(terminal_renderer::half_block);
+    REQUIRE(half.columns() == 64);
+    REQUIRE(half.rows() == 16);
+
+    // the first frame draws every cell, one cursor move per row
+    std::string first = half.render(pixels);
+    REQUIRE(first.size() == 2+9*6+7*7+16*64+2);
+    REQUIRE(half.render(pixels).empty());
+
+    // upper pixel of cell 3,1 and both pixels of cell 4,1
+    pixels[2*chip8::width+3] = 1;
+    pixels[2*chip8::width+4] = 1;
+    pixels[3*chip8::width+4] = 1;
+    REQUIRE(half.render(pixels) == "\x1b" "7\x1b[2;4H\xe2\x96\x80\xe2\x96\x88\x1b" "8");
+    // a short gap of unchanged cells is repeated, a long one is skipped
+    pixels[2*chip8::width+3] = 0;
+    pixels[2*chip8::width+6] = 1;
+    pixels[2*chip8::width+30] = 1;
+    REQUIRE(half.render(pixels) == "\x1b" "7\x1b[2;4H \xe2\x96\x88 \xe2\x96\x80\x1b[23C\xe2\x96\x80\x1b" "8");
+
+    half.invalidate();
+    REQUIRE(half.render(pixels).size() > 64*16);
+
+    // 128x64 fits into 64x16 braille cells
+    std::vector<unsigned char> large(128*64,0);
+    terminal_renderer dots(terminal_renderer::braille,128,64,5,10);
+    REQUIRE(dots.columns() == 64);
+    REQUIRE(dots.rows() == 16);
+    dots.render(large.data());
+    // left column of dots and the bottom right dot of cell 0,0
+    large[0] = large[128] = large[2*128] = large[3*128] = large[3*128+1] = 1;
+    REQUIRE(dots.render(large.data()) == "\x1b" "7\x1b[5;10H\xe2\xa3\x87\x1b" "8");
+    REQUIRE(dots.frames() == 2);
+}
+
+TEST_CASE("perf counters"," "){
+    // works with and without hardware counters
+    perf_counters counters;
+    counters.start();
+    chip8 ch8;
+    ch8.load_program(std::vector<uint16_t>{0x7001,0x1200});
+    for(int i = 0; i < 100; ++i)
+        ch8.run_frame();
+    perf_counters::sample sample = counters.stop();
+    REQUIRE(sample.seconds > 0);
+    if(counters.available() && sample.valid[perf_counters::instructions])
+        CHECK(sample.value[perf_counters::instructions] > 1000);
+
+    perf_counters::sample fake;
+    fake.seconds = 0.5;
+    std::string report = perf_report(fake,1000);
+    REQUIRE(report.find("not available") != std::string::npos);
+    REQUIRE(report.find("500000.000 ns per emulated instruction") != std::string::npos);
+    fake.valid[perf_counters::instructions] = fake.valid[perf_counters::cycles] = true;
+    fake.value[perf_counters::instructions] = 3000;
+    fake.value[perf_counters::cycles] = 2000;
+    report = perf_report(fake,1000);
+    REQUIRE(report.find("not available") == std::string::npos);
+    REQUIRE(report.find("3.000 per emulated instruction") != std::string::npos);
+    REQUIRE(report.find("IPC 1.50") != std::string::npos);
+}
+
+TEST_CASE("metrics"," "){
+    chip8 ch8;
+    // 0x9XY1 is unknown and leaves PC where it is
+    ch8.load_program(std::vector<uint16_t>{0x9121});
+    ch8.run_frame();
+    REQUIRE(ch8.instructions_executed == 10);
+    REQUIRE(ch8.unknown_opcodes == 10);
+    ch8.load_program(std::vector<uint16_t>{0x8FFF});
+    ch8.run_frame();
+    REQUIRE(ch8.unknown_opcodes == 20);
+    ch8.timing = chip8::cosmac_vip;
+    uint64_t before = ch8.instructions_executed;
+    ch8.run_frame();
+    REQUIRE(ch8.instructions_executed > before);
+
+    metrics_registry registry;
+    thread_metrics &m = registry.add("vm0");
+    m.record_frames(2,20,3,std::chrono::microseconds(600));
+    m.record_frames(1,10,0,std::chrono::milliseconds(20));
+    m.record_idle(7);
+    std::string text = registry.prometheus_text();
+    REQUIRE(text.find("# TYPE chip8_instructions_total counter\nchip8_instructions_total{thread=\"vm0\"} 30\n")
+            != std::string::npos);
+    REQUIRE(text.find("chip8_frames_total{thread=\"vm0\"} 3\n") != std::string::npos);
+    REQUIRE(text.find("chip8_idle_instructions_total{thread=\"vm0\"} 7\n") != std::string::npos);
+    REQUIRE(text.find("chip8_unknown_opcodes_total{thread=\"vm0\"} 3\n") != std::string::npos);
+    // 300us per frame for the first batch, 20ms for the second
+    REQUIRE(text.find("chip8_frame_seconds_bucket{thread=\"vm0\",le=\"0.0001\"} 0\n") != std::string::npos);
+    REQUIRE(text.find("chip8_frame_seconds_bucket{thread=\"vm0\",le=\"0.001\"} 2\n") != std::string::npos);
+    REQUIRE(text.find("chip8_frame_seconds_bucket{thread=\"vm0\",le=\"0.05\"} 3\n") != std::string::npos);
+    REQUIRE(text.find("chip8_frame_seconds_bucket{thread=\"vm0\",le=\"+Inf\"} 3\n") != std::string::npos);
+    REQUIRE(text.find("chip8_frame_seconds_count{thread=\"vm0\"} 3\n") != std::string::npos);
+
+    // counters past 10 digits are not rounded
+    m.record_frames(1,12345678901234ull,0,std::chrono::microseconds(1));
+    text = registry.prometheus_text();
+    REQUIRE(text.find("chip8_instructions_total{thread=\"vm0\"} 12345678901264\n") != std::string::npos);
+
+    std::string path = "metrics_test.prom";
+    REQUIRE(registry.write_file(path));
+    std::ifstream file(path);
+    std::string first;
+    std::getline(file,first);
+    REQUIRE(first == "# HELP chip8_instructions_total Instructions executed.");
+    std::remove(path.c_str());
+}
+
+TEST_CASE("halt detection"," "){
+    // sets the delay timer, then jumps to itself. The halt is only final once the timer ran out
+    chip8 ch8;
+    ch8.load_program(std::vector<uint16_t>{0x6005,0xF015,0x1204});
+    halt_detector halts;
+    uint64_t frame = 0;
+    while(!halts.check(ch8,frame) && frame < 100){
+        ch8.run_frame();
+        ++frame;
+    }
+    REQUIRE(halts.info().reason == halt_detector::self_jump);
+    REQUIRE(halts.info().frame == 5);
+    REQUIRE(ch8.delay_timer == 0);
+    // counted at the end of the frame, not where the self jump was reached
+    REQUIRE(halts.info().frame_instructions == 5*ch8.instructions_per_frame);
+
+    // draws the same sprite over and over, the display alternates every frame
+    auto run = [](chip8 &vm, halt_detector &detector, uint64_t frames){
+        for(uint64_t frame = 1; frame <= frames; ++frame){
+            vm.run_frame();
+            if(detector.check(vm,frame))
+                return true;
+        }
+        return false;
+    };
+    chip8 blink;
+    blink.load_program(std::vector<uint16_t>{0xA000,0xD015,0x1202});
+    halt_detector every_frame(1);
+    REQUIRE(run(blink,every_frame,100));
+    REQUIRE(every_frame.info().reason == halt_detector::repeated_state);
+    REQUIRE(every_frame.info().period == 2);
+    REQUIRE(every_frame.info().frame == 1);
+
+    // V0 counts up by 5 per frame, the state repeats after 256 frames
+    chip8 counter;
+    counter.load_program(std::vector<uint16_t>{0x7001,0x1200});
+    halt_detector long_history(1,300);
+    REQUIRE(run(counter,long_history,1000));
+    REQUIRE(long_history.info().period == 256);
+    // with a short history the loop is not found
+    counter.load_program(std::vector<uint16_t>{0x7001,0x1200});
+    halt_detector short_history(1,100);
+    REQUIRE(!run(counter,short_history,1000));
+
+    // the random numbers never repeat
+    chip8 noise;
+    noise.seed(3);
+    noise.load_program(std::vector<uint16_t>{0xC0FF,0x1200});
+    halt_detector random(1);
+    REQUIRE(!run(noise,random,500));
+}
+
+TEST_CASE("frame cache"," "){
+    // a subroutine stores V0 as BCD and draws it at (V0,0). V0 counts up while key 0 is released
+    std::vector<uint16_t> rom(8,0);
+    rom[0] = 0x2210; rom[1] = 0xE09E; rom[2] = 0x7001; rom[3] = 0x1200;
+    rom.insert(rom.end(),{0xA300,0xF033,0xD015,0x00EE});
+    auto run = [&rom](frame_cache &cache, unsigned int frames){
+        chip8 cached, emulated;
+        cached.load_program(rom);
+        emulated.load_program(rom);
+        cached.seed(1);
+        emulated.seed(1);
+        for(unsigned int frame = 0; frame < frames; ++frame){
+            cached.key[0] = emulated.key[0] = frame/50%2 == 1;
+            REQUIRE(cache.run_frame(cached));
+            emulated.run_frame();
+            if(!cached.same_state(emulated) || cached.instructions_executed != emulated.instructions_executed)
+                return false;
+        }
+        return true;
+    };
+
+    frame_cache cache;
+    REQUIRE(run(cache,2000));
+    REQUIRE(cache.stats().lookups == 2000);
+    REQUIRE(cache.hit_rate() > 0.3);
+    REQUIRE(cache.stats().evictions == 0);
+    // a second machine replays everything
+    uint64_t misses = cache.stats().lookups-cache.stats().hits;
+    REQUIRE(run(cache,2000));
+    REQUIRE(cache.stats().lookups-cache.stats().hits == misses);
+
+    frame_cache verified;
+    verified.set_verify(1);
+    REQUIRE(run(verified,2000));
+    REQUIRE(verified.stats().verified == verified.stats().hits);
+    REQUIRE(verified.stats().mismatches == 0);
+
+    // a small budget evicts, the results stay right
+    frame_cache small(8192);
+    REQUIRE(run(small,2000));
+    REQUIRE(small.stats().evictions > 0);
+    REQUIRE(small.bytes() <= 8192);
+    REQUIRE(small.hit_rate() < cache.hit_rate());
+    small.clear();
+    REQUIRE(small.entries() == 0);
+    REQUIRE(small.bytes() == 0);
+
+    // the profiler has to see every instruction
+    chip8 profiled;
+    profiled.load_program(rom);
+    call_profiler profiler(profiled);
+    frame_cache bypass;
+    for(int frame = 0; frame < 10; ++frame)
+        bypass.run_frame(profiled);
+    REQUIRE(bypass.stats().bypassed == 10);
+    REQUIRE(bypass.entries() == 0);
+}
+
+TEST_CASE("vector environment"," "){
+    // V2 counts up while key 1 is pressed and is stored as BCD at 0x300. At 50 the ROM jumps to itself
+    const unsigned char counter[] = {0x61,0x01,0x62,0x00,0xA3,0x00,0xE1,0xA1,0x72,0x01,0xF2,0x33,0x32,0x32,0x12,0x04,
+                                     0x12,0x10};
+    vector_env_options options;
+    options.envs = 3;
+    options.threads = 2;
+    options.score = vector_env_options::score_bcd;
+    options.score_address = 0x300;
+    vector_env env(counter,sizeof(counter),options);
+    REQUIRE(env.size() == 3);
+    uint64_t seeds[] = {1,2,3};
+    std::vector<unsigned char> observations(3*vector_env::observation_size,1);
+    env.reset(seeds,observations.data());
+    REQUIRE(std::count(observations.begin(),observations.end(),0) == (long)observations.size());
+
+    uint16_t actions[] = {1 << 1,0,1 << 2};
+    float rewards[3];
+    unsigned char dones[3];
+    float total = 0;
+    int steps = 0;
+    do{
+        env.step(actions,observations.data(),rewards,dones);
+        total += rewards[0];
+        REQUIRE(rewards[1] == 0);
+        REQUIRE(rewards[2] == 0);
+        REQUIRE(!dones[1]);
+        ++steps;
+    }while(!dones[0] && steps < 100);
+    REQUIRE(dones[0]);
+    REQUIRE(total == 50);
+    REQUIRE(env.episodes() == 1);
+    // the next step starts a new episode
+    env.step(actions,observations.data(),rewards,dones);
+    REQUIRE(rewards[0] > 0);
+    REQUIRE(rewards[0] < 50);
+    REQUIRE(!dones[0]);
+
+    // episodes end after max_episode_frames
+    options.envs = 1;
+    options.threads = 1;
+    options.max_episode_frames = 8;
+    vector_env limited(counter,sizeof(counter),options);
+    limited.reset(seeds,nullptr);
+    limited.step(actions+1,observations.data(),rewards,dones);
+    REQUIRE(!dones[0]);
+    limited.step(actions+1,observations.data(),rewards,dones);
+    REQUIRE(dones[0]);
+
+    // draws the 0 of the font at random positions. The observations do not depend on the threads
+    const unsigned char noise[] = {0xC0,0x3F,0xC1,0x1F,0xA0,0x00,0xD0,0x15,0x12,0x00};
+    vector_env_options random_options;
+    random_options.envs = 5;
+    vector_env single(noise,sizeof(noise),random_options);
+    random_options.threads = 4;
+    vector_env threaded(noise,sizeof(noise),random_options);
+    uint64_t random_seeds[] = {1,2,3,4,5};
+    uint16_t no_keys[5] = {0};
+    float more_rewards[5];
+    unsigned char more_dones[5];
+    std::vector<unsigned char> a(5*vector_env::observation_size), b(a.size());
+    single.reset(random_seeds,a.data());
+    threaded.reset(random_seeds,b.data());
+    for(int step = 0; step < 20; ++step){
+        single.step(no_keys,a.data(),more_rewards,more_dones);
+        threaded.step(no_keys,b.data(),more_rewards,more_dones);
+        REQUIRE(a == b);
+        REQUIRE(single.env(4).same_state(threaded.env(4)));
+    }
+    REQUIRE(std::memcmp(a.data(),a.data()+vector_env::observation_size,vector_env::observation_size) != 0);
+    // the observation is the OR of the last two frames
+    chip8 last = single.env(2);
+    const unsigned char *pixels = last.framebuffer();
+    const unsigned char *observation = a.data()+2*vector_env::observation_size;
+    for(size_t p = 0; p < vector_env::observation_size; ++p)
+        REQUIRE(observation[p] >= pixels[p]);
+}
+
+TEST_CASE("golden store"," "){
+    // V0 moves a sprite one pixel per instruction and never halts
+    const unsigned char moving[] = {0x70,0x01,0xA0,0x00,0xD0,0x15,0x12,0x00};
+    // sets the delay timer, then jumps to itself
+    const unsigned char waiting[] = {0x60,0x30,0xF0,0x15,0x12,0x04};
+    const unsigned char unknown[] = {0x12,0x00,0x00,0x01};
+    golden_options options;
+    options.frames = 300;
+    options.interval = 50;
+    golden_builder builder(options);
+    REQUIRE(builder.add(moving,sizeof(moving)) == golden_builder::added);
+    REQUIRE(builder.add(waiting,sizeof(waiting)) == golden_builder::added);
+    REQUIRE(builder.add(moving,sizeof(moving)) == golden_builder::duplicate);
+    REQUIRE(builder.add(moving,0) == golden_builder::rejected);
+    REQUIRE(builder.roms() == 2);
+
+    std::vector<golden_checkpoint> run = golden_run(moving,sizeof(moving),options);
+    REQUIRE(run.size() == 6);
+    REQUIRE(run.back().frame == 300);
+    // the halt ends the run at the first frame with the timer at 0
+    std::vector<golden_checkpoint> halted = golden_run(waiting,sizeof(waiting),options);
+    REQUIRE(halted.size() == 1);
+    REQUIRE(halted.back().frame == 48);
+
+    std::vector<unsigned char> bytes;
+    builder.encode(bytes);
+    golden_store store;
+    REQUIRE(store.open(bytes.data(),bytes.size()));
+    REQUIRE(store.size() == 2);
+    REQUIRE(store.options().interval == 50);
+    golden_store::outcome outcome = store.check(moving,sizeof(moving));
+    REQUIRE(outcome.result == golden_store::pass);
+    REQUIRE(outcome.checkpoints == 6);
+    REQUIRE(store.check(waiting,sizeof(waiting)).result == golden_store::pass);
+    REQUIRE(store.check(unknown,sizeof(unknown)).result == golden_store::missing);
+
+    // a different framebuffer at the third checkpoint stops the comparison there
+    std::vector<unsigned char> changed = bytes;
+    size_t entry = 0;
+    while(entry < 2){
+        const unsigned char *p = changed.data()+golden_header_size+entry*golden_entry_size;
+        if(p[12] == 6)
+            break;
+        ++entry;
+    }
+    REQUIRE(entry < 2);
+    unsigned char *p = changed.data()+golden_header_size+entry*golden_entry_size;
+    size_t offset = p[8] | p[9] << 8 | p[10] << 16 | p[11] << 24;
+    changed[offset+2*golden_checkpoint_size+8] ^= 1;
+    REQUIRE(!store.open(changed.data(),changed.size()));
+    REQUIRE(store.error() == "golden store checksum mismatch");
+    uint64_t checksum = fnv1a_64(changed.data()+golden_header_size,changed.size()-golden_header_size);
+    for(int i = 0; i < 8; ++i)
+        changed[40+i] = (unsigned char)(checksum >> (8*i));
+    REQUIRE(store.open(changed.data(),changed.size()));
+    outcome = store.check(moving,sizeof(moving));
+    REQUIRE(outcome.result == golden_store::diverged);
+    REQUIRE(outcome.frame == 150);
+    REQUIRE(outcome.checkpoints == 2);
+    REQUIRE(outcome.framebuffer_differs);
+    REQUIRE(!outcome.digest_differs);
+
+    // checks run with the settings of the store
+    options.instructions_per_frame = 11;
+    golden_builder faster(options);
+    faster.add(moving,sizeof(moving));
+    faster.encode(bytes);
+    REQUIRE(store.open(bytes.data(),bytes.size()));
+    REQUIRE(store.check(moving,sizeof(moving)).result == golden_store::pass);
+    REQUIRE(store.options().instructions_per_frame == 11);
+
+    bytes.resize(bytes.size()-1);
+    REQUIRE(!store.open(bytes.data(),bytes.size()));
+    REQUIRE(store.error() == "golden store is truncated");
+}
+
+// translated from test_roms by chip8_aot, see CMakeLists.txt
+extern const aot_program aot_loop;
+extern const aot_program aot_smc_store;
+extern const aot_program aot_smc_bcd;
+
+TEST_CASE("ahead of time recompiler"," "){
+    // the runtime has to stop at the same instruction and in the same state as the interpreter
+    auto same = [](const aot_program &program, unsigned long long cycles, unsigned long long step){
+        chip8 interpreter, native;
+        interpreter.load_program(program.rom,program.rom_size);
+        native.load_program(program.rom,program.rom_size);
+        interpreter.seed(0);
+        native.seed(0);
+        aot_runtime runtime(program);
+        for(unsigned long long done = 0; done < cycles; done += step){
+            for(unsigned long long i = 0; i < step; ++i)
+                interpreter.cycle();
+            runtime.run(native,step);
+            if(interpreter.digest() != native.digest() || interpreter.PC != native.PC)
+                return false;
+        }
+        return true;
+    };
+    REQUIRE(aot_loop.block_count > 0);
+    REQUIRE(same(aot_loop,1000,1));
+    REQUIRE(same(aot_loop,1000,7));
+    REQUIRE(same(aot_loop,1000,100));
+    // the translated block overwrites its own next instruction with FX55 and FX33
+    REQUIRE(same(aot_smc_store,100,1));
+    REQUIRE(same(aot_smc_store,100,100));
+    REQUIRE(same(aot_smc_bcd,100,1));
+    REQUIRE(same(aot_smc_bcd,100,100));
+
+    // the translation checks the rest of the block after the store, but not after the last instruction
+    std::ostringstream out;
+    REQUIRE(recompile(aot_smc_store.rom,aot_smc_store.rom_size,"smc",out));
+    REQUIRE(out.str().find("aot_intact(ch8,smc_rom,0x208,0x20C)") != std::string::npos);
+    REQUIRE(out.str().find("extern const aot_program smc") != std::string::npos);
+    // an empty ROM would become a zero length array
+    std::ostringstream empty;
+    REQUIRE(!recompile(aot_smc_store.rom,0,"empty",empty));
+    REQUIRE(empty.str().empty());
+}
@@ -0,0 +1,74 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_TRIPLE_BUFFER_H
+#define CHIP_8_TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock free triple buffer for one writer and one reader thread. The writer fills back() and publishes it, the reader
+// picks up the latest published buffer with update() and reads front(). Neither side ever waits for the other, a
+// reader which is slower than the writer simply skips buffers.
+template<typename T>
+class triple_buffer {
+public:
+    // writer: the buffer which is filled next
+    T &back(){
+        return buffers[back_index];
+    }
+
+    // writer: hands the back buffer to the reader and continues with the previously published buffer
+    void publish(){
+        unsigned previous = middle.exchange(back_index | fresh, std::memory_order_acq_rel);
+        back_index = previous & index_mask;
+    }
+
+    // reader: takes the latest published buffer. Returns false if nothing was published since the last call
+    bool update(){
+        if((middle.load(std::memory_order_relaxed) & fresh) == 0)
+            return false;
+        unsigned previous = middle.exchange(front_index, std::memory_order_acq_rel);
+        front_index = previous & index_mask;
+        return true;
+    }
+
+    // reader: the buffer taken by the last update()
+    const T &front() const {
+        return buffers[front_index];
+    }
+
+private:
+    static const unsigned index_mask = 0x3;
+    // set if the middle buffer was published and not yet taken by the reader
+    static const unsigned fresh = 0x4;
+
+    T buffers[3] {};
+
+    // the buffer which is exchanged between writer and reader. Each side owns one of the other two buffers
+    alignas(64) std::atomic<unsigned> middle {1};
+    alignas(64) unsigned back_index {0};
+    alignas(64) unsigned front_index {2};
+};
+
+#endif //CHIP_8_TRIPLE_BUFFER_H
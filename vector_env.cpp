@@ -0,0 +1,197 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "vector_env.h"
+#include <algorithm>
+#include <cstring>
+
+vector_env::vector_env(const unsigned char *rom, size_t size, const vector_env_options &options) : options(options) {
+    if(this->options.frame_skip == 0)
+        this->options.frame_skip = 1;
+    initial.load_program(rom,size);
+    initial.instructions_per_frame = options.instructions_per_frame;
+    if(options.vip_timing)
+        initial.timing = chip8::cosmac_vip;
+
+    machines.reserve(options.envs);
+    for(size_t i = 0; i < options.envs; ++i)
+        machines.emplace_back(new chip8(initial));
+    slots.resize(options.envs);
+
+    unsigned int threads = options.threads;
+    if(threads == 0)
+        threads = std::max(1u,std::thread::hardware_concurrency());
+    threads = (unsigned int)std::min<size_t>(threads,std::max<size_t>(1,options.envs));
+    for(unsigned int i = 1; i < threads; ++i)
+        workers.emplace_back(&vector_env::work,this,i);
+}
+
+vector_env::~vector_env() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for(std::thread &t : workers)
+        t.join();
+}
+
+uint64_t vector_env::episodes() const {
+    uint64_t count = 0;
+    for(const slot &s : slots)
+        count += s.episodes;
+    return count;
+}
+
+long vector_env::score(const chip8 &ch8) const {
+    const unsigned char *p = ch8.memory;
+    unsigned short a = options.score_address & 0x0FFF;
+    switch(options.score){
+        case vector_env_options::score_byte:
+            return p[a];
+        case vector_env_options::score_word:
+            return p[a] << 8 | p[(a+1) & 0x0FFF];
+        case vector_env_options::score_bcd:
+            return p[a]*100+p[(a+1) & 0x0FFF]*10+p[(a+2) & 0x0FFF];
+        default:
+            return 0;
+    }
+}
+
+bool vector_env::done(const chip8 &ch8, const slot &s) const {
+    if(options.done_value >= 0 && ch8.memory[options.done_address & 0x0FFF] == options.done_value)
+        return true;
+    if(options.max_episode_frames > 0 && s.frames >= options.max_episode_frames)
+        return true;
+    // the self_jump of halt_detector. Its repeated states do not apply, the agent changes the keys
+    unsigned short pc = ch8.PC & 0x0FFF;
+    unsigned short next = ch8.memory[pc] << 8 | ch8.memory[(pc+1) & 0x0FFF];
+    return next == (0x1000 | pc) && ch8.delay_timer == 0 && ch8.sound_timer == 0;
+}
+
+void vector_env::start_episode(size_t i) {
+    chip8 &ch8 = *machines[i];
+    slot &s = slots[i];
+    // chip8 is trivially copyable, this is a memcpy of the state with the ROM loaded
+    ch8 = initial;
+    ch8.seed(s.seed+s.episodes);
+    s.frames = 0;
+    s.score = score(ch8);
+    s.finished = false;
+}
+
+void vector_env::reset(const uint64_t *seeds, unsigned char *observations) {
+    for(size_t i = 0; i < machines.size(); ++i){
+        slots[i] = slot();
+        slots[i].seed = seeds[i];
+        start_episode(i);
+        if(observations != nullptr)
+            std::memcpy(observations+i*observation_size,machines[i]->framebuffer(),observation_size);
+    }
+}
+
+void vector_env::step_range(size_t first, size_t last) {
+    for(size_t i = first; i < last; ++i){
+        chip8 &ch8 = *machines[i];
+        slot &s = slots[i];
+        if(s.finished)
+            start_episode(i);
+
+        uint16_t keys = actions[i];
+        for(int k = 0; k < 16; ++k)
+            ch8.key[k] = (keys >> k) & 1;
+
+        unsigned char *observation = observations+i*observation_size;
+        bool pooled = false;
+        for(unsigned int frame = 0; frame < options.frame_skip && !s.finished; ++frame){
+            ch8.run_frame();
+            ++s.frames;
+            s.finished = done(ch8,s);
+            if(options.max_pool && frame+2 == options.frame_skip && !s.finished){
+                std::memcpy(observation,ch8.framebuffer(),observation_size);
+                pooled = true;
+            }
+        }
+        const unsigned char *pixels = ch8.framebuffer();
+        if(pooled){
+            for(size_t p = 0; p < observation_size; ++p)
+                observation[p] |= pixels[p];
+        }else
+            std::memcpy(observation,pixels,observation_size);
+
+        long now = score(ch8);
+        rewards[i] = (float)(now-s.score);
+        s.score = now;
+        dones[i] = s.finished;
+        if(s.finished)
+            ++s.episodes;
+    }
+}
+
+void vector_env::range(unsigned int index, size_t &first, size_t &last) const {
+    size_t parts = workers.size()+1;
+    first = machines.size()*index/parts;
+    last = machines.size()*(index+1)/parts;
+}
+
+void vector_env::step(const uint16_t *actions, unsigned char *observations, float *rewards, unsigned char *dones) {
+    this->actions = actions;
+    this->observations = observations;
+    this->rewards = rewards;
+    this->dones = dones;
+    if(workers.empty()){
+        step_range(0,machines.size());
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generation;
+        pending = (unsigned int)workers.size();
+    }
+    wake.notify_all();
+    size_t first, last;
+    range(0,first,last);
+    step_range(first,last);
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock,[this]{ return pending == 0; });
+}
+
+void vector_env::work(unsigned int index) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;){
+        wake.wait(lock,[this,seen]{ return quitting || generation != seen; });
+        if(quitting)
+            return;
+        seen = generation;
+        lock.unlock();
+        size_t first, last;
+        range(index,first,last);
+        step_range(first,last);
+        lock.lock();
+        if(--pending == 0)
+            idle.notify_one();
+    }
+}
@@ -0,0 +1,139 @@
+/*MIT License
+
+Copyright (c) 2019 by lyinch
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef CHIP_8_VECTOR_ENV_H
+#define CHIP_8_VECTOR_ENV_H
+
+#include "chip8.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A batch of environments for reinforcement learning, all running the same ROM. reset() and step() work on every
+// environment at once and write into arrays of the caller, environment i at index i:
+//   actions       uint16 per environment, bit K holds key K for the whole step
+//   observations  observation_size bytes per environment, one byte per pixel which is 0 or 1
+//   rewards       float per environment, how much the score in memory grew during the step
+//   dones         uint8 per environment, 1 if the episode ended during the step
+// A step emulates frame_skip frames. CHIP-8 games draw by XOR and flicker a lot, so by default the observation is
+// the OR of the last two frames. An episode ends once the ROM jumps to itself, a byte in memory has a value or it
+// ran too many frames. A finished environment starts its next episode at the beginning of the next step, seeded with
+// its seed plus the number of episodes it finished.
+//
+// step() does not allocate. With more than one thread the environments are split into one contiguous range per
+// thread, the threads are started once and wait for the next step.
+struct vector_env_options {
+    size_t envs {1};
+    unsigned int frame_skip {4};
+    // the calling thread counts, 0 uses every core
+    unsigned int threads {1};
+    bool max_pool {true};
+
+    unsigned int instructions_per_frame {10};
+    bool vip_timing {false};
+
+    enum score_format {
+        no_score,
+        // one byte at score_address
+        score_byte,
+        // big endian word at score_address
+        score_word,
+        // three decimal digits at score_address, as FX33 stores them
+        score_bcd
+    };
+    score_format score {no_score};
+    unsigned short score_address {0};
+
+    // the episode ends when the byte at done_address equals done_value. Negative values turn this off
+    unsigned short done_address {0};
+    int done_value {-1};
+    // 0 does not limit the length of an episode
+    uint64_t max_episode_frames {0};
+};
+
+class vector_env {
+public:
+    static const size_t observation_size = chip8::width*chip8::height;
+
+    vector_env(const unsigned char *rom, size_t size, const vector_env_options &options = vector_env_options());
+    vector_env(const vector_env &) = delete;
+    vector_env &operator=(const vector_env &) = delete;
+    ~vector_env();
+
+    size_t size() const {
+        return machines.size();
+    }
+
+    // starts a new episode in every environment. observations may be null
+    void reset(const uint64_t *seeds, unsigned char *observations);
+
+    void step(const uint16_t *actions, unsigned char *observations, float *rewards, unsigned char *dones);
+
+    const chip8 &env(size_t i) const {
+        return *machines[i];
+    }
+
+    // episodes finished by all environments
+    uint64_t episodes() const;
+
+private:
+    struct slot {
+        uint64_t seed {0};
+        uint64_t episodes {0};
+        uint64_t frames {0};
+        long score {0};
+        bool finished {false};
+    };
+
+    vector_env_options options;
+    chip8 initial;
+    std::vector<std::unique_ptr<chip8>> machines;
+    std::vector<slot> slots;
+
+    // the arguments of the current step
+    const uint16_t *actions {nullptr};
+    unsigned char *observations {nullptr};
+    float *rewards {nullptr};
+    unsigned char *dones {nullptr};
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    uint64_t generation {0};
+    unsigned int pending {0};
+    bool quitting {false};
+
+    long score(const chip8 &ch8) const;
+    bool done(const chip8 &ch8, const slot &s) const;
+    void start_episode(size_t i);
+    void step_range(size_t first, size_t last);
+    void work(unsigned int index);
+    void range(unsigned int index, size_t &first, size_t &last) const;
+};
+
+#endif //CHIP_8_VECTOR_ENV_H